@@ -0,0 +1,192 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * frame_cache: decoded frames shared by the players running on a host.
+ *
+ * A POSIX shared memory segment holds fixed-size slots, each with the frame
+ * of a (drive, stream, index) key. The first player needing a frame decodes
+ * it into a free slot; the other ones find it there and read it in place:
+ *
+ *     kitti_player::FrameCache cache;
+ *     cache.open("/kitti_player.frame_cache", 256 << 20, 2 << 20);
+ *     uint64_t key = kitti_player::FrameCache::key(drive, stream, frame);
+ *     kitti_player::FrameCacheView view;
+ *     if (!cache.find(key, view))
+ *         if (uint8_t *slot = cache.reserve(key, bytes, view))
+ *             // decode into slot, then
+ *             cache.commit(view, info);
+ *     // view.data(), view.info(): valid until view is released
+ *
+ * Slots are reference counted: a slot held by a view is never evicted, the
+ * least recently used free one is. The table is guarded by a robust
+ * process-shared mutex, so that a crashed player does not block the others.
+ * A reserved slot is leased to the random token of its writer: once the lease
+ * expires, the slot is dropped and the late writer can no longer commit it,
+ * without relying on pids (reused, or of another namespace). Such a slot is
+ * never reserved again, since a stalled writer may still copy into it; it is
+ * lost, as the views a crashed player held, until the segment is removed
+ * (rm /dev/shm/kitti_player.frame_cache).
+ *
+ * The segment is created 0600, minus the umask: only the players of the user
+ * share it.
+ */
+
+#ifndef KITTI_PLAYER_FRAME_CACHE_H
+#define KITTI_PLAYER_FRAME_CACHE_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+namespace kitti_player
+{
+
+struct FrameCacheHeader;
+struct FrameCacheEntry;
+class FrameCache;
+
+/**
+ * @brief The FrameCacheView class holds a slot of the cache, and releases it when destroyed
+ */
+class FrameCacheView
+{
+public:
+    FrameCacheView() : cache_(NULL), entry_(0), reservation_(0), data_(NULL), size_(0)
+    {
+        info_[0] = info_[1] = info_[2] = 0;
+    }
+
+    ~FrameCacheView()
+    {
+        release();
+    }
+
+    bool valid() const
+    {
+        return cache_ != NULL;
+    }
+
+    /// frame bytes; only the player that reserved the slot writes them, before commit
+    const uint8_t *data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    /// caller data stored with the frame, e.g. rows, cols and type of an image
+    const uint32_t *info() const
+    {
+        return info_;
+    }
+
+    /// lets the cache evict the slot (or drops it, if reserved and not committed)
+    void release();
+
+private:
+    friend class FrameCache;
+
+    FrameCacheView(const FrameCacheView &);
+    FrameCacheView &operator=(const FrameCacheView &);
+
+    FrameCache     *cache_;
+    uint32_t        entry_;
+    uint64_t        reservation_;   // of the frame held, to tell a dropped slot
+    const uint8_t  *data_;
+    size_t          size_;
+    uint32_t        info_[3];
+};
+
+/**
+ * @brief The FrameCache class attaches to (or creates) a shared frame cache segment
+ *
+ * Thread-safe: the players threads share one instance.
+ */
+class FrameCache
+{
+public:
+    FrameCache();
+    ~FrameCache();
+
+    /**
+     * @brief open attaches to the segment, or creates it
+     * @param name segment name, "/name"
+     * @param bytes segment size, when created
+     * @param slot_size bytes per frame, when created; larger frames are not cached
+     * @return 1 if the segment is mapped, 0 otherwise
+     *
+     * An existing segment keeps its own size and slots.
+     */
+    int open(const std::string &name, size_t bytes, size_t slot_size);
+
+    /// unmaps the segment, that stays for the other players; views must be released before
+    void close();
+
+    bool isOpen() const
+    {
+        return header_ != NULL;
+    }
+
+    uint32_t slotCount() const;
+    size_t slotSize() const;
+
+    /**
+     * @brief key of a frame
+     * @param drive drive identifier, e.g. its absolute path
+     * @param stream stream of the drive, e.g. a kitti_player::Sensor
+     * @param frame frame index
+     */
+    static uint64_t key(const std::string &drive, uint32_t stream, uint32_t frame);
+
+    /**
+     * @brief find holds the frame of key, waiting for it if another player is writing it
+     * @param key frame key
+     * @param view holds the slot until released
+     * @return 1 if the frame is in the cache, 0 otherwise
+     */
+    int find(uint64_t key, FrameCacheView &view);
+
+    /**
+     * @brief reserve evicts the least recently used free slot for a new frame
+     * @param key frame key
+     * @param size frame bytes
+     * @param view holds the slot, to commit or release
+     * @return the slot bytes to write, NULL if the frame is too large, is being
+     *         written by another player or no slot is free
+     *
+     * The slot is leased for a few seconds: it is meant to be filled and committed right away.
+     */
+    uint8_t *reserve(uint64_t key, size_t size, FrameCacheView &view);
+
+    /**
+     * @brief commit makes a reserved frame visible to the other players; view keeps holding it
+     * @param view view returned by reserve
+     * @param info caller data, 3 values
+     * @return 1 if the frame is committed, 0 if the lease expired and the slot was dropped
+     */
+    int commit(FrameCacheView &view, const uint32_t *info);
+
+private:
+    friend class FrameCacheView;
+
+    FrameCache(const FrameCache &);
+    FrameCache &operator=(const FrameCache &);
+
+    void lock();
+    void unlock();
+    void release(uint32_t entry, uint64_t reservation);
+    FrameCacheEntry *entry(uint32_t index) const;
+    uint8_t *slot(uint32_t index) const;
+
+    FrameCacheHeader   *header_;
+    size_t              bytes_;
+    std::string         name_;
+    uint64_t            token_;     // random, identifies the slots this player writes
+};
+
+} // namespace kitti_player
+
+#endif // KITTI_PLAYER_FRAME_CACHE_H
@@ -0,0 +1,73 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * image_codec: fast-decoding lossless image files (.kqi), written by
+ * kitti_transcode under image_0x/data_kqi/ and read by the player in place
+ * of the PNG images.
+ *
+ * A .kqi file is a KqiHeader followed by the pixels, coded as in QOI
+ * (https://qoiformat.org): a byte stream of runs, references to a 64-entry
+ * table of recently seen pixels, small differences to the previous pixel and
+ * raw pixels. Decoding is a single pass with no entropy coder, several times
+ * faster than PNG inflate and unfiltering, for files of about the PNG size.
+ *
+ * Color images use the QOI operations on the B, G, R channels; grayscale
+ * images have their own variant, as QOI is RGB(A) only:
+ *
+ *   00iiiiii           INDEX   table[i]
+ *   01dddddd           DIFF    previous + d, d in -32..31
+ *   11rrrrrr           RUN     previous, r + 1 times (r < 62)
+ *   11111110 v         RAW     v
+ */
+
+#ifndef KITTI_PLAYER_IMAGE_CODEC_H
+#define KITTI_PLAYER_IMAGE_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace kitti_player
+{
+
+static const char     kKqiMagic[4]  = { 'K', 'Q', 'I', '1' };
+
+/// file header, little endian
+struct KqiHeader
+{
+    char        magic[4];
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    channels;   // 1: MONO8, 3: BGR8
+};
+
+/**
+ * @brief imageCacheDirectory
+ * @param data_dir image data directory, e.g. drive/image_02/data/
+ * @return the directory of the transcoded images, e.g. drive/image_02/data_kqi/
+ */
+std::string imageCacheDirectory(const std::string &data_dir);
+
+/**
+ * @brief encodeImage
+ * @param image 8 bit image, 1 (mono) or 3 (BGR) channels
+ * @param file output .kqi file content
+ * @return 1 if the image is encoded, 0 if its type is not supported
+ */
+int encodeImage(const cv::Mat &image, std::vector<uint8_t> &file);
+
+/**
+ * @brief decodeImage
+ * @param file .kqi file content
+ * @param size bytes of file
+ * @param image output image; its buffer is reused when the size and type match
+ * @return 1 if the file is decoded, 0 if it is not a valid .kqi file
+ */
+int decodeImage(const uint8_t *file, size_t size, cv::Mat &image);
+
+} // namespace kitti_player
+
+#endif // KITTI_PLAYER_IMAGE_CODEC_H
@@ -0,0 +1,520 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * kitti_reader: ROS-free loaders for KITTI raw drives.
+ *
+ * The parsers used by kitti_player (timestamps, calibration, oxts packets,
+ * velodyne scans, images) and a Drive class giving random and sequential
+ * access to the synchronized frames of a drive, with background prefetch:
+ *
+ *     kitti_player::Drive drive;
+ *     if (!drive.open("2011_09_26/2011_09_26_drive_0001_sync/"))
+ *         return -1;
+ *     drive.setPrefetch(4);
+ *     for (kitti_player::Drive::iterator it = drive.begin(); it != drive.end(); ++it)
+ *     {
+ *         kitti_player::FrameConstPtr frame = *it;
+ *         // frame->velodyne.data(): x y z reflectance, mapped from the file
+ *     }
+ */
+
+#ifndef KITTI_PLAYER_KITTI_READER_H
+#define KITTI_PLAYER_KITTI_READER_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <opencv2/core/core.hpp>
+
+namespace kitti_player
+{
+
+/**
+ * @brief The Timestamp struct is a KITTI timestamp, seconds since the epoch
+ */
+struct Timestamp
+{
+    uint32_t sec;
+    uint32_t nsec;
+
+    Timestamp() : sec(0), nsec(0) {}
+    Timestamp(uint32_t s, uint32_t ns) : sec(s), nsec(ns) {}
+
+    double toSec() const
+    {
+        return sec + 1e-9 * nsec;
+    }
+
+    bool isZero() const
+    {
+        return sec == 0 && nsec == 0;
+    }
+
+    bool operator<(const Timestamp &other) const
+    {
+        return sec < other.sec || (sec == other.sec && nsec < other.nsec);
+    }
+};
+
+/**
+ * @brief parseTimestamp
+ * @param line timestamp as in timestamps.txt, e.g. 2011-09-26 13:21:35.134391552 (local time)
+ * @param stamp output timestamp
+ * @return 1 if line is a timestamp, 0 otherwise
+ */
+int parseTimestamp(const std::string &line, Timestamp &stamp);
+
+/**
+ * @brief loadTimestamps reads a whole timestamps.txt file
+ * @param filename the timestamps file
+ * @param timestamps output table, one entry per frame
+ * @return 1 if file is correctly readed, 0 otherwise
+ */
+int loadTimestamps(const std::string &filename, std::vector<Timestamp> &timestamps);
+
+/**
+ * @brief countFiles
+ * @param dir directory to scan, on disk or in a mounted archive
+ * @return number of entries in dir, . & .. excluded
+ */
+unsigned int countFiles(const std::string &dir);
+
+/**
+ * @brief isDirectory
+ * @param dir directory, on disk or in a mounted archive (zip_archive.h)
+ * @return true if dir exists
+ */
+bool isDirectory(const std::string &dir);
+
+/**
+ * @brief fileExists
+ * @param filename file, on disk or in a mounted archive
+ * @return true if filename exists
+ */
+bool fileExists(const std::string &filename);
+
+/**
+ * @brief readFile reads a whole file, decompressing archive members
+ * @param filename file, on disk or in a mounted archive
+ * @param buffer output content, its capacity is reused
+ * @return 1 if file is correctly readed, 0 otherwise
+ */
+int readFile(const std::string &filename, std::vector<uint8_t> &buffer);
+
+/**
+ * @brief prefetchFile asks the kernel to read a file ahead, without waiting for it
+ * @param filename file, on disk or in a mounted archive
+ */
+void prefetchFile(const std::string &filename);
+
+/// digits of the frame numbers: raw drives name their files 0000000042.png, odometry sequences 000042.png
+const unsigned int kRawFrameDigits = 10;
+const unsigned int kOdometryFrameDigits = 6;
+
+/**
+ * @brief frameFilename
+ * @param dir data directory, with the trailing /
+ * @param frame frame number
+ * @param extension e.g. ".png"
+ * @param digits zero padded width of the frame number
+ * @return dir/0000000042.png
+ */
+std::string frameFilename(const std::string &dir, unsigned int frame, const char *extension, unsigned int digits = kRawFrameDigits);
+
+/// as above, reusing the storage of filename
+void frameFilename(const std::string &dir, unsigned int frame, const char *extension, std::string &filename, unsigned int digits = kRawFrameDigits);
+
+/**
+ * @brief The CameraCalibration struct holds the calib_cam_to_cam.txt entries of a camera
+ */
+struct CameraCalibration
+{
+    double K[9];    // calibration matrix before rectification
+    double D[5];    // distortion coefficients before rectification
+    double R[9];    // rotation matrix (extrinsic)
+    double P[12];   // projection matrix after rectification
+    double R_rect[9];   // rectifying rotation
+    double S_rect[2];   // image width, height after rectification
+
+    CameraCalibration();
+};
+
+/**
+ * @brief loadCameraCalibration
+ * @param dir_root drive directory, with the trailing /; the file is searched there, then in the day directory above
+ * @param camera_name "00" ... "03"
+ * @param calibration output calibration
+ * @return 1: file found, 0: file not found
+ */
+int loadCameraCalibration(const std::string &dir_root, const std::string &camera_name, CameraCalibration &calibration);
+
+/**
+ * @brief loadImuToVelo reads calib_imu_to_velo.txt: p_velo = R * p_imu + T
+ * @param dir_root drive directory, with the trailing /; the file is searched there, then in the day directory above
+ * @param R double R[9] - rotation from IMU to velodyne frame
+ * @param T double T[3] - translation from IMU to velodyne frame
+ * @return 1: file found, 0: file not found
+ */
+int loadImuToVelo(const std::string &dir_root, double *R, double *T);
+
+/**
+ * @brief loadVeloToCam reads calib_velo_to_cam.txt: p_cam00 = R * p_velo + T, before rectification
+ * @param dir_root drive directory, with the trailing /; the file is searched there, then in the day directory above
+ * @param R double R[9] - rotation from velodyne to camera 00 frame
+ * @param T double T[3] - translation from velodyne to camera 00 frame
+ * @return 1: file found, 0: file not found
+ */
+int loadVeloToCam(const std::string &dir_root, double *R, double *T);
+
+/**
+ * @brief The OdometryCalibration struct holds the calib.txt of an odometry sequence
+ */
+struct OdometryCalibration
+{
+    double P[4][12];    // projection matrices of image_0 ... image_3, rectified, from the image_0 frame
+    double Tr[12];      // velodyne to image_0 frame, 3x4: p_cam0 = Tr * p_velo
+
+    OdometryCalibration();
+};
+
+/**
+ * @brief loadOdometryCalibration
+ * @param filename calib.txt of the sequence
+ * @param calibration output calibration
+ * @return 1 if the file holds the P0 ... P3 and Tr lines, 0 otherwise
+ */
+int loadOdometryCalibration(const std::string &filename, OdometryCalibration &calibration);
+
+/**
+ * @brief loadOdometryTimes reads the times.txt of an odometry sequence
+ * @param filename the times file
+ * @param times output, seconds from the sequence start, one entry per frame
+ * @return 1 if file is correctly readed, 0 otherwise
+ */
+int loadOdometryTimes(const std::string &filename, std::vector<double> &times);
+
+/**
+ * @brief loadOdometryPoses reads a ground truth file of the odometry benchmark, poses/XX.txt
+ * @param filename the poses file
+ * @param poses output, 12 values per frame: the 3x4 pose of image_0 in the image_0 frame of frame 0, row major
+ * @return 1 if file is correctly readed, 0 otherwise
+ */
+int loadOdometryPoses(const std::string &filename, std::vector<double> &poses);
+
+/**
+ * @brief The OxtsPacket struct is a line of an oxts file, fields as in the KITTI devkit
+ */
+struct OxtsPacket
+{
+    double lat, lon, alt;               // deg, deg, m
+    double roll, pitch, yaw;            // rad
+    double vn, ve;                      // north, east velocity (m/s)
+    double vf, vl, vu;                  // forward, leftward, upward velocity (m/s)
+    double ax, ay, az;                  // acceleration in the vehicle frame (m/s^2)
+    double af, al, au;                  // forward, leftward, upward acceleration (m/s^2)
+    double wx, wy, wz;                  // angular rate in the vehicle frame (rad/s)
+    double wf, wl, wu;                  // angular rate around forward, leftward, upward axes (rad/s)
+    double pos_accuracy, vel_accuracy;  // m, m/s
+    double navstat, numsats, posmode, velmode, orimode;
+
+    OxtsPacket();
+};
+
+/**
+ * @brief parseOxtsPacket
+ * @param line a line of an oxts file
+ * @param packet output packet
+ * @return 1 if the line holds at least the accuracy fields, 0 otherwise
+ */
+int parseOxtsPacket(const std::string &line, OxtsPacket &packet);
+
+/**
+ * @brief loadOxtsPacket
+ * @param filename oxts file
+ * @param packet output packet
+ * @return 1 if file is correctly readed, 0 otherwise
+ */
+int loadOxtsPacket(const std::string &filename, OxtsPacket &packet);
+
+/**
+ * @brief The VelodyneScan class is a scan, 4 floats per point: x, y, z, reflectance
+ *
+ * Binary scans are memory mapped copy-on-write: loading costs no copy, and
+ * writes through data() stay private to the process. Copies of a scan share
+ * the same points.
+ */
+class VelodyneScan
+{
+public:
+    VelodyneScan() : points_(NULL), count_(0) {}
+
+    /**
+     * @brief load
+     * @param filename scan, binary (.bin), text (.txt, unsynced drives) or transcoded (.kvc)
+     * @return 1 if file is correctly readed, 0 otherwise
+     */
+    int load(const std::string &filename);
+
+    /**
+     * @brief load reads a scan into a buffer owned by the caller, reused frame after frame
+     * @param filename scan, binary (.bin), text (.txt, unsynced drives) or transcoded (.kvc)
+     * @param buffer keeps the points, must outlive the scan
+     * @return 1 if file is correctly readed, 0 otherwise
+     */
+    int load(const std::string &filename, std::vector<float> &buffer);
+
+    /// wraps points owned by the caller, that must outlive the scan
+    void wrap(float *points, size_t count);
+
+    const float *data() const
+    {
+        return points_;
+    }
+
+    float *data()
+    {
+        return points_;
+    }
+
+    /// number of points
+    size_t size() const
+    {
+        return count_;
+    }
+
+    bool empty() const
+    {
+        return count_ == 0;
+    }
+
+private:
+    boost::shared_ptr<void> storage_;   // mapping or buffer holding the points
+    float                  *points_;
+    size_t                  count_;
+};
+
+/**
+ * @brief loadImage
+ * @param filename png or transcoded (.kqi) image
+ * @param image output image, as stored (8 bit mono or BGR)
+ * @return 1 if file is correctly readed, 0 otherwise
+ */
+int loadImage(const std::string &filename, cv::Mat &image);
+
+/**
+ * @brief loadImage decodes into the existing buffers: no allocation when the size does not change
+ * @param filename png or transcoded (.kqi) image
+ * @param image output image; must not be shared, its data is overwritten
+ * @param file_buffer keeps the encoded file (unused for the stored members of an archive, mapped)
+ * @param flags cv::imread flags [-1: as stored], .kqi images are always as stored
+ * @return 1 if file is correctly readed, 0 otherwise
+ */
+int loadImage(const std::string &filename, cv::Mat &image, std::vector<uint8_t> &file_buffer, int flags = -1);
+
+/// Sensors of a drive
+enum Sensor
+{
+    IMAGE_00 = 0,       // grayscale left
+    IMAGE_01,           // grayscale right
+    IMAGE_02,           // color left
+    IMAGE_03,           // color right
+    VELODYNE_POINTS,
+    OXTS,
+    SENSORS
+};
+
+/// Sensor sets for Drive::open
+enum SensorMask
+{
+    GRAYSCALE_IMAGES = (1 << IMAGE_00) | (1 << IMAGE_01),
+    COLOR_IMAGES     = (1 << IMAGE_02) | (1 << IMAGE_03),
+    VELODYNE_SCANS   = (1 << VELODYNE_POINTS),
+    OXTS_PACKETS     = (1 << OXTS),
+    ALL_SENSORS      = (1 << SENSORS) - 1
+};
+
+/**
+ * @brief The Frame struct holds the data of every loaded sensor at one frame
+ */
+struct Frame
+{
+    unsigned int    index;
+    Timestamp       stamp[SENSORS];     // zero if the sensor has no timestamps
+    cv::Mat         image[4];           // image_00 ... image_03, empty if not loaded
+    VelodyneScan    velodyne;
+    OxtsPacket      oxts;
+
+    Frame() : index(0) {}
+};
+
+typedef boost::shared_ptr<const Frame> FrameConstPtr;
+
+/**
+ * @brief The Drive class gives access to the synchronized frames of a KITTI raw drive
+ *
+ * Frames are loaded on demand; with setPrefetch() a background thread loads
+ * the frames following the last one requested, so that sequential reads
+ * only wait for the first one.
+ */
+class Drive
+{
+public:
+    class iterator;
+
+    Drive();
+    ~Drive();
+
+    /**
+     * @brief open reads the frame counts, timestamps and calibrations of a drive
+     * @param path drive directory, e.g. 2011_09_26/2011_09_26_drive_0001_sync/, or its
+     *        zip archive, e.g. 2011_09_26_drive_0001_sync.zip (mounted, see zip_archive.h)
+     * @param sensors SensorMask of the sensors to load
+     * @return 1 if every requested sensor is found, 0 otherwise
+     */
+    int open(const std::string &path, unsigned int sensors = ALL_SENSORS);
+
+    /// number of frames, the shortest of the loaded sensors
+    size_t size() const
+    {
+        return size_;
+    }
+
+    unsigned int sensors() const
+    {
+        return sensors_;
+    }
+
+    const std::string &path() const
+    {
+        return path_;
+    }
+
+    /// data directory of a sensor, with the trailing /
+    std::string directory(Sensor sensor) const;
+
+    /**
+     * @brief setUseCaches, before open()
+     * @param use read the transcoded files (image_0x/data_kqi/,
+     *        velodyne_points/data_kvc/) when complete, instead of the raw ones [default: true]
+     */
+    void setUseCaches(bool use)
+    {
+        use_caches_ = use;
+    }
+
+    const std::vector<Timestamp> &timestamps(Sensor sensor) const
+    {
+        return timestamps_[sensor];
+    }
+
+    /// calibration of camera (IMAGE_00 ... IMAGE_03)
+    const CameraCalibration &calibration(Sensor camera) const
+    {
+        return calibration_[camera];
+    }
+
+    /**
+     * @brief load reads a frame, without caching or prefetch
+     * @param index frame number
+     * @param frame output frame
+     * @return 1 if every loaded sensor is read, 0 otherwise
+     */
+    int load(unsigned int index, Frame &frame) const;
+
+    /**
+     * @brief at random access to a frame, served from the prefetched frames when possible
+     * @param index frame number
+     * @return the frame, NULL if it cannot be read
+     */
+    FrameConstPtr at(unsigned int index);
+
+    /**
+     * @brief setPrefetch, before or after open(): the depth is kept across drives
+     * @param frames frames kept loaded from the last requested one on, itself included [0: no prefetch]
+     */
+    void setPrefetch(unsigned int frames);
+
+    iterator begin();
+    iterator end();
+
+    /**
+     * @brief The iterator class reads the frames in order
+     */
+    class iterator
+    {
+    public:
+        iterator() : drive_(NULL), index_(0) {}
+
+        FrameConstPtr operator*()
+        {
+            if (!frame_)
+                frame_ = drive_->at(index_);
+            return frame_;
+        }
+
+        iterator &operator++()
+        {
+            index_++;
+            frame_.reset();
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const
+        {
+            return index_ == other.index_;
+        }
+
+        bool operator!=(const iterator &other) const
+        {
+            return index_ != other.index_;
+        }
+
+        unsigned int index() const
+        {
+            return index_;
+        }
+
+    private:
+        friend class Drive;
+        iterator(Drive *drive, unsigned int index) : drive_(drive), index_(index) {}
+
+        Drive          *drive_;
+        unsigned int    index_;
+        FrameConstPtr   frame_;
+    };
+
+private:
+    Drive(const Drive &);
+    Drive &operator=(const Drive &);
+
+    void stopPrefetch();
+    void startPrefetch();
+    void prefetchLoop();
+
+    std::string             path_;
+    unsigned int            sensors_;
+    size_t                  size_;
+    std::string             data_directory_[SENSORS];   // data/ or the transcoded copy
+    std::string             extension_[SENSORS];
+    bool                    use_caches_;
+    std::vector<Timestamp>  timestamps_[SENSORS];
+    CameraCalibration       calibration_[4];
+
+    // prefetch: frames in [window_, window_ + prefetch_) are loaded in background
+    boost::mutex                            mutex_;
+    boost::condition_variable               cv_;
+    boost::thread                           thread_;
+    std::map<unsigned int, FrameConstPtr>   ready_;
+    unsigned int                            window_;
+    unsigned int                            prefetch_;
+    unsigned int                            loading_;   // frame being loaded by the prefetch thread
+    bool                                    stop_;
+};
+
+} // namespace kitti_player
+
+#endif // KITTI_PLAYER_KITTI_READER_H
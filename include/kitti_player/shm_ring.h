@@ -0,0 +1,431 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * Shared-memory ring of fixed-size slots, used by kitti_player to hand images
+ * and point clouds to processes on the same host without serialization.
+ *
+ * Header-only and ROS-free: consumers include this file, subscribe to the
+ * kitti_player/ShmDescriptor topic and map the slot named by each descriptor:
+ *
+ *     kitti_player::ShmRingReader reader;
+ *     reader.open(descriptor.segment);
+ *     kitti_player::ShmSlotView view;
+ *     if (reader.read(descriptor.slot, descriptor.sequence, view))
+ *         process(view.data(), view.size());    // valid until view is released
+ *
+ * A slot held by a view is not overwritten; the writer skips it and, when
+ * every slot is held, drops the frame. Views are leases of kShmLeaseMs: past
+ * it, a held slot is taken back, so that a crashed reader does not pin it
+ * forever, and view.current() turns false.
+ *
+ * The segments are created 0600 (less the umask): readers run as the user of
+ * the player.
+ */
+
+#ifndef KITTI_PLAYER_SHM_RING_H
+#define KITTI_PLAYER_SHM_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <stdint.h>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kitti_player
+{
+
+static const uint32_t kShmRingMagic   = 0x4b534852; // "KSHR"
+static const uint32_t kShmRingVersion = 2;
+
+/// segment header, followed by slot_count slots of slot_stride bytes
+struct ShmRingHeader
+{
+    uint32_t                magic;
+    uint32_t                version;
+    uint32_t                slot_count;
+    uint32_t                slot_size;      // payload bytes per slot
+    uint64_t                slot_stride;    // slot header + payload, cache line aligned
+    std::atomic<uint64_t>   next_sequence;  // sequence of the next committed slot, from 1
+};
+
+/// slot header, followed by the payload
+struct ShmSlotHeader
+{
+    std::atomic<uint64_t>   sequence;       // 0: never written
+    std::atomic<uint64_t>   state;          // generation << 32 | views holding the slot, kShmWriting while written
+    std::atomic<uint64_t>   lease;          // CLOCK_MONOTONIC ms of the latest read
+    uint32_t                size;           // payload bytes
+};
+
+static const uint32_t kShmWriting    = 0x80000000u;
+static const uint32_t kShmReaderMask = 0x7fffffffu;
+
+/// longest hold of a slot by a view, before the writer takes it back
+static const uint64_t kShmLeaseMs = 5000;
+
+/// CLOCK_MONOTONIC milliseconds, shared by the processes of the host
+inline uint64_t shmNowMs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint64_t(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+/// drops a hold of the slot, unless the writer took it back since (generation changed)
+inline void shmReleaseHold(ShmSlotHeader *slot, uint32_t generation)
+{
+    uint64_t state = slot->state.load(std::memory_order_relaxed);
+    while (uint32_t(state >> 32) == generation && (state & kShmReaderMask) != 0 &&
+           !slot->state.compare_exchange_weak(state, state - 1, std::memory_order_release, std::memory_order_relaxed))
+        ;
+}
+
+/// offset of the first slot and of the payload in a slot
+static const size_t kShmHeaderBytes = 64;
+
+inline size_t shmAlign(size_t bytes)
+{
+    return (bytes + 63) & ~size_t(63);
+}
+
+/**
+ * @brief The ShmRing class maps a ring segment, base of writer and reader
+ */
+class ShmRing
+{
+public:
+    ShmRing() : base_(NULL), bytes_(0) {}
+
+    ~ShmRing()
+    {
+        close();
+    }
+
+    /// true if a segment is mapped
+    bool isOpen() const
+    {
+        return base_ != NULL;
+    }
+
+    uint32_t slotCount() const
+    {
+        return header()->slot_count;
+    }
+
+    uint32_t slotSize() const
+    {
+        return header()->slot_size;
+    }
+
+    const std::string &name() const
+    {
+        return name_;
+    }
+
+    virtual void close()
+    {
+        if (base_ != NULL)
+            munmap(base_, bytes_);
+        base_ = NULL;
+        bytes_ = 0;
+    }
+
+protected:
+    ShmRingHeader *header() const
+    {
+        return static_cast<ShmRingHeader*>(base_);
+    }
+
+    ShmSlotHeader *slot(uint32_t index) const
+    {
+        return reinterpret_cast<ShmSlotHeader*>(static_cast<uint8_t*>(base_) + kShmHeaderBytes +
+                                                index * header()->slot_stride);
+    }
+
+    uint8_t *payload(uint32_t index) const
+    {
+        return reinterpret_cast<uint8_t*>(slot(index)) + kShmHeaderBytes;
+    }
+
+    /// maps fd, which is closed; return 1 if mapped, 0 otherwise
+    int map(int fd, size_t bytes)
+    {
+        void *base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED)
+            return 0;
+        base_ = base;
+        bytes_ = bytes;
+        return 1;
+    }
+
+    void           *base_;
+    size_t          bytes_;
+    std::string     name_;
+
+private:
+    ShmRing(const ShmRing &);
+    ShmRing &operator=(const ShmRing &);
+};
+
+/**
+ * @brief The ShmSlotView class holds a slot for reading, and releases it when destroyed
+ */
+class ShmSlotView
+{
+public:
+    ShmSlotView() : slot_(NULL), generation_(0), data_(NULL), size_(0) {}
+
+    ~ShmSlotView()
+    {
+        release();
+    }
+
+    const uint8_t *data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool valid() const
+    {
+        return slot_ != NULL;
+    }
+
+    /// false once the lease expired and the writer took the slot back: the data may be overwritten
+    bool current() const
+    {
+        return slot_ != NULL && uint32_t(slot_->state.load(std::memory_order_acquire) >> 32) == generation_;
+    }
+
+    /// lets the writer reuse the slot
+    void release()
+    {
+        if (slot_ != NULL)
+            shmReleaseHold(slot_, generation_);
+        slot_ = NULL;
+        data_ = NULL;
+        size_ = 0;
+    }
+
+private:
+    friend class ShmRingReader;
+
+    ShmSlotView(const ShmSlotView &);
+    ShmSlotView &operator=(const ShmSlotView &);
+
+    ShmSlotHeader  *slot_;
+    uint32_t        generation_;
+    const uint8_t  *data_;
+    size_t          size_;
+};
+
+/**
+ * @brief The ShmRingReader class maps an existing ring
+ */
+class ShmRingReader : public ShmRing
+{
+public:
+    /**
+     * @brief open
+     * @param name segment name, as in the descriptor
+     * @return 1 if the ring is mapped, 0 otherwise
+     */
+    int open(const std::string &name)
+    {
+        if (isOpen() && name == name_)
+            return 1;
+        close();
+
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+            return 0;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < kShmHeaderBytes)
+        {
+            ::close(fd);
+            return 0;
+        }
+        if (!map(fd, st.st_size))
+            return 0;
+        if (header()->magic != kShmRingMagic || header()->version != kShmRingVersion ||
+            kShmHeaderBytes + header()->slot_count * header()->slot_stride > bytes_)
+        {
+            close();
+            return 0;
+        }
+        name_ = name;
+        return 1;
+    }
+
+    /**
+     * @brief read maps a slot without copies
+     * @param index slot index, from the descriptor
+     * @param sequence slot sequence, from the descriptor
+     * @param view holds the slot until released
+     * @return 1 if the slot still holds sequence, 0 if it was overwritten
+     */
+    int read(uint32_t index, uint64_t sequence, ShmSlotView &view) const
+    {
+        view.release();
+        if (!isOpen() || index >= slotCount())
+            return 0;
+
+        ShmSlotHeader *s = slot(index);
+        uint64_t state = s->state.fetch_add(1, std::memory_order_acquire);
+        uint32_t generation = uint32_t(state >> 32);
+        if ((state & kShmWriting) || s->sequence.load(std::memory_order_acquire) != sequence)
+        {
+            shmReleaseHold(s, generation);
+            return 0;
+        }
+        s->lease.store(shmNowMs(), std::memory_order_release);
+        if (uint32_t(s->state.load(std::memory_order_acquire) >> 32) != generation)
+            return 0;   // taken back on the previous lease meanwhile
+        view.slot_ = s;
+        view.generation_ = generation;
+        view.data_ = payload(index);
+        view.size_ = s->size;
+        return 1;
+    }
+};
+
+/**
+ * @brief The ShmRingWriter class creates a ring and fills its slots
+ *
+ * Single writer: acquire() a free slot, fill its payload, commit() it and send
+ * the returned sequence in the descriptor.
+ */
+class ShmRingWriter : public ShmRing
+{
+public:
+    ShmRingWriter() : writing_(kNoSlot) {}
+
+    ~ShmRingWriter()
+    {
+        close();
+    }
+
+    /**
+     * @brief create creates a ring
+     * @param name segment name, "/name", unique to the writer
+     * @param slot_count number of slots
+     * @param slot_size payload bytes per slot
+     * @return 1 if the ring is created, 0 otherwise (errno EEXIST: the name is taken)
+     */
+    int create(const std::string &name, uint32_t slot_count, uint32_t slot_size)
+    {
+        close();
+        if (slot_count == 0 || slot_size == 0)
+            return 0;
+
+        uint64_t stride = kShmHeaderBytes + shmAlign(slot_size);
+        size_t bytes = kShmHeaderBytes + slot_count * stride;
+
+        // never replaces the segment of another writer
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+            return 0;
+        if (ftruncate(fd, bytes) != 0)
+        {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return 0;
+        }
+        if (!map(fd, bytes))
+        {
+            shm_unlink(name.c_str());
+            return 0;
+        }
+        name_ = name;
+
+        // ftruncate zero-fills: every slot is free and never written
+        ShmRingHeader *h = header();
+        h->magic = kShmRingMagic;
+        h->version = kShmRingVersion;
+        h->slot_count = slot_count;
+        h->slot_size = slot_size;
+        h->slot_stride = stride;
+        h->next_sequence.store(1, std::memory_order_release);
+        return 1;
+    }
+
+    /**
+     * @brief acquire reserves the oldest slot not held by a reader, or held past its lease
+     * @param index reserved slot
+     * @return payload of the slot, NULL if every slot is held
+     */
+    uint8_t *acquire(uint32_t &index)
+    {
+        if (!isOpen() || writing_ != kNoSlot)
+            return NULL;
+
+        const uint64_t now = shmNowMs();
+        uint32_t first = header()->next_sequence.load(std::memory_order_relaxed) % slotCount();
+        for (uint32_t i = 0; i < slotCount(); i++)
+        {
+            uint32_t candidate = (first + i) % slotCount();
+            ShmSlotHeader *s = slot(candidate);
+            uint64_t state = s->state.load(std::memory_order_acquire);
+            uint64_t reserved;
+            if ((state & kShmReaderMask) == 0)
+                reserved = state | kShmWriting;
+            else if (now > s->lease.load(std::memory_order_relaxed) + kShmLeaseMs)
+                reserved = ((state >> 32) + 1) << 32 | kShmWriting;     // a reader died holding it: new generation, its holds are void
+            else
+                continue;
+            if (s->state.compare_exchange_strong(state, reserved, std::memory_order_acq_rel))
+            {
+                writing_ = index = candidate;
+                return payload(candidate);
+            }
+        }
+        return NULL;
+    }
+
+    /**
+     * @brief commit makes the acquired slot readable
+     * @param size payload bytes written
+     * @return sequence of the slot, for the descriptor; 0 if no slot was acquired
+     */
+    uint64_t commit(uint32_t size)
+    {
+        if (writing_ == kNoSlot)
+            return 0;
+        ShmSlotHeader *s = slot(writing_);
+        uint64_t sequence = header()->next_sequence.fetch_add(1, std::memory_order_relaxed);
+        s->size = size;
+        s->sequence.store(sequence, std::memory_order_release);
+        s->state.fetch_sub(kShmWriting, std::memory_order_release);
+        writing_ = kNoSlot;
+        return sequence;
+    }
+
+    /// removes the segment name; readers keep their mapping
+    void close()
+    {
+        if (isOpen())
+            shm_unlink(name_.c_str());
+        ShmRing::close();
+        writing_ = kNoSlot;
+    }
+
+private:
+    static const uint32_t kNoSlot = 0xffffffffu;
+
+    uint32_t    writing_;   // acquired slot
+};
+
+} // namespace kitti_player
+
+#endif // KITTI_PLAYER_SHM_RING_H
@@ -0,0 +1,116 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * tracklets: the object labels of a drive (tracklet_labels.xml).
+ *
+ * The XML is parsed once into a table of boxes sorted by frame: the boxes of
+ * a frame are a contiguous range, found in constant time.
+ *
+ *     kitti_player::Tracklets tracklets;
+ *     if (tracklets.load("2011_09_26/2011_09_26_drive_0001_sync/tracklet_labels.xml"))
+ *         for (const kitti_player::TrackletPose *box = tracklets.begin(frame); box != tracklets.end(frame); ++box)
+ *             // box->t: center of the bottom face in the velodyne frame
+ */
+
+#ifndef KITTI_PLAYER_TRACKLETS_H
+#define KITTI_PLAYER_TRACKLETS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace kitti_player
+{
+
+/// Object classes of the KITTI labels
+enum ObjectType
+{
+    CAR = 0,
+    VAN,
+    TRUCK,
+    PEDESTRIAN,
+    PERSON_SITTING,
+    CYCLIST,
+    TRAM,
+    MISC,
+    OBJECT_TYPES
+};
+
+/**
+ * @brief parseObjectType
+ * @param name objectType of tracklet_labels.xml, e.g. "Person (sitting)"
+ * @return the class, MISC if unknown
+ */
+ObjectType parseObjectType(const std::string &name);
+
+/// objectType name of a class, as in tracklet_labels.xml
+const char *objectTypeName(ObjectType type);
+
+/**
+ * @brief The TrackletPose struct is the box of a tracklet at one frame
+ */
+struct TrackletPose
+{
+    uint32_t    id;             // tracklet index in the file, the same along the track
+    uint8_t     type;           // ObjectType
+    int8_t      occlusion;      // -1: unset, 0: visible, 1: partly, 2: fully occluded
+    int8_t      truncation;     // -1: unset, 0: in image, 1: truncated, 2: out of image, 3: behind image
+    float       t[3];           // center of the bottom face, velodyne frame [m]
+    float       r[3];           // roll, pitch, yaw [rad]
+    float       h, w, l;        // height, width, length [m]
+};
+
+/**
+ * @brief The Tracklets class holds the boxes of a drive, indexed by frame
+ */
+class Tracklets
+{
+public:
+    Tracklets() : offsets_(1, 0), tracklets_(0) {}
+
+    /**
+     * @brief load parses tracklet_labels.xml
+     * @param filename tracklet file, on disk or in a mounted archive (zip_archive.h)
+     * @return 1 if file is correctly readed, 0 otherwise
+     */
+    int load(const std::string &filename);
+
+    /// number of frames, up to the last labelled one
+    size_t frames() const
+    {
+        return offsets_.size() - 1;
+    }
+
+    /// number of boxes, all frames
+    size_t size() const
+    {
+        return poses_.size();
+    }
+
+    /// number of tracklets (objects)
+    size_t tracklets() const
+    {
+        return tracklets_;
+    }
+
+    /// first box of a frame
+    const TrackletPose *begin(unsigned int frame) const
+    {
+        return poses_.data() + offsets_[frame < frames() ? frame : frames()];
+    }
+
+    /// past the last box of a frame; begin(frame) == end(frame) when the frame has no box
+    const TrackletPose *end(unsigned int frame) const
+    {
+        return poses_.data() + offsets_[frame < frames() ? frame + 1 : frames()];
+    }
+
+private:
+    std::vector<TrackletPose>   poses_;     // sorted by frame, then by tracklet
+    std::vector<uint32_t>       offsets_;   // boxes of frame f: [offsets_[f], offsets_[f + 1])
+    size_t                      tracklets_;
+};
+
+} // namespace kitti_player
+
+#endif // KITTI_PLAYER_TRACKLETS_H
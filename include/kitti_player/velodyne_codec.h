@@ -0,0 +1,79 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * velodyne_codec: compact velodyne scan files (.kvc), written by
+ * kitti_transcode under velodyne_points/data_kvc/ and read by the player in
+ * place of the raw .bin scans.
+ *
+ * A .kvc file is a KvcHeader followed by a zlib stream. Inflated, it holds
+ * the x, y, z and reflectance channels one after the other, each one as
+ * zigzag varints of the difference between consecutive points. KITTI scans
+ * are stored laser by laser, in azimuth order within a laser, so that
+ * consecutive points are neighbours and the differences are small.
+ *
+ * Values are either quantized (bounded-loss, step = 2 * max error) or, with
+ * a zero step, the raw float bits (lossless).
+ */
+
+#ifndef KITTI_PLAYER_VELODYNE_CODEC_H
+#define KITTI_PLAYER_VELODYNE_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace kitti_player
+{
+
+static const char     kKvcMagic[4]  = { 'K', 'V', 'C', '1' };
+static const uint32_t kKvcVersion   = 1;
+
+/// reflectance quantization step of the bounded-loss files
+static const float kKvcReflectanceStep = 0.001f;
+
+/// file header, little endian
+struct KvcHeader
+{
+    char        magic[4];
+    uint32_t    version;
+    uint32_t    points;
+    float       xyz_step;           // coordinate quantization step [m], 0: lossless
+    float       reflectance_step;   // reflectance quantization step, 0: lossless
+    uint32_t    varint_bytes;       // inflated size
+    uint32_t    packed_bytes;       // zlib stream size, following the header
+    uint32_t    reserved;
+};
+
+/**
+ * @brief velodyneCacheDirectory
+ * @param data_dir velodyne data directory, e.g. drive/velodyne_points/data/
+ * @return the directory of the transcoded scans, e.g. drive/velodyne_points/data_kvc/
+ */
+std::string velodyneCacheDirectory(const std::string &data_dir);
+
+/**
+ * @brief encodeVelodyneScan
+ * @param points x y z reflectance, 4 floats per point
+ * @param count number of points
+ * @param max_error max coordinate error [m], 0: lossless. A scan that does
+ *        not fit the quantization (non-finite or huge values) is stored lossless
+ * @param file output .kvc file content
+ * @param level zlib compression level, 1 (fast) ... 9 (small)
+ * @return 1 if the scan is encoded, 0 otherwise
+ */
+int encodeVelodyneScan(const float *points, size_t count, float max_error, std::vector<uint8_t> &file, int level = 6);
+
+/**
+ * @brief decodeVelodyneScan
+ * @param file .kvc file content
+ * @param size bytes of file
+ * @param points output, 4 floats per point; reuses its capacity
+ * @param scratch inflate buffer, reused across calls
+ * @return 1 if the file is decoded, 0 if it is not a valid .kvc file
+ */
+int decodeVelodyneScan(const uint8_t *file, size_t size, std::vector<float> &points, std::vector<uint8_t> &scratch);
+
+} // namespace kitti_player
+
+#endif // KITTI_PLAYER_VELODYNE_CODEC_H
@@ -0,0 +1,150 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * zip_archive: read access to the KITTI zip archives, without extracting them.
+ *
+ * The member index (name, data offset, sizes, method) is built once from the
+ * central directory and the local headers, and saved next to the archive as
+ * <zip>.idx; later opens read it back in a single pass. Stored members are
+ * mapped copy-on-write, deflated ones are inflated on the calling thread.
+ *
+ * Mounted archives overlay the directory that holds them: once
+ * /data/2011_09_26_drive_0001_sync.zip is mounted, every kitti_reader loader
+ * reads /data/2011_09_26/2011_09_26_drive_0001_sync/... from the archive.
+ */
+
+#ifndef KITTI_PLAYER_ZIP_ARCHIVE_H
+#define KITTI_PLAYER_ZIP_ARCHIVE_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+namespace kitti_player
+{
+
+/**
+ * @brief The ZipArchive class indexes a zip (zip64 included) and reads its members
+ */
+class ZipArchive
+{
+public:
+    /// a file of the archive
+    struct Member
+    {
+        uint64_t    data_offset;    // first byte of the (compressed) data in the archive
+        uint64_t    compressed;     // bytes in the archive
+        uint64_t    size;           // bytes once decompressed
+        uint32_t    method;         // 0: stored, 8: deflated
+    };
+
+    ZipArchive();
+    ~ZipArchive();
+
+    /**
+     * @brief open reads the member index: from <zip>.idx when it matches the
+     *        archive, from the archive otherwise (then saved to <zip>.idx)
+     * @param filename zip archive
+     * @return 1 if the archive is indexed, 0 otherwise
+     */
+    int open(const std::string &filename);
+
+    const std::string &filename() const
+    {
+        return filename_;
+    }
+
+    /// number of file members
+    size_t size() const
+    {
+        return members_.size();
+    }
+
+    /// true if the index was read from <zip>.idx
+    bool indexLoaded() const
+    {
+        return index_loaded_;
+    }
+
+    /**
+     * @brief find
+     * @param name member name, e.g. 2011_09_26/2011_09_26_drive_0001_sync/oxts/data/0000000000.txt
+     * @return the member, NULL if missing
+     */
+    const Member *find(const std::string &name) const;
+
+    /// number of members directly in dir (with the trailing /), 0 if no such directory
+    unsigned int countFiles(const std::string &dir) const;
+
+    /// true if some member is in dir (with the trailing /)
+    bool hasDirectory(const std::string &dir) const;
+
+    /**
+     * @brief read decompresses a member
+     * @param member the member, from find()
+     * @param out member.size bytes
+     * @return 1 if read, 0 otherwise (I/O error, corrupted data or unsupported method)
+     */
+    int read(const Member &member, void *out) const;
+
+    /**
+     * @brief map zero-copy access to a stored member
+     * @param member the member, from find()
+     * @return the member bytes, a private copy-on-write mapping; NULL if the member is compressed
+     */
+    boost::shared_ptr<uint8_t> map(const Member &member) const;
+
+    /// asks the kernel to read a member ahead, does not block
+    void prefetch(const Member &member) const;
+
+    /// directory of the drive in the archive (parent of oxts/, velodyne_points/, image_0x/), "" if none
+    std::string driveDirectory() const;
+
+private:
+    ZipArchive(const ZipArchive &);
+    ZipArchive &operator=(const ZipArchive &);
+
+    void close();
+    int readCentralDirectory(uint64_t archive_size);
+    int loadIndex(const std::string &index_file, uint64_t archive_size, int64_t archive_mtime);
+    int saveIndex(const std::string &index_file, uint64_t archive_size, int64_t archive_mtime) const;
+    void indexDirectories();
+
+    std::string                             filename_;
+    int                                     fd_;
+    bool                                    index_loaded_;
+    std::map<std::string, Member>           members_;
+    std::map<std::string, unsigned int>     directories_;   // files directly in each directory
+};
+
+/**
+ * @brief mountArchive overlays the members of a zip on the directory holding it
+ * @param zip archive, e.g. /data/2011_09_26_drive_0001_sync.zip
+ * @return 1 if mounted (or already mounted), 0 if the archive cannot be indexed
+ */
+int mountArchive(const std::string &zip);
+
+/**
+ * @brief mountDrive mounts a drive archive, and the calibration archive of its
+ *        day (<day>_calib.zip) when it is in the same directory
+ * @param zip drive archive, e.g. /data/2011_09_26_drive_0001_sync.zip
+ * @param drive_path output, the drive directory through the mount,
+ *        e.g. /data/2011_09_26/2011_09_26_drive_0001_sync/
+ * @return 1 if the drive is mounted, 0 otherwise
+ */
+int mountDrive(const std::string &zip, std::string &drive_path);
+
+/**
+ * @brief findMounted resolves a path through the mounted archives
+ * @param path file or directory path
+ * @param member output, the member name in the archive
+ * @return the archive holding path, NULL if path is not in a mounted archive
+ */
+boost::shared_ptr<const ZipArchive> findMounted(const std::string &path, std::string &member);
+
+} // namespace kitti_player
+
+#endif // KITTI_PLAYER_ZIP_ARCHIVE_H
@@ -0,0 +1,437 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * frame_cache: decoded frames shared by the players running on a host.
+ */
+
+#include <kitti_player/frame_cache.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+#include <random>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace kitti_player
+{
+
+const uint32_t kFrameCacheMagic   = 0x4b46434d; // "KFCM"
+const uint32_t kFrameCacheVersion = 3;
+
+/// segment header, followed by the entries and the slots
+struct FrameCacheHeader
+{
+    std::atomic<uint32_t>   magic;          // written last by the creator
+    uint32_t                version;
+    uint32_t                slot_count;
+    uint32_t                reserved;
+    uint64_t                slot_size;      // bytes per slot, page aligned
+    uint64_t                slots_offset;   // first slot, from the segment start
+    uint64_t                clock;          // LRU time, advanced by every use
+    pthread_mutex_t         mutex;          // robust, process-shared: guards the entries
+    pthread_cond_t          written;        // a reserved frame is committed or dropped
+};
+
+/// state of a slot
+enum FrameCacheState
+{
+    kEmpty = 0,
+    kWriting,
+    kReady,
+    kDead           // dropped from a late writer, that may still write it: never reused
+};
+
+/// table entry of a slot
+struct FrameCacheEntry
+{
+    uint64_t    key;
+    uint64_t    last_used;      // LRU time of the last find or reserve
+    uint64_t    size;           // frame bytes
+    uint64_t    reservation;    // LRU time of the reserve, identifies the frame held by the views
+    uint64_t    writer;         // token of the player writing the slot
+    uint64_t    lease;          // CLOCK_MONOTONIC ms until which the writer holds the slot
+    uint32_t    state;          // FrameCacheState
+    uint32_t    refs;           // views holding the slot
+    uint32_t    info[3];
+};
+
+namespace
+{
+
+const size_t kPageBytes = 4096;
+
+/// creator initialization time, before the other players give up
+const int kOpenTimeoutMs = 2000;
+
+/// longest wait for a frame written by another player, before decoding it again
+const int kWriteTimeoutMs = 1000;
+
+/// reserve to commit time of a writer, before its slot is dropped: a frame copy takes a few ms
+const uint64_t kWriteLeaseMs = 5000;
+
+inline size_t pageAlign(size_t bytes)
+{
+    return (bytes + kPageBytes - 1) & ~(kPageBytes - 1);
+}
+
+inline uint64_t mix(uint64_t value)
+{
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+inline uint64_t nowMs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint64_t(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+/// true if the writer of a slot did not commit it in time: crashed, or stalled
+inline bool leaseExpired(const FrameCacheEntry &entry, uint64_t now)
+{
+    return entry.state == kWriting && now > entry.lease;
+}
+
+/// true if the slot holds, or is about to hold, the frame of its key
+inline bool holdsFrame(const FrameCacheEntry &entry)
+{
+    return entry.state == kWriting || entry.state == kReady;
+}
+
+/// drops the frame of an expired writer; the slot is lost until the segment is recreated
+inline void quarantine(FrameCacheEntry &entry)
+{
+    entry.state = kDead;
+    entry.refs = 0;
+}
+
+} // namespace
+
+void FrameCacheView::release()
+{
+    if (cache_ != NULL)
+        cache_->release(entry_, reservation_);
+    cache_ = NULL;
+    data_ = NULL;
+    size_ = 0;
+}
+
+FrameCache::FrameCache()
+    : header_(NULL), bytes_(0)
+{
+    std::random_device random;
+    token_ = mix((uint64_t(random()) << 32 | random()) ^ nowMs()) | 1;
+}
+
+FrameCache::~FrameCache()
+{
+    close();
+}
+
+int FrameCache::open(const string &name, size_t bytes, size_t slot_size)
+{
+    close();
+    if (bytes == 0 || slot_size == 0)
+        return 0;
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    const bool created = fd >= 0;
+    size_t total = 0;
+    uint32_t slot_count = 0;
+    uint64_t slots_offset = 0;
+
+    if (created)
+    {
+        slot_size = pageAlign(slot_size);
+        slot_count = max<size_t>(1, bytes / slot_size);
+        slots_offset = pageAlign(sizeof(FrameCacheHeader) + slot_count * sizeof(FrameCacheEntry));
+        total = slots_offset + slot_count * slot_size;
+        if (ftruncate(fd, total) != 0)
+        {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return 0;
+        }
+    }
+    else
+    {
+        if (errno != EEXIST || (fd = shm_open(name.c_str(), O_RDWR, 0)) < 0)
+            return 0;
+
+        // sized by the creator, right after shm_open
+        struct stat st;
+        for (int waited = 0; fstat(fd, &st) == 0 && size_t(st.st_size) < sizeof(FrameCacheHeader) && waited < kOpenTimeoutMs; waited += 10)
+            usleep(10000);
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(FrameCacheHeader))
+        {
+            ::close(fd);
+            return 0;
+        }
+        total = st.st_size;
+    }
+
+    void *base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        if (created)
+            shm_unlink(name.c_str());
+        return 0;
+    }
+    FrameCacheHeader *header = static_cast<FrameCacheHeader*>(base);
+
+    if (created)
+    {
+        // ftruncate zero-fills: every entry is empty
+        pthread_mutexattr_t mutex_attr;
+        pthread_mutexattr_init(&mutex_attr);
+        pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header->mutex, &mutex_attr);
+        pthread_mutexattr_destroy(&mutex_attr);
+
+        pthread_condattr_t cond_attr;
+        pthread_condattr_init(&cond_attr);
+        pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+        pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&header->written, &cond_attr);
+        pthread_condattr_destroy(&cond_attr);
+
+        header->version = kFrameCacheVersion;
+        header->slot_count = slot_count;
+        header->slot_size = slot_size;
+        header->slots_offset = slots_offset;
+        header->clock = 0;
+        header->magic.store(kFrameCacheMagic, std::memory_order_release);
+    }
+    else
+    {
+        for (int waited = 0; header->magic.load(std::memory_order_acquire) != kFrameCacheMagic && waited < kOpenTimeoutMs; waited += 10)
+            usleep(10000);
+        if (header->magic.load(std::memory_order_acquire) != kFrameCacheMagic || header->version != kFrameCacheVersion ||
+            header->slots_offset + header->slot_count * header->slot_size > total)
+        {
+            munmap(base, total);
+            return 0;
+        }
+    }
+
+    header_ = header;
+    bytes_ = total;
+    name_ = name;
+    return 1;
+}
+
+void FrameCache::close()
+{
+    if (header_ != NULL)
+        munmap(header_, bytes_);
+    header_ = NULL;
+    bytes_ = 0;
+}
+
+uint32_t FrameCache::slotCount() const
+{
+    return header_ ? header_->slot_count : 0;
+}
+
+size_t FrameCache::slotSize() const
+{
+    return header_ ? header_->slot_size : 0;
+}
+
+uint64_t FrameCache::key(const string &drive, uint32_t stream, uint32_t frame)
+{
+    // FNV-1a of the drive, mixed with the stream and frame
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < drive.size(); i++)
+        hash = (hash ^ uint8_t(drive[i])) * 0x100000001b3ULL;
+    return mix(hash ^ mix((uint64_t(stream) << 32) | frame));
+}
+
+void FrameCache::lock()
+{
+    // a player died holding the mutex: the entries are only changed as a whole, they are consistent
+    if (pthread_mutex_lock(&header_->mutex) == EOWNERDEAD)
+        pthread_mutex_consistent(&header_->mutex);
+}
+
+void FrameCache::unlock()
+{
+    pthread_mutex_unlock(&header_->mutex);
+}
+
+FrameCacheEntry *FrameCache::entry(uint32_t index) const
+{
+    return reinterpret_cast<FrameCacheEntry*>(header_ + 1) + index;
+}
+
+uint8_t *FrameCache::slot(uint32_t index) const
+{
+    return reinterpret_cast<uint8_t*>(header_) + header_->slots_offset + index * header_->slot_size;
+}
+
+int FrameCache::find(uint64_t key, FrameCacheView &view)
+{
+    view.release();
+    if (!isOpen())
+        return 0;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += kWriteTimeoutMs / 1000;
+    deadline.tv_nsec += (kWriteTimeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    lock();
+    for (;;)
+    {
+        // a few thousand entries at most: a scan costs less than a lookup structure to keep in shared memory
+        uint32_t found = header_->slot_count;
+        for (uint32_t i = 0; i < header_->slot_count && found == header_->slot_count; i++)
+            if (holdsFrame(*entry(i)) && entry(i)->key == key)
+                found = i;
+        if (found == header_->slot_count)
+            break;
+
+        FrameCacheEntry *e = entry(found);
+        if (e->state == kReady)
+        {
+            e->refs++;
+            e->last_used = ++header_->clock;
+            view.cache_ = this;
+            view.entry_ = found;
+            view.reservation_ = e->reservation;
+            view.data_ = slot(found);
+            view.size_ = e->size;
+            std::copy(e->info, e->info + 3, view.info_);
+            unlock();
+            return 1;
+        }
+
+        // being written by another player: wait for it, unless its lease expired
+        if (leaseExpired(*e, nowMs()))
+        {
+            quarantine(*e);
+            pthread_cond_broadcast(&header_->written);
+            break;
+        }
+        int waited = pthread_cond_timedwait(&header_->written, &header_->mutex, &deadline);
+        if (waited == EOWNERDEAD)
+            pthread_mutex_consistent(&header_->mutex);
+        else if (waited == ETIMEDOUT)
+            break;
+    }
+    unlock();
+    return 0;
+}
+
+uint8_t *FrameCache::reserve(uint64_t key, size_t size, FrameCacheView &view)
+{
+    view.release();
+    if (!isOpen() || size > header_->slot_size)
+        return NULL;
+
+    const uint64_t now = nowMs();
+    lock();
+    uint32_t victim = header_->slot_count;
+    uint64_t oldest = ~uint64_t(0);
+    for (uint32_t i = 0; i < header_->slot_count; i++)
+    {
+        FrameCacheEntry *e = entry(i);
+        if (leaseExpired(*e, now))
+            quarantine(*e);
+        if (holdsFrame(*e) && e->key == key)
+        {
+            // committed or being written in the meantime
+            unlock();
+            return NULL;
+        }
+        if (e->refs == 0 && (e->state == kEmpty || e->state == kReady) && e->last_used < oldest)
+        {
+            victim = i;
+            oldest = e->last_used;
+        }
+    }
+    if (victim == header_->slot_count)
+    {
+        unlock();
+        return NULL;
+    }
+
+    FrameCacheEntry *e = entry(victim);
+    e->key = key;
+    e->size = size;
+    e->state = kWriting;
+    e->refs = 1;
+    e->writer = token_;
+    e->lease = now + kWriteLeaseMs;
+    e->last_used = ++header_->clock;
+    e->reservation = e->last_used;
+    unlock();
+
+    view.cache_ = this;
+    view.entry_ = victim;
+    view.reservation_ = e->reservation;
+    view.data_ = slot(victim);
+    view.size_ = size;
+    return slot(victim);
+}
+
+int FrameCache::commit(FrameCacheView &view, const uint32_t *info)
+{
+    if (view.cache_ != this)
+        return 0;
+
+    lock();
+    FrameCacheEntry *e = entry(view.entry_);
+    // dropped after the lease
+    if (e->state != kWriting || e->writer != token_ || e->reservation != view.reservation_)
+    {
+        unlock();
+        return 0;
+    }
+    std::copy(info, info + 3, e->info);
+    e->state = kReady;
+    pthread_cond_broadcast(&header_->written);
+    unlock();
+    std::copy(info, info + 3, view.info_);
+    return 1;
+}
+
+void FrameCache::release(uint32_t index, uint64_t reservation)
+{
+    lock();
+    FrameCacheEntry *e = entry(index);
+    // the hold was dropped with the slot
+    if (e->reservation != reservation)
+    {
+        unlock();
+        return;
+    }
+    if (e->refs > 0)
+        e->refs--;
+    if (e->state == kWriting && e->refs == 0)
+    {
+        // reserved and never committed
+        e->state = kEmpty;
+        pthread_cond_broadcast(&header_->written);
+    }
+    unlock();
+}
+
+} // namespace kitti_player
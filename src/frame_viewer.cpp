@@ -0,0 +1,118 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * FrameViewer: HighGUI windows drawn by their own thread.
+ */
+
+#include "frame_viewer.h"
+
+#include <cstdio>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace
+{
+
+/// HighGUI event loop period, ms
+const int kEventPeriod = 10;
+
+}
+
+FrameViewer::FrameViewer()
+    : dropped_(0), stop_(false)
+{
+}
+
+FrameViewer::~FrameViewer()
+{
+    stop();
+}
+
+int FrameViewer::addWindow(const std::string &name, bool overlay)
+{
+    Window window;
+    window.name = name;
+    window.overlay = overlay;
+    window.pending_frame = 0;
+    window.fresh = false;
+    windows_.push_back(window);
+    return windows_.size() - 1;
+}
+
+void FrameViewer::start()
+{
+    if (windows_.empty() || thread_.joinable())
+        return;
+    stop_ = false;
+    thread_ = boost::thread(&FrameViewer::loop, this);
+}
+
+void FrameViewer::stop()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        stop_ = true;
+    }
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void FrameViewer::post(int window, const cv::Mat &image, unsigned int frame)
+{
+    if (window < 0 || size_t(window) >= windows_.size() || image.empty())
+        return;
+
+    boost::mutex::scoped_lock lock(mutex_);
+    Window &w = windows_[window];
+    if (w.fresh)
+        dropped_++;
+    // the buffers of pending and shown are swapped, not reallocated
+    image.copyTo(w.pending);
+    w.pending_frame = frame;
+    w.fresh = true;
+}
+
+unsigned long FrameViewer::dropped() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return dropped_;
+}
+
+void FrameViewer::loop()
+{
+    for (size_t i = 0; i < windows_.size(); i++)
+        cv::namedWindow(windows_[i].name, CV_WINDOW_AUTOSIZE);
+
+    char text[16];
+    bool running = true;
+    while (running)
+    {
+        for (size_t i = 0; i < windows_.size() && running; i++)
+        {
+            Window &w = windows_[i];
+            unsigned int frame;
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                running = !stop_;
+                if (!running || !w.fresh)
+                    continue;
+                cv::swap(w.pending, w.shown);
+                frame = w.pending_frame;
+                w.fresh = false;
+            }
+
+            if (w.overlay)
+            {
+                snprintf(text, sizeof(text), "%5u", frame);
+                cv::putText(w.shown, "KittiPlayer", cvPoint(20, 15), CV_FONT_HERSHEY_SIMPLEX, 0.4, cvScalar(0, 255, 0), 1, CV_AA);
+                cv::putText(w.shown, text, cvPoint(w.shown.cols - 100, 30), CV_FONT_HERSHEY_DUPLEX, 1.0, cvScalar(0, 0, 255), 1, CV_AA);
+            }
+            cv::imshow(w.name, w.shown);
+        }
+        cv::waitKey(kEventPeriod);
+    }
+
+    for (size_t i = 0; i < windows_.size(); i++)
+        cv::destroyWindow(windows_[i].name);
+    cv::waitKey(1);
+}
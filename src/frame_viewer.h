@@ -0,0 +1,79 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * FrameViewer: HighGUI windows drawn by their own thread.
+ */
+
+#ifndef KITTI_PLAYER_FRAME_VIEWER_H
+#define KITTI_PLAYER_FRAME_VIEWER_H
+
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <opencv2/core/core.hpp>
+
+/**
+ * @brief The FrameViewer class shows images without blocking the playback
+ *
+ * Every window is a latest-frame mailbox: post() copies the image in and
+ * returns, the viewer thread draws the newest image of each window and runs
+ * the HighGUI event loop. A frame posted before the previous one was drawn
+ * replaces it, so a slow display drops frames instead of delaying the
+ * publishers. Windows are created, drawn and destroyed by the viewer thread
+ * only, as HighGUI requires.
+ */
+class FrameViewer
+{
+public:
+    FrameViewer();
+    ~FrameViewer();
+
+    /**
+     * @brief addWindow declares a window, before start()
+     * @param name window title
+     * @param overlay draw the player name and frame number on the image
+     * @return window index, for post()
+     */
+    int addWindow(const std::string &name, bool overlay = false);
+
+    /// creates the viewer thread, if there is any window
+    void start();
+
+    /// stops the viewer thread and closes the windows
+    void stop();
+
+    /**
+     * @brief post hands the latest image of a window to the viewer thread
+     * @param window index returned by addWindow
+     * @param image image to show, copied
+     * @param frame frame number, for the overlay
+     */
+    void post(int window, const cv::Mat &image, unsigned int frame);
+
+    /// frames replaced in a mailbox before being drawn
+    unsigned long dropped() const;
+
+private:
+    FrameViewer(const FrameViewer &);
+    FrameViewer &operator=(const FrameViewer &);
+
+    void loop();
+
+    struct Window
+    {
+        std::string     name;
+        bool            overlay;
+        cv::Mat         pending;    // last posted image, written by post()
+        unsigned int    pending_frame;
+        bool            fresh;      // pending not drawn yet
+        cv::Mat         shown;      // image being drawn, owned by the viewer thread
+    };
+
+    std::vector<Window>     windows_;
+    mutable boost::mutex    mutex_;
+    boost::thread           thread_;
+    unsigned long           dropped_;
+    bool                    stop_;
+};
+
+#endif // KITTI_PLAYER_FRAME_VIEWER_H
@@ -0,0 +1,330 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * image_codec: fast-decoding lossless image files (.kqi).
+ */
+
+#include <kitti_player/image_codec.h>
+
+#include <cstring>
+
+using namespace std;
+
+namespace kitti_player
+{
+
+namespace
+{
+
+const uint8_t kOpIndex = 0x00;
+const uint8_t kOpDiff  = 0x40;
+const uint8_t kOpLuma  = 0x80;     // color: 10gggggg + (dr - dg, db - dg)
+const uint8_t kOpDiff2 = 0x80;     // grayscale: 10aaabbb, two pixels
+const uint8_t kOpRun   = 0xc0;
+const uint8_t kOpRaw   = 0xfe;
+const uint8_t kMask    = 0xc0;
+
+const int kMaxRun = 62;
+
+/// worst case bytes per pixel, raw op
+inline size_t maxBytes(size_t pixels, int channels)
+{
+    return sizeof(KqiHeader) + pixels * (channels + 1);
+}
+
+inline unsigned int hashGray(uint8_t v)
+{
+    return (v * 7) & 63;
+}
+
+struct Bgr
+{
+    uint8_t b, g, r;
+
+    bool operator==(const Bgr &other) const
+    {
+        return b == other.b && g == other.g && r == other.r;
+    }
+};
+
+inline unsigned int hashBgr(const Bgr &p)
+{
+    return (p.r * 3 + p.g * 5 + p.b * 7) & 63;
+}
+
+uint8_t *encodeGray(const uint8_t *pixels, size_t n, uint8_t *out)
+{
+    uint8_t table[64] = { 0 };
+    uint8_t previous = 0;
+    int run = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t v = pixels[i];
+        if (v == previous)
+        {
+            if (++run == kMaxRun)
+            {
+                *out++ = kOpRun | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0)
+        {
+            *out++ = kOpRun | (run - 1);
+            run = 0;
+        }
+
+        unsigned int h = hashGray(v);
+        int8_t d = int8_t(v - previous);
+        if (table[h] == v)
+            *out++ = kOpIndex | h;
+        else if (i + 1 < n && d >= -4 && d < 4 && int8_t(pixels[i + 1] - v) >= -4 && int8_t(pixels[i + 1] - v) < 4)
+        {
+            uint8_t v2 = pixels[++i];
+            *out++ = kOpDiff2 | ((d + 4) << 3) | (int8_t(v2 - v) + 4);
+            table[h] = v;
+            v = v2;
+            h = hashGray(v);
+        }
+        else if (d >= -32 && d < 32)
+            *out++ = kOpDiff | (d + 32);
+        else
+        {
+            *out++ = kOpRaw;
+            *out++ = v;
+        }
+        table[h] = v;
+        previous = v;
+    }
+    if (run > 0)
+        *out++ = kOpRun | (run - 1);
+    return out;
+}
+
+uint8_t *encodeBgr(const uint8_t *pixels, size_t n, uint8_t *out)
+{
+    Bgr table[64];
+    memset(table, 0, sizeof(table));
+    Bgr previous = { 0, 0, 0 };
+    int run = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        Bgr p = { pixels[3 * i], pixels[3 * i + 1], pixels[3 * i + 2] };
+        if (p == previous)
+        {
+            if (++run == kMaxRun)
+            {
+                *out++ = kOpRun | (run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0)
+        {
+            *out++ = kOpRun | (run - 1);
+            run = 0;
+        }
+
+        unsigned int h = hashBgr(p);
+        if (table[h] == p)
+            *out++ = kOpIndex | h;
+        else
+        {
+            int8_t dr = int8_t(p.r - previous.r);
+            int8_t dg = int8_t(p.g - previous.g);
+            int8_t db = int8_t(p.b - previous.b);
+            int8_t dr_dg = int8_t(dr - dg);
+            int8_t db_dg = int8_t(db - dg);
+            if (dr >= -2 && dr < 2 && dg >= -2 && dg < 2 && db >= -2 && db < 2)
+                *out++ = kOpDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+            else if (dg >= -32 && dg < 32 && dr_dg >= -8 && dr_dg < 8 && db_dg >= -8 && db_dg < 8)
+            {
+                *out++ = kOpLuma | (dg + 32);
+                *out++ = ((dr_dg + 8) << 4) | (db_dg + 8);
+            }
+            else
+            {
+                *out++ = kOpRaw;
+                *out++ = p.b;
+                *out++ = p.g;
+                *out++ = p.r;
+            }
+            table[h] = p;
+        }
+        previous = p;
+    }
+    if (run > 0)
+        *out++ = kOpRun | (run - 1);
+    return out;
+}
+
+bool decodeGray(const uint8_t *in, const uint8_t *end, uint8_t *pixels, size_t n)
+{
+    uint8_t table[64] = { 0 };
+    uint8_t v = 0;
+
+    size_t i = 0;
+    while (i < n)
+    {
+        if (in >= end)
+            return false;
+        uint8_t op = *in++;
+        if (op == kOpRaw)
+        {
+            if (in >= end)
+                return false;
+            v = *in++;
+        }
+        else if ((op & kMask) == kOpIndex)
+            v = table[op];
+        else if ((op & kMask) == kOpDiff)
+            v += (op & 0x3f) - 32;
+        else if ((op & kMask) == kOpDiff2)
+        {
+            if (i + 2 > n)
+                return false;
+            v += ((op >> 3) & 7) - 4;
+            table[hashGray(v)] = v;
+            pixels[i++] = v;
+            v += (op & 7) - 4;
+        }
+        else
+        {
+            size_t run = (op & 0x3f) + 1;
+            if (i + run > n)
+                return false;
+            memset(pixels + i, v, run);
+            i += run;
+            continue;
+        }
+        table[hashGray(v)] = v;
+        pixels[i++] = v;
+    }
+    return true;
+}
+
+bool decodeBgr(const uint8_t *in, const uint8_t *end, uint8_t *pixels, size_t n)
+{
+    Bgr table[64];
+    memset(table, 0, sizeof(table));
+    Bgr p = { 0, 0, 0 };
+
+    for (size_t i = 0; i < n; )
+    {
+        if (in >= end)
+            return false;
+        uint8_t op = *in++;
+        if (op == kOpRaw)
+        {
+            if (end - in < 3)
+                return false;
+            p.b = in[0];
+            p.g = in[1];
+            p.r = in[2];
+            in += 3;
+        }
+        else if ((op & kMask) == kOpIndex)
+            p = table[op];
+        else if ((op & kMask) == kOpDiff)
+        {
+            p.r += ((op >> 4) & 3) - 2;
+            p.g += ((op >> 2) & 3) - 2;
+            p.b += (op & 3) - 2;
+        }
+        else if ((op & kMask) == kOpLuma)
+        {
+            if (in >= end)
+                return false;
+            int dg = (op & 0x3f) - 32;
+            uint8_t second = *in++;
+            p.r += dg + (second >> 4) - 8;
+            p.g += dg;
+            p.b += dg + (second & 0x0f) - 8;
+        }
+        else
+        {
+            size_t run = (op & 0x3f) + 1;
+            if (i + run > n)
+                return false;
+            for (; run > 0; run--, i++)
+            {
+                pixels[3 * i]     = p.b;
+                pixels[3 * i + 1] = p.g;
+                pixels[3 * i + 2] = p.r;
+            }
+            continue;
+        }
+        table[hashBgr(p)] = p;
+        pixels[3 * i]     = p.b;
+        pixels[3 * i + 1] = p.g;
+        pixels[3 * i + 2] = p.r;
+        i++;
+    }
+    return true;
+}
+
+} // namespace
+
+string imageCacheDirectory(const string &data_dir)
+{
+    string dir = data_dir;
+    if (!dir.empty() && dir[dir.size() - 1] == '/')
+        dir.erase(dir.size() - 1);
+    return dir + "_kqi/";
+}
+
+int encodeImage(const cv::Mat &image, vector<uint8_t> &file)
+{
+    if (image.depth() != CV_8U || (image.channels() != 1 && image.channels() != 3) || image.empty())
+        return 0;
+
+    cv::Mat pixels = image.isContinuous() ? image : image.clone();
+    size_t n = size_t(pixels.rows) * pixels.cols;
+
+    KqiHeader header;
+    memcpy(header.magic, kKqiMagic, sizeof(header.magic));
+    header.width = pixels.cols;
+    header.height = pixels.rows;
+    header.channels = image.channels();
+
+    file.resize(maxBytes(n, header.channels));
+    memcpy(file.data(), &header, sizeof(header));
+    uint8_t *out = file.data() + sizeof(header);
+    if (header.channels == 1)
+        out = encodeGray(pixels.ptr(), n, out);
+    else
+        out = encodeBgr(pixels.ptr(), n, out);
+    file.resize(out - file.data());
+    return 1;
+}
+
+int decodeImage(const uint8_t *file, size_t size, cv::Mat &image)
+{
+    KqiHeader header;
+    if (size < sizeof(header))
+        return 0;
+    memcpy(&header, file, sizeof(header));
+    if (memcmp(header.magic, kKqiMagic, sizeof(header.magic)) != 0 ||
+        (header.channels != 1 && header.channels != 3) ||
+        header.width == 0 || header.height == 0 || header.width > 65535 || header.height > 65535)
+        return 0;
+
+    // create() keeps the buffer of an image of the same size and type
+    int type = header.channels == 1 ? CV_8UC1 : CV_8UC3;
+    if (!image.isContinuous())
+        image.release();
+    image.create(header.height, header.width, type);
+
+    size_t n = size_t(header.width) * header.height;
+    const uint8_t *in = file + sizeof(header);
+    bool ok = header.channels == 1 ? decodeGray(in, file + size, image.ptr(), n)
+                                   : decodeBgr(in, file + size, image.ptr(), n);
+    if (!ok)
+        image.release();
+    return ok;
+}
+
+} // namespace kitti_player
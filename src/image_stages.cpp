@@ -0,0 +1,128 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * Processing stages applied to the camera images before publishing.
+ */
+
+#include "image_stages.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+/// output rows per chunk
+const size_t kRowsPerChunk = 16;
+
+/// computeDisparity: rows matched above and below each band, and matching window size
+const int kBandMargin = 24;
+const int kBlockSize = 5;
+
+/**
+ * @brief halveRow one output row of a single channel image
+ * @param r0,r1 the two input rows
+ * @param out output row
+ * @param width output width
+ */
+inline void halveRowMono(const uint8_t *r0, const uint8_t *r1, uint8_t *out, int width)
+{
+    int x = 0;
+
+#ifdef __SSE2__
+    // 8 output pixels per iteration: even and odd bytes of both rows are
+    // widened to 16 bit, summed with the rounding term and shifted back
+    const __m128i low  = _mm_set1_epi16(0x00ff);
+    const __m128i two  = _mm_set1_epi16(2);
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(r0 + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(r1 + 2 * x));
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, low), _mm_srli_epi16(a, 8)),
+                                    _mm_add_epi16(_mm_and_si128(b, low), _mm_srli_epi16(b, 8)));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(sum, sum));
+    }
+#endif
+
+    for (; x < width; x++)
+        out[x] = (r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2;
+}
+
+/// one output row of a multi channel image
+inline void halveRow(const uint8_t *r0, const uint8_t *r1, uint8_t *out, int width, int channels)
+{
+    for (int x = 0; x < width; x++)
+    {
+        const int i = 2 * x * channels;
+        for (int c = 0; c < channels; c++)
+            out[x * channels + c] = (r0[i + c] + r0[i + channels + c] + r1[i + c] + r1[i + channels + c] + 2) >> 2;
+    }
+}
+
+} // namespace
+
+void halveImage(const cv::Mat &src, cv::Mat &dst, WorkerPool &pool)
+{
+    CV_Assert(src.depth() == CV_8U);
+
+    const int width = src.cols / 2;
+    const int height = src.rows / 2;
+    const int channels = src.channels();
+    dst.create(height, width, src.type());
+
+    pool.parallel_for(height, [&](size_t begin, size_t end)
+    {
+        for (size_t y = begin; y < end; y++)
+        {
+            const uint8_t *r0 = src.ptr<uint8_t>(2 * y);
+            const uint8_t *r1 = src.ptr<uint8_t>(2 * y + 1);
+            uint8_t *out = dst.ptr<uint8_t>(y);
+            if (channels == 1)
+                halveRowMono(r0, r1, out, width);
+            else
+                halveRow(r0, r1, out, width, channels);
+        }
+    }, kRowsPerChunk);
+}
+
+void computeDisparity(const cv::Mat &left, const cv::Mat &right, cv::Mat &disparity, StereoBands &bands, WorkerPool &pool)
+{
+    CV_Assert(left.type() == CV_8UC1 && right.type() == left.type() && right.size() == left.size());
+
+    const int rows = left.rows;
+    const size_t count = std::max(1, std::min<int>(pool.size(), rows / (2 * kBandMargin)));
+    if (bands.matcher.size() != count)
+    {
+        // KITTI settings of the OpenCV baseline: P1, P2 scaled with the window area
+        bands.matcher.resize(count);
+        bands.disparity.resize(count);
+        for (size_t b = 0; b < count; b++)
+            bands.matcher[b] = cv::StereoSGBM::create(0, kMaxDisparity, kBlockSize,
+                                                      8 * kBlockSize * kBlockSize, 32 * kBlockSize * kBlockSize,
+                                                      1, 63, 10, 100, 32, cv::StereoSGBM::MODE_SGBM_3WAY);
+    }
+    disparity.create(left.size(), CV_16UC1);
+
+    pool.parallel_for(count, [&](size_t begin, size_t end)
+    {
+        for (size_t b = begin; b < end; b++)
+        {
+            const int top = rows * b / count;
+            const int bottom = rows * (b + 1) / count;
+            const int first = std::max(0, top - kBandMargin);
+            const int last = std::min(rows, bottom + kBandMargin);
+
+            cv::Mat &band = bands.disparity[b];
+            bands.matcher[b]->compute(left.rowRange(first, last), right.rowRange(first, last), band);
+
+            // 4 fractional bits -> kDisparityScale, unmatched (negative) -> 0
+            band.rowRange(top - first, bottom - first).convertTo(disparity.rowRange(top, bottom), CV_16U, kDisparityScale / 16.0);
+        }
+    });
+}
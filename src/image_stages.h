@@ -0,0 +1,59 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * Processing stages applied to the camera images before publishing.
+ */
+
+#ifndef KITTI_PLAYER_IMAGE_STAGES_H
+#define KITTI_PLAYER_IMAGE_STAGES_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+class WorkerPool;
+
+/**
+ * @brief halveImage area-downsamples an 8 bit image by two
+ * @param src input image, any number of channels
+ * @param dst output image, src.cols / 2 x src.rows / 2; an odd last row or
+ *        column of src is dropped
+ * @param pool workers running the row bands
+ *
+ * Each output pixel is the rounded mean of a 2x2 block, i.e. INTER_AREA for an
+ * exact factor of two. Single channel images use an SSE2 kernel.
+ */
+void halveImage(const cv::Mat &src, cv::Mat &dst, WorkerPool &pool);
+
+/// disparity range searched by computeDisparity, in pixels
+const int kMaxDisparity = 128;
+
+/// scale of the 16 bit disparity files: d = value / kDisparityScale, 0 = invalid (KITTI stereo format)
+const double kDisparityScale = 256.0;
+
+/**
+ * @brief The StereoBands struct keeps the matchers and band buffers of computeDisparity
+ *        from frame to frame, one per row band
+ */
+struct StereoBands
+{
+    std::vector<cv::Ptr<cv::StereoSGBM> >   matcher;
+    std::vector<cv::Mat>                    disparity;
+};
+
+/**
+ * @brief computeDisparity matches a rectified 8 bit stereo pair with semi-global block matching
+ * @param left left image, single channel
+ * @param right right image, same size and type
+ * @param disparity output, CV_16U in the kDisparityScale format
+ * @param bands matchers and buffers, reused
+ * @param pool workers running the row bands
+ *
+ * The image is cut in one horizontal band per worker, each matched on its own
+ * with kBandMargin extra rows above and below so that the cost aggregation
+ * near the band edges still sees the neighbouring rows; only the band rows are
+ * kept. Pixels without a match, e.g. the first kMaxDisparity columns, are 0.
+ */
+void computeDisparity(const cv::Mat &left, const cv::Mat &right, cv::Mat &disparity, StereoBands &bands, WorkerPool &pool);
+
+#endif // KITTI_PLAYER_IMAGE_STAGES_H
@@ -0,0 +1,289 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * kitti_generate: writes a synthetic synced drive, laid out as the KITTI raw
+ * ones, to measure the player (--profile) without downloading a dataset.
+ *
+ * Images are smooth gradients with a moving pattern and some noise, so that
+ * they compress about as the real ones; scans hold 64 rings of points at
+ * plausible ranges; oxts packets follow a straight drive at 10 m/s.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <boost/program_options.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <kitti_player/kitti_reader.h>
+
+#include "worker_pool.h"
+
+using namespace std;
+namespace po = boost::program_options;
+
+struct kitti_generate_options
+{
+    string          path;
+    unsigned int    frames;
+    unsigned int    width;
+    unsigned int    height;
+    unsigned int    lasers;     // velodyne rings
+    unsigned int    azimuths;   // points per ring
+    unsigned int    threads;    // 0 = one per hardware thread
+};
+
+/**
+ * @brief makeDirectory
+ * @param dir directory to create, if missing
+ * @return 1 if dir exists, 0 otherwise
+ */
+int makeDirectory(const string &dir)
+{
+    return mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+/**
+ * @brief writeTimestamps writes a timestamps.txt, frames 0.1 s apart
+ * @param filename the timestamps file
+ * @param frames number of frames
+ * @param offset seconds after the first camera frame, e.g. the velodyne trigger delay
+ * @return 1 if written, 0 otherwise
+ */
+int writeTimestamps(const string &filename, unsigned int frames, double offset)
+{
+    ofstream file(filename.c_str());
+    for (unsigned int i = 0; i < frames; i++)
+    {
+        double t = 35.0 + 0.1 * i + offset;     // seconds after 13:21:00
+        int minutes = int(t / 60.0);
+        double seconds = t - 60.0 * minutes;
+        file << "2011-09-26 13:" << setfill('0') << setw(2) << 21 + minutes << ":"
+             << setw(12) << fixed << setprecision(9) << seconds << endl;
+    }
+    return file.good();
+}
+
+/**
+ * @brief writeCalibration writes calib_cam_to_cam.txt and calib_imu_to_velo.txt with the KITTI values
+ * @param root drive directory, with the trailing /
+ * @param width image width
+ * @param height image height
+ * @return 1 if written, 0 otherwise
+ */
+int writeCalibration(const string &root, unsigned int width, unsigned int height)
+{
+    ofstream c2c((root + "calib_cam_to_cam.txt").c_str());
+    c2c << "calib_time: 09-Jan-2012 13:57:47" << endl
+        << "corner_dist: 9.950000e-02" << endl;
+    const double baseline[4] = { 0.0, -0.537, 0.06, -0.47 };
+    for (int c = 0; c < 4; c++)
+    {
+        char id[4];
+        snprintf(id, sizeof(id), "%02d", c);
+        double fx = 721.5377, cx = width / 2.0, cy = height / 2.0;
+        c2c << "S_" << id << ": " << width << " " << height << endl
+            << "K_" << id << ": " << fx << " 0 " << cx << " 0 " << fx << " " << cy << " 0 0 1" << endl
+            << "D_" << id << ": 0 0 0 0 0" << endl
+            << "R_" << id << ": 1 0 0 0 1 0 0 0 1" << endl
+            << "T_" << id << ": " << baseline[c] << " 0 0" << endl
+            << "S_rect_" << id << ": " << width << " " << height << endl
+            << "R_rect_" << id << ": 1 0 0 0 1 0 0 0 1" << endl
+            << "P_rect_" << id << ": " << fx << " 0 " << cx << " " << fx * baseline[c] << " 0 " << fx << " " << cy << " 0 0 0 1 0" << endl;
+    }
+
+    ofstream i2v((root + "calib_imu_to_velo.txt").c_str());
+    i2v << "calib_time: 25-May-2012 16:47:16" << endl
+        << "R: 1 0 0 0 1 0 0 0 1" << endl
+        << "T: -0.8086759 0.3195559 -0.7997231" << endl;
+
+    ofstream v2c((root + "calib_velo_to_cam.txt").c_str());
+    v2c << "calib_time: 15-Mar-2012 11:37:16" << endl
+        << "R: 0 -1 0 0 0 -1 1 0 0" << endl
+        << "T: -0.004069766 -0.07631618 -0.2717806" << endl;
+    return c2c.good() && i2v.good() && v2c.good();
+}
+
+/**
+ * @brief writeImage writes a frame of a camera
+ * @param filename png file
+ * @param frame frame number, moves the pattern
+ * @param camera 0 ... 3, 2 and 3 in color
+ * @param options tool options
+ * @return 1 if written, 0 otherwise
+ */
+int writeImage(const string &filename, unsigned int frame, int camera, const kitti_generate_options &options)
+{
+    cv::Mat image(options.height, options.width, camera < 2 ? CV_8UC1 : CV_8UC3);
+    cv::RNG rng(frame * 4 + camera);
+    const int channels = image.channels();
+    for (int r = 0; r < image.rows; r++)
+    {
+        uint8_t *row = image.ptr<uint8_t>(r);
+        for (int c = 0; c < image.cols; c++)
+        {
+            // sky above, road below, stripes moving with the frames
+            int base = r < image.rows / 2 ? 180 - r / 4 : 60 + ((c + 8 * frame) / 40 % 2) * 40;
+            for (int k = 0; k < channels; k++)
+                row[c * channels + k] = cv::saturate_cast<uint8_t>(base + 15 * k + rng.uniform(-3, 4));
+        }
+    }
+    return cv::imwrite(filename, image);
+}
+
+/**
+ * @brief writeScan writes a frame of the velodyne, one ring per laser
+ * @param filename bin file
+ * @param frame frame number
+ * @param options tool options
+ * @return 1 if written, 0 otherwise
+ */
+int writeScan(const string &filename, unsigned int frame, const kitti_generate_options &options)
+{
+    vector<float> points;
+    points.reserve(4 * options.lasers * options.azimuths);
+    cv::RNG rng(frame);
+    for (unsigned int laser = 0; laser < options.lasers; laser++)
+    {
+        double elevation = (2.0 - 26.8 * laser / options.lasers) * M_PI / 180.0;
+        for (unsigned int a = 0; a < options.azimuths; a++)
+        {
+            double azimuth = 2.0 * M_PI * a / options.azimuths;
+            // rings below the horizon hit the ground, the others a wall at 20-40 m
+            double range = elevation < -0.03 ? 1.73 / -sin(elevation) : 30.0 + 10.0 * sin(3.0 * azimuth + 0.1 * frame);
+            range = min(range, 120.0) + rng.gaussian(0.02);
+            points.push_back(range * cos(elevation) * cos(azimuth));
+            points.push_back(range * cos(elevation) * sin(azimuth));
+            points.push_back(range * sin(elevation));
+            points.push_back(rng.uniform(0.0f, 1.0f));
+        }
+    }
+
+    ofstream file(filename.c_str(), ios::binary | ios::trunc);
+    file.write(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(float));
+    return file.good();
+}
+
+/**
+ * @brief writeOxts writes a frame of the oxts, a straight drive heading east
+ * @param filename txt file
+ * @param frame frame number
+ * @return 1 if written, 0 otherwise
+ */
+int writeOxts(const string &filename, unsigned int frame)
+{
+    const double speed = 10.0;
+    const double east = speed * 0.1 * frame;
+    ofstream file(filename.c_str());
+    file << setprecision(12)
+         << 49.011 << " " << 8.4161 + east / (111320.0 * cos(49.011 * M_PI / 180.0)) << " " << 112.0 << " "   // lat lon alt
+         << 0.0 << " " << 0.0 << " " << 0.0 << " "                                                           // roll pitch yaw
+         << 0.0 << " " << speed << " "                                                                       // vn ve
+         << speed << " " << 0.0 << " " << 0.0 << " "                                                         // vf vl vu
+         << 0.0 << " " << 0.0 << " " << 9.81 << " "                                                          // ax ay az
+         << 0.0 << " " << 0.0 << " " << 9.81 << " "                                                          // af al au
+         << 0.0 << " " << 0.0 << " " << 0.0 << " "                                                           // wx wy wz
+         << 0.0 << " " << 0.0 << " " << 0.0 << " "                                                           // wf wl wu
+         << 0.05 << " " << 0.02 << " "                                                                       // accuracies
+         << 4 << " " << 10 << " " << 4 << " " << 4 << " " << 4 << endl;                                       // status
+    return file.good();
+}
+
+/**
+ * @brief main kitti_generate, writes a synthetic KITTI raw drive
+ * @param argc
+ * @param argv
+ * @return 0 if the drive is written, 1 otherwise
+ */
+int main(int argc, char **argv)
+{
+    kitti_generate_options options;
+    po::variables_map vm;
+
+    po::options_description desc("kitti_generate, writes a synthetic KITTI raw drive for kitti_player --profile\n\nAllowed options", 200);
+    desc.add_options()
+    ("help,h"                                                                                                    ,  "help message")
+    ("directory ,d",  po::value<string>       (&options.path)->required()                                        ,  "*required* - drive directory to write, e.g. /tmp/2011_09_26_drive_0000_sync")
+    ("frames    ,n",  po::value<unsigned int> (&options.frames)           ->default_value(100)                     ,  "number of frames")
+    ("width",         po::value<unsigned int> (&options.width)            ->default_value(1242)                    ,  "image width")
+    ("height",        po::value<unsigned int> (&options.height)           ->default_value(375)                     ,  "image height")
+    ("lasers",        po::value<unsigned int> (&options.lasers)           ->default_value(64)                      ,  "velodyne rings")
+    ("azimuths",      po::value<unsigned int> (&options.azimuths)         ->default_value(1900)                    ,  "velodyne points per ring")
+    ("threads",       po::value<unsigned int> (&options.threads)          ->default_value(0)                       ,  "writing threads [0: one per core]")
+    ;
+
+    try // parse options
+    {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help"))
+        {
+            cout << desc << endl;
+            return 0;
+        }
+        po::notify(vm);
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << endl << endl << desc << endl;
+        return 1;
+    }
+
+    // oxts frame 1 is read as the initial GPS fix
+    if (options.frames < 2 || options.width == 0 || options.height == 0 || options.lasers == 0 || options.azimuths == 0)
+    {
+        cerr << "frames must be >= 2, and the image and scan sizes > 0" << endl;
+        return 1;
+    }
+
+    string root = options.path;
+    if (!root.empty() && root[root.size() - 1] != '/')
+        root += "/";
+
+    static const char *sensors[] = { "image_00", "image_01", "image_02", "image_03", "velodyne_points", "oxts" };
+    const size_t sensor_count = sizeof(sensors) / sizeof(sensors[0]);
+    bool ok = makeDirectory(root) && writeCalibration(root, options.width, options.height);
+    for (size_t s = 0; s < sensor_count && ok; s++)
+    {
+        ok = makeDirectory(root + sensors[s]) && makeDirectory(root + sensors[s] + "/data") &&
+             writeTimestamps(root + sensors[s] + "/timestamps.txt", options.frames, s == 4 ? 0.05 : 0.0);
+    }
+    if (!ok)
+    {
+        cerr << "Cannot write " << root << endl;
+        return 1;
+    }
+
+    std::atomic<unsigned int> failed(0);
+    WorkerPool pool(options.threads);
+    pool.parallel_for(options.frames, [&](size_t begin, size_t end)
+    {
+        for (size_t frame = begin; frame < end; frame++)
+        {
+            for (int c = 0; c < 4; c++)
+                if (!writeImage(kitti_player::frameFilename(root + sensors[c] + "/data/", frame, ".png"), frame, c, options))
+                    failed++;
+            if (!writeScan(kitti_player::frameFilename(root + "velodyne_points/data/", frame, ".bin"), frame, options))
+                failed++;
+            if (!writeOxts(kitti_player::frameFilename(root + "oxts/data/", frame, ".txt"), frame))
+                failed++;
+        }
+    });
+
+    if (failed > 0)
+    {
+        cerr << failed << " files not written in " << root << endl;
+        return 1;
+    }
+    cout << root << ": " << options.frames << " frames" << endl;
+    return 0;
+}
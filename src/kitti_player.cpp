@@ -19,27 +19,42 @@
 // ###############################################################################################
 // ###############################################################################################
 
+#include <cstdio>
 #include <iostream>
 #include <fstream>
 #include <limits>
 #include <sstream>
 #include <string>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
 #include <ros/ros.h>
 #include <boost/algorithm/string.hpp>
-#include <boost/lexical_cast.hpp>
 #include <boost/locale.hpp>
 #include <boost/program_options.hpp>
 #include <boost/progress.hpp>
-#include <boost/tokenizer.hpp>
+#include <boost/thread.hpp>
 #include <cv_bridge/cv_bridge.h>
+#include <dynamic_reconfigure/server.h>
 #include <image_transport/image_transport.h>
+#include <kitti_player/frame_cache.h>
+#include <kitti_player/image_codec.h>
+#include <kitti_player/kitti_playerConfig.h>
+#include <kitti_player/kitti_reader.h>
+#include <kitti_player/ShmDescriptor.h>
+#include <kitti_player/velodyne_codec.h>
+#include <kitti_player/shm_ring.h>
+#include <kitti_player/tracklets.h>
+#include <kitti_player/TrackletBoxArray.h>
+#include <kitti_player/zip_archive.h>
+#include <nav_msgs/Path.h>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
-#include <pcl_conversions/pcl_conversions.h>
-#include <pcl_ros/point_cloud.h>
-#include <pcl/point_types.h>
+#include <rosgraph_msgs/Clock.h>
 #include <visualization_msgs/Marker.h>
 #include <visualization_msgs/MarkerArray.h>
+#include <geometry_msgs/PoseStamped.h>
 #include <sensor_msgs/distortion_models.h>
 #include <sensor_msgs/image_encodings.h>
 #include <sensor_msgs/Imu.h>
@@ -47,13 +62,22 @@
 #include <sensor_msgs/PointCloud2.h>
 #include <stereo_msgs/DisparityImage.h>
 #include <std_msgs/Bool.h>
+#include <std_msgs/Header.h>
 #include <tf/LinearMath/Transform.h>
 #include <tf/transform_broadcaster.h>
 #include <tf/transform_listener.h>
 #include <time.h>
+#include <sys/stat.h>
+
+#include "frame_viewer.h"
+#include "image_stages.h"
+#include "message_pool.h"
+#include "stream_threads.h"
+#include "throughput_profile.h"
+#include "velodyne_stages.h"
+#include "worker_pool.h"
 
 using namespace std;
-using namespace pcl;
 using namespace ros;
 using namespace tf;
 
@@ -71,12 +95,45 @@ struct kitti_player_options
     bool    color;            // publish
     bool    viewer;           // enable CV viewer
     bool    timestamps;       // use KITTI timestamps;
-    bool    sendTransform;    // publish velodyne TF IMU 3DOF orientation wrt fixed frame
+    bool    sendTransform;    // publish world->base_link TF, pose and path from the OXTS trajectory
     bool    stereoDisp;       // use precalculated stereoDisparities
     bool    viewDisparities;  // view use precalculated stereoDisparities
+    bool    computeDisp;      // compute the missing stereoDisparities from image_00/01, and cache them
     bool    synchMode;        // start with synchMode on (wait for message to send next frame)
     unsigned int startFrame;  // start the replay at frame ...
     string gpsReferenceFrame; // publish GPS points into RVIZ as RVIZ Markers
+    unsigned int gpsTrailLength; // max number of GPS markers kept in RVIZ, 0 = unlimited
+    float   gpsTrailSpacing;  // min distance [m] between two GPS markers, 0 = one marker per frame
+    bool    unsynced;         // play an unsynced (extract) drive, each stream at its own rate
+    bool    deskew;           // remove the ego-motion distortion from the velodyne scans
+    float   compactError;     // max coordinate error [m] of hdl64e_compact, 0 = not published
+    unsigned int pyramidLevels; // reduced camera levels published (1/2, 1/4, ...)
+    unsigned int rangeImageCols; // width of hdl64e_range, 0 = not published
+    float   cropMinRange;     // hdl64e_cropped range limits [m]
+    float   cropMaxRange;     // 0 = no limit
+    bool    cropFrustum;      // hdl64e_cropped keeps the points seen by image_02
+    float   voxelLeaf;        // voxel size [m] of hdl64e_voxel, 0 = not published
+    bool    clock;            // publish /clock from the KITTI timestamps (simulated time)
+    float   clockSpeed;       // simulated time speed wrt real time, 0 = as fast as possible
+    bool    adaptive;         // adapt the replay frequency to the consumers acks
+    float   minRate;          // adaptive frequency bounds
+    float   maxRate;
+    unsigned int targetLag;   // frames published and not acked yet, kept by the adaptive mode
+    bool    shm;              // also publish images and scans through shared memory
+    unsigned int shmSlots;    // slots per shared memory ring
+    float   shmSlotSize;      // MB per slot
+    bool    streamThreads;    // publish every stream of a frame from its own thread
+    string  cpuAffinity;      // cores of the stream threads, e.g. "2,3,4", empty = any core
+    unsigned int realtime;    // SCHED_FIFO priority of the stream threads, 0 = default scheduler
+    bool    noCache;          // ignore the kitti_transcode caches, read the raw files
+    unsigned int frameCache;  // MB of the decoded frames cache shared by the players of the host, 0 = not used
+    string  frameCacheName;   // shared memory segment of the frames cache
+    bool    tracklets;        // publish the tracklet_labels.xml boxes of every frame
+    int     sequence;         // odometry benchmark sequence played, -1 = path is a raw drive
+    bool    profile;          // play at unlimited rate and report frames/s and time per stream
+    string  baseline;         // profile baseline file, compared to
+    bool    recordBaseline;   // record the combinations missing from the baseline file instead of failing
+    float   tolerance;        // relative regression accepted wrt the baseline
 };
 
 
@@ -97,47 +154,535 @@ void synchCallback(const std_msgs::Bool::ConstPtr& msg)
         waitSynch = false;
 }
 
+/**
+ * @brief The AdaptiveRate class adapts the replay frequency to the slowest consumer
+ *
+ * Every published header carries the frame number in its seq field. Consumers
+ * echo the header of each processed message on /kitti_player/ack; the frames
+ * published and not acked yet by a consumer are its lag. Before publishing, the
+ * player waits while the lag is at the target (a consumer with queue size 1
+ * would drop the frame) and slows down; it speeds up while the lag is below the
+ * target. Consumers silent for a few seconds are forgotten.
+ */
+class AdaptiveRate
+{
+public:
+    AdaptiveRate(ros::NodeHandle &node, double rate, double min_rate, double max_rate, unsigned int target_lag)
+        : rate_(std::min(std::max(rate, min_rate), max_rate)), min_rate_(min_rate), max_rate_(max_rate),
+          target_lag_(std::max(1u, target_lag)), changed_(true)
+    {
+        sub_ = node.subscribe("/kitti_player/ack", 100, &AdaptiveRate::ackCallback, this);
+    }
+
+    /**
+     * @brief waitFor waits until frame can be published without drops, and adapts the rate
+     * @param frame next frame to publish
+     * @return false if ROS is shutting down
+     */
+    bool waitFor(unsigned int frame)
+    {
+        bool waited = false;
+        ros::spinOnce();
+        while (ros::ok() && lag(frame) >= target_lag_)
+        {
+            waited = true;
+            ros::WallDuration(0.001).sleep();
+            ros::spinOnce();
+        }
+        if (consumers_.empty())
+            return ros::ok();
+
+        double rate = rate_;
+        if (waited)
+            rate *= 0.8;
+        else if (lag(frame) == 0 || lag(frame) + 1 < target_lag_)
+            rate *= 1.1;
+        rate = std::min(std::max(rate, min_rate_), max_rate_);
+        if (rate != rate_)
+        {
+            rate_ = rate;
+            changed_ = true;
+        }
+        return ros::ok();
+    }
+
+    /**
+     * @brief rateChanged
+     * @param rate current replay frequency
+     * @return 1 if the rate changed since the last call, 0 otherwise
+     */
+    int rateChanged(double &rate)
+    {
+        rate = rate_;
+        bool changed = changed_;
+        changed_ = false;
+        return changed;
+    }
+
+private:
+    struct Consumer
+    {
+        unsigned int    next;       // first frame not acked yet
+        ros::WallTime   last_ack;
+    };
+
+    void ackCallback(const ros::MessageEvent<std_msgs::Header const> &event)
+    {
+        std::map<string, Consumer>::iterator it = consumers_.find(event.getPublisherName());
+        if (it == consumers_.end())
+        {
+            ROS_INFO_STREAM("Adaptive rate: acks from " << event.getPublisherName());
+            it = consumers_.insert(std::make_pair(event.getPublisherName(), Consumer())).first;
+            it->second.next = 0;
+        }
+        it->second.next = std::max(it->second.next, event.getMessage()->seq + 1);
+        it->second.last_ack = ros::WallTime::now();
+    }
+
+    /// frames before frame not acked yet by the slowest consumer
+    unsigned int lag(unsigned int frame)
+    {
+        unsigned int slowest = frame;
+        std::map<string, Consumer>::iterator it = consumers_.begin();
+        while (it != consumers_.end())
+        {
+            if (ros::WallTime::now() - it->second.last_ack > ros::WallDuration(5.0))
+            {
+                ROS_WARN_STREAM("Adaptive rate: no acks from " << it->first << ", ignoring it");
+                consumers_.erase(it++);
+                continue;
+            }
+            slowest = std::min(slowest, it->second.next);
+            ++it;
+        }
+        return frame - slowest;
+    }
+
+    ros::Subscriber             sub_;
+    std::map<string, Consumer>  consumers_;
+    double                      rate_;
+    double                      min_rate_;
+    double                      max_rate_;
+    unsigned int                target_lag_;
+    bool                        changed_;
+};
+
+/// Live playback control, set from dynamic_reconfigure (cfg/kitti_player.cfg)
+struct PlaybackControl
+{
+    double  loop_rate;      // replay frequency
+    bool    rate_changed;   // loop_rate changed since last read
+    bool    playing;        // false: paused
+    bool    step;           // publish a single frame while paused
+    bool    continuous;     // play every frame at loop_rate, ignoring synch mode
+};
+
+PlaybackControl control = { 1.0, false, true, false, false };
+
+/**
+ * @brief reconfigureCallback
+ * @param config new configuration
+ * @param level unused
+ *
+ * The "publish" request is consumed here and reset, so that clients see it
+ * as a button.
+ */
+void reconfigureCallback(kitti_player::kitti_playerConfig &config, uint32_t level)
+{
+    if (config.loop_rate != control.loop_rate)
+    {
+        ROS_INFO_STREAM("Replay frequency set to " << config.loop_rate);
+        control.loop_rate = config.loop_rate;
+        control.rate_changed = true;
+    }
+    if (config.start != control.playing)
+        ROS_INFO_STREAM((config.start ? "Playback resumed" : "Playback paused"));
+
+    control.playing = config.start;
+    control.continuous = config.continuous;
+    if (config.publish)
+    {
+        control.step = true;
+        config.publish = false;
+    }
+}
+
+/**
+ * @brief setVelodyneLayout describes a scan as a PointCloud2 with x y z intensity float fields
+ * @param pc2 cloud, data is left untouched
+ * @param header Header to use to publish the message
+ * @param count number of points
+ *
+ * This is the layout of the KITTI scans, the points can be copied as they are.
+ */
+void setVelodyneLayout(sensor_msgs::PointCloud2 &pc2, const std_msgs::Header &header, size_t count)
+{
+    pc2.header.frame_id = "base_link"; //ros::this_node::getName();
+    pc2.header.stamp = header.stamp;
+    pc2.header.seq = header.seq;
+
+    const char *names[] = { "x", "y", "z", "intensity" };
+    pc2.fields.resize(4);
+    for (int i = 0; i < 4; i++)
+    {
+        pc2.fields[i].name     = names[i];
+        pc2.fields[i].offset   = i * sizeof(float);
+        pc2.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+        pc2.fields[i].count    = 1;
+    }
+
+    pc2.height       = 1;
+    pc2.width        = count;
+    pc2.point_step   = 4 * sizeof(float);
+    pc2.row_step     = pc2.point_step * count;
+    pc2.is_bigendian = false;
+    pc2.is_dense     = true;
+}
+
 /**
  * @brief publish_velodyne
  * @param pub The ROS publisher as reference
- * @param infile file with data to publish
+ * @param scan scan to publish
  * @param header Header to use to publish the message
- * @return 1 if file is correctly readed, 0 otherwise
+ * @param messages recycled messages of the stream
+ * @return 1 if the scan is published
+ *
+ * The scan is published as a PointCloud2 with a single copy of the points,
+ * without going through a pcl::PointCloud.
+ */
+int publish_velodyne(ros::Publisher &pub, const kitti_player::VelodyneScan &scan, std_msgs::Header *header,
+                     MessagePool<sensor_msgs::PointCloud2> &messages)
+{
+    MessagePool<sensor_msgs::PointCloud2>::Ptr pc2 = messages.acquire();
+    setVelodyneLayout(*pc2, *header, scan.size());
+    pc2->data.resize(pc2->row_step);
+    if (!scan.empty())
+        memcpy(pc2->data.data(), scan.data(), pc2->row_step);
+    pub.publish(pc2);
+
+    return 1;
+}
+
+/**
+ * @brief publish_velodyne_compact publishes the scan with quantized fields
+ * @param pub The ROS publisher as reference
+ * @param scan scan to publish
+ * @param scale size of a coordinate step [m]
+ * @param header Header to use to publish the message
+ * @param pool workers packing the points
+ * @param messages recycled messages of the stream
+ * @return 1 if the scan is published
+ *
+ * x, y, z are int16 steps of scale meters (as declared in the ~hdl64e_compact/scale
+ * parameter), intensity an uint8 step of 1/255.
+ */
+int publish_velodyne_compact(ros::Publisher &pub, const kitti_player::VelodyneScan &scan, float scale, std_msgs::Header *header, WorkerPool &pool,
+                             MessagePool<sensor_msgs::PointCloud2> &messages)
+{
+    MessagePool<sensor_msgs::PointCloud2>::Ptr pc2 = messages.acquire();
+
+    pc2->header.frame_id = "base_link";
+    pc2->header.stamp = header->stamp;
+    pc2->header.seq = header->seq;
+
+    const char *names[] = { "x", "y", "z", "intensity" };
+    pc2->fields.resize(4);
+    for (int i = 0; i < 4; i++)
+    {
+        pc2->fields[i].name     = names[i];
+        pc2->fields[i].offset   = 2 * i;
+        pc2->fields[i].datatype = i < 3 ? sensor_msgs::PointField::INT16 : sensor_msgs::PointField::UINT8;
+        pc2->fields[i].count    = 1;
+    }
+
+    const size_t count = scan.size();
+    pc2->data.resize(count * kCompactPointStep);
+    const size_t written = quantizeScan(scan.data(), count, scale, pc2->data.data(), pool);
+    pc2->data.resize(written * kCompactPointStep);
+
+    pc2->height       = 1;
+    pc2->width        = written;
+    pc2->point_step   = kCompactPointStep;
+    pc2->row_step     = pc2->data.size();
+    pc2->is_bigendian = false;
+    pc2->is_dense     = true;
+    pub.publish(pc2);
+
+    return 1;
+}
+
+/// slot of the shared frames cache: a KITTI color image (1.4 MB) or scan (about 2 MB)
+const size_t kFrameCacheSlot = 2 << 20;
+
+/**
+ * @brief loadCachedImage loads an image through the shared frames cache
+ * @param cache frames cache, the image is just loaded when it is closed
+ * @param key frame key
+ * @param filename image file, decoded when the cache misses it
+ * @param image output image: decoded, or in place in the cache slot held by view
+ * @param file_buffer keeps the encoded file
+ * @param view holds the slot of the image of the previous call, then of this one
+ * @return 1 if the image is loaded, 0 otherwise
+ *
+ * A decoded image is copied in a free slot for the other players.
  */
-int publish_velodyne(ros::Publisher &pub, string infile, std_msgs::Header *header)
+int loadCachedImage(kitti_player::FrameCache &cache, uint64_t key, const string &filename, cv::Mat &image,
+                    vector<uint8_t> &file_buffer, kitti_player::FrameCacheView &view)
 {
-    fstream input(infile.c_str(), ios::in | ios::binary);
-    if (!input.good())
+    if (!cache.isOpen())
+        return kitti_player::loadImage(filename, image, file_buffer);
+
+    // the previous image is the cached one: it must not be decoded over
+    if (view.valid())
+    {
+        image.release();
+        view.release();
+    }
+    if (cache.find(key, view))
     {
-        ROS_ERROR_STREAM ( "Could not read file: " << infile );
+        const uint32_t *info = view.info();
+        image = cv::Mat(info[0], info[1], info[2], const_cast<uint8_t*>(view.data()));
+        return 1;
+    }
+
+    if (!kitti_player::loadImage(filename, image, file_buffer))
         return 0;
+    const size_t bytes = image.total() * image.elemSize();
+    uint8_t *slot = image.isContinuous() ? cache.reserve(key, bytes, view) : NULL;
+    if (slot != NULL)
+    {
+        memcpy(slot, image.data, bytes);
+        uint32_t info[3] = { uint32_t(image.rows), uint32_t(image.cols), uint32_t(image.type()) };
+        cache.commit(view, info);
+        view.release();
     }
-    else
+    return 1;
+}
+
+/**
+ * @brief loadCachedScan loads a velodyne scan through the shared frames cache
+ * @param cache frames cache, the scan is just loaded when it is closed
+ * @param key frame key
+ * @param filename scan file, decoded when the cache misses it
+ * @param scan output scan, in buffer: the stages may change it in place
+ * @param buffer points buffer
+ * @return 1 if the scan is loaded, 0 otherwise
+ */
+int loadCachedScan(kitti_player::FrameCache &cache, uint64_t key, const string &filename, kitti_player::VelodyneScan &scan,
+                   vector<float> &buffer)
+{
+    if (!cache.isOpen())
+        return scan.load(filename, buffer);
+
+    kitti_player::FrameCacheView view;
+    if (cache.find(key, view))
+    {
+        buffer.resize(view.size() / sizeof(float));
+        memcpy(buffer.data(), view.data(), buffer.size() * sizeof(float));
+        scan.wrap(buffer.data(), buffer.size() / 4);
+        return 1;
+    }
+
+    if (!scan.load(filename, buffer))
+        return 0;
+    const size_t bytes = scan.size() * 4 * sizeof(float);
+    uint8_t *slot = cache.reserve(key, bytes, view);
+    if (slot != NULL)
     {
-        ROS_DEBUG_STREAM ("reading " << infile);
-        input.seekg(0, ios::beg);
+        memcpy(slot, scan.data(), bytes);
+        uint32_t info[3] = { uint32_t(scan.size()), 0, 0 };
+        cache.commit(view, info);
+    }
+    return 1;
+}
+
+/**
+ * @brief publish_velodyne_cropped publishes the points of the scan within a region
+ * @param pub The ROS publisher as reference
+ * @param scan scan to publish
+ * @param region range limits and camera frustum
+ * @param header Header to use to publish the message
+ * @param pool workers filtering the points
+ * @param blocks per block counts of cropScan
+ * @param messages recycled messages of the stream
+ * @return 1 if the scan is published
+ *
+ * The kept points are written by cropScan straight into the message data.
+ */
+int publish_velodyne_cropped(ros::Publisher &pub, const kitti_player::VelodyneScan &scan, const CropRegion &region, std_msgs::Header *header,
+                             WorkerPool &pool, vector<size_t> &blocks, MessagePool<sensor_msgs::PointCloud2> &messages)
+{
+    MessagePool<sensor_msgs::PointCloud2>::Ptr pc2 = messages.acquire();
+    pc2->data.resize(scan.size() * 4 * sizeof(float));
+    const size_t written = cropScan(scan.data(), scan.size(), region, reinterpret_cast<float*>(pc2->data.data()), blocks, pool);
+
+    setVelodyneLayout(*pc2, *header, written);
+    pc2->data.resize(pc2->row_step);
+    pub.publish(pc2);
+
+    return 1;
+}
+
+/**
+ * @brief publish_velodyne_voxel publishes the scan downsampled on a voxel grid
+ * @param pub The ROS publisher as reference
+ * @param scan scan to publish
+ * @param leaf voxel size [m]
+ * @param header Header to use to publish the message
+ * @param pool workers running the grid
+ * @param grid buffers of voxelizeScan
+ * @param messages recycled messages of the stream
+ * @return 1 if the scan is published
+ */
+int publish_velodyne_voxel(ros::Publisher &pub, const kitti_player::VelodyneScan &scan, float leaf, std_msgs::Header *header,
+                           WorkerPool &pool, VoxelGrid &grid, MessagePool<sensor_msgs::PointCloud2> &messages)
+{
+    MessagePool<sensor_msgs::PointCloud2>::Ptr pc2 = messages.acquire();
+    pc2->data.resize(scan.size() * 4 * sizeof(float));
+    const size_t written = voxelizeScan(scan.data(), scan.size(), leaf, reinterpret_cast<float*>(pc2->data.data()), grid, pool);
 
-        pcl::PointCloud<pcl::PointXYZI>::Ptr points (new pcl::PointCloud<pcl::PointXYZI>);
+    setVelodyneLayout(*pc2, *header, written);
+    pc2->data.resize(pc2->row_step);
+    pub.publish(pc2);
 
-        int i;
-        for (i = 0; input.good() && !input.eof(); i++)
+    return 1;
+}
+
+/**
+ * @brief getCropRegion builds the hdl64e_cropped region
+ * @param dir_root drive directory, with the trailing /
+ * @param options player options, range limits and frustum
+ * @param odometry calib.txt of an odometry sequence, NULL for a raw drive
+ * @param region output region
+ * @return 1 if the calibration needed by the frustum is read, 0 otherwise
+ *
+ * Velodyne points are seen by image_02 at P_rect_02 * R_rect_00 * [R T] of
+ * calib_velo_to_cam.txt, as in the KITTI devkit; at P2 * Tr in the odometry
+ * sequences, where the image size is the one of the first image_2 frame.
+ */
+int getCropRegion(const string &dir_root, const kitti_player_options &options, const kitti_player::OdometryCalibration *odometry, CropRegion &region)
+{
+    region.min_range = options.cropMinRange;
+    region.max_range = options.cropMaxRange;
+    region.frustum = options.cropFrustum;
+    std::fill(region.projection, region.projection + 12, 0.0f);
+    region.width = region.height = 0.0f;
+    if (!options.cropFrustum)
+        return 1;
+
+    // velodyne -> rectified camera 00 frame, then projected
+    kitti_player::CameraCalibration camera00, camera02;
+    double rect[12];
+    const double *P = camera02.P;
+    if (odometry != NULL)
+    {
+        cv::Mat first;
+        if (!kitti_player::loadImage(kitti_player::frameFilename(dir_root + "image_2/", 0, ".png", kitti_player::kOdometryFrameDigits), first))
+            return 0;
+        std::copy(odometry->Tr, odometry->Tr + 12, rect);
+        P = odometry->P[2];
+        region.width = first.cols;
+        region.height = first.rows;
+    }
+    else
+    {
+        double R[9], T[3];
+        if (!kitti_player::loadCameraCalibration(dir_root, "00", camera00) ||
+            !kitti_player::loadCameraCalibration(dir_root, "02", camera02) ||
+            !kitti_player::loadVeloToCam(dir_root, R, T))
+            return 0;
+
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                rect[4 * i + j] = 0.0;
+                for (int k = 0; k < 3; k++)
+                    rect[4 * i + j] += camera00.R_rect[3 * i + k] * R[3 * k + j];
+            }
+            rect[4 * i + 3] = 0.0;
+            for (int k = 0; k < 3; k++)
+                rect[4 * i + 3] += camera00.R_rect[3 * i + k] * T[k];
+        }
+        region.width = camera02.S_rect[0];
+        region.height = camera02.S_rect[1];
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 4; j++)
         {
-            pcl::PointXYZI point;
-            input.read((char *) &point.x, 3 * sizeof(float));
-            input.read((char *) &point.intensity, sizeof(float));
-            points->push_back(point);
+            double value = j == 3 ? P[4 * i + 3] : 0.0;
+            for (int k = 0; k < 3; k++)
+                value += P[4 * i + k] * rect[4 * k + j];
+            region.projection[4 * i + j] = value;
         }
-        input.close();
+    }
+    return region.width > 0.0f && region.height > 0.0f;
+}
+
+/**
+ * @brief publish_range_image publishes the scan projected on a range image
+ * @param pub The ROS publisher as reference
+ * @param scan scan to publish
+ * @param cols image width
+ * @param header Header to use to publish the message
+ * @param pool workers projecting the points
+ * @param projection per point buffers of projectScan
+ * @param messages recycled messages of the stream
+ * @return 1 if the image is published
+ *
+ * The image is projected in place in the message data, 2 floats per pixel:
+ * range and reflectance (see projectScan).
+ */
+int publish_range_image(ros::Publisher &pub, const kitti_player::VelodyneScan &scan, unsigned int cols, std_msgs::Header *header, WorkerPool &pool,
+                        RangeProjection &projection, MessagePool<sensor_msgs::Image> &messages)
+{
+    MessagePool<sensor_msgs::Image>::Ptr image = messages.acquire();
 
-        //workaround for the PCL headers... http://wiki.ros.org/hydro/Migration#PCL
-        sensor_msgs::PointCloud2 pc2;
+    image->header.frame_id = "base_link";
+    image->header.stamp = header->stamp;
+    image->header.seq = header->seq;
+    image->height = kRangeImageRows;
+    image->width = cols;
+    image->encoding = sensor_msgs::image_encodings::TYPE_32FC2;
+    image->is_bigendian = false;
+    image->step = cols * 2 * sizeof(float);
+    image->data.resize(image->step * image->height);
 
-        pc2.header.frame_id = "base_link"; //ros::this_node::getName();
-        pc2.header.stamp = header->stamp;
-        points->header = pcl_conversions::toPCL(pc2.header);
-        pub.publish(points);
+    projectScan(scan.data(), scan.size(), cols, reinterpret_cast<float*>(image->data.data()), projection, pool);
+    pub.publish(image);
 
-        return 1;
+    return 1;
+}
+
+/**
+ * @brief getVelodyneMotion computes the ego-motion of the scanner
+ * @param oxts oxts packet of the scan
+ * @param R double R[9] - rotation from IMU to velodyne frame
+ * @param T double T[3] - translation from IMU to velodyne frame
+ * @param motion output motion, in the velodyne frame
+ */
+void getVelodyneMotion(const kitti_player::OxtsPacket &oxts, const double *R, const double *T, EgoMotion &motion)
+{
+    //    - vf, vl, vu: forward, leftward, upward velocity (m/s)
+    //    - wf, wl, wu: angular rate around forward, leftward, upward axes (rad/s)
+    double v[3] = { oxts.vf, oxts.vl, oxts.vu };
+    double w[3] = { oxts.wf, oxts.wl, oxts.wu };
+
+    // velocity of the velodyne origin, o = -R' * T in the IMU frame: v + w x o
+    double o[3];
+    for (int i = 0; i < 3; i++)
+        o[i] = -(R[i] * T[0] + R[3 + i] * T[1] + R[6 + i] * T[2]);
+    double vo[3] = { v[0] + w[1] * o[2] - w[2] * o[1],
+                     v[1] + w[2] * o[0] - w[0] * o[2],
+                     v[2] + w[0] * o[1] - w[1] * o[0]
+                   };
+
+    // ... both rotated in the velodyne frame
+    for (int i = 0; i < 3; i++)
+    {
+        motion.linear[i]  = R[3 * i] * vo[0] + R[3 * i + 1] * vo[1] + R[3 * i + 2] * vo[2];
+        motion.angular[i] = R[3 * i] * w[0]  + R[3 * i + 1] * w[1]  + R[3 * i + 2] * w[2];
     }
 }
 
@@ -165,116 +710,261 @@ int publish_velodyne(ros::Publisher &pub, string infile, std_msgs::Header *heade
  */
 int getCalibration(string dir_root, string camera_name, double* K, std::vector<double> & D, double *R, double* P)
 {
-
-    string calib_cam_to_cam = dir_root + "calib_cam_to_cam.txt";
-    ifstream file_c2c(calib_cam_to_cam.c_str());
-    if (!file_c2c.is_open())
+    kitti_player::CameraCalibration calibration;
+    if (!kitti_player::loadCameraCalibration(dir_root, camera_name, calibration))
         return false;
 
-    ROS_INFO_STREAM("Reading camera" << camera_name << " calibration from " << calib_cam_to_cam);
+    ROS_INFO_STREAM("Reading camera" << camera_name << " calibration from " << dir_root << "calib_cam_to_cam.txt");
 
-    typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
-    boost::char_separator<char> sep {" "};
+    // D is left empty: the images are rectified
+    std::copy(calibration.K, calibration.K + 9, K);
+    std::copy(calibration.R, calibration.R + 9, R);
+    std::copy(calibration.P, calibration.P + 12, P);
 
-    string line = "";
-    unsigned char index = 0;
-    tokenizer::iterator token_iterator;
-
-    while (getline(file_c2c, line))
-    {
-        // Parse string phase 1, tokenize it using Boost.
-        tokenizer tok(line, sep);
+    ROS_INFO_STREAM("... ok");
+    return true;
+}
 
-        // Move the iterator at the beginning of the tokenize vector and check for K/D/R/P matrices.
-        token_iterator = tok.begin();
-        if (strcmp((*token_iterator).c_str(), ((string)(string("K_") + camera_name + string(":"))).c_str()) == 0) //Calibration Matrix
+/**
+ * @brief getOdometryCalibration reads the camera info of an odometry sequence camera
+ * @param calibration calib.txt of the sequence
+ * @param camera 0 ... 3
+ * @param K double K[9]  - Calibration Matrix
+ * @param R double R[9]  - Rectification Matrix
+ * @param P double P[12] - Projection Matrix Rectified (u,v,w) = P * R * (x,y,z,q)
+ * @return 1 if the camera has a projection matrix, 0 otherwise
+ *
+ * calib.txt only holds the rectified projections, from the image_0 frame:
+ * K is the left 3x3 block of P, R the identity.
+ */
+int getOdometryCalibration(const kitti_player::OdometryCalibration &calibration, int camera, double *K, double *R, double *P)
+{
+    const double *P_rect = calibration.P[camera];
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
         {
-            index = 0; //should be 9 at the end
-            ROS_DEBUG_STREAM("K_" << camera_name);
-            for (token_iterator++; token_iterator != tok.end(); token_iterator++)
-            {
-                //std::cout << *token_iterator << '\n';
-                K[index++] = boost::lexical_cast<double>(*token_iterator);
-            }
+            K[3 * i + j] = P_rect[4 * i + j];
+            R[3 * i + j] = i == j ? 1.0 : 0.0;
         }
+    std::copy(P_rect, P_rect + 12, P);
+    return P_rect[0] != 0.0;
+}
 
-        // EXPERIMENTAL: use with unrectified images
-
-        //        token_iterator=tok.begin();
-        //        if (strcmp((*token_iterator).c_str(),((string)(string("D_")+camera_name+string(":"))).c_str())==0) //Distortion Coefficients
-        //        {
-        //            index=0; //should be 5 at the end
-        //            ROS_DEBUG_STREAM("D_" << camera_name);
-        //            for (token_iterator++; token_iterator != tok.end(); token_iterator++)
-        //            {
-        ////                std::cout << *token_iterator << '\n';
-        //                D[index++]=boost::lexical_cast<double>(*token_iterator);
-        //            }
-        //        }
+/**
+ * @brief The ShmPublisher class publishes images and clouds through a shared-memory ring
+ *
+ * The payload is written in a slot of a kitti_player::ShmRingWriter, and only a
+ * kitti_player/ShmDescriptor goes over ROS. Nothing is written while the
+ * descriptor topic has no subscribers.
+ */
+class ShmPublisher
+{
+public:
+    /**
+     * @brief open
+     * @param node NodeHandle advertising the descriptors
+     * @param topic descriptor topic
+     * @param slots number of slots in the ring
+     * @param slot_size bytes per slot
+     * @return 1 if the ring is created, 0 otherwise
+     */
+    int open(ros::NodeHandle &node, const string &topic, unsigned int slots, size_t slot_size)
+    {
+        pub_ = node.advertise<kitti_player::ShmDescriptor>(topic + "/shm", 1);
 
-        token_iterator = tok.begin();
-        if (strcmp((*token_iterator).c_str(), ((string)(string("R_") + camera_name + string(":"))).c_str()) == 0) //Rectification Matrix
+        // one segment per resolved topic and player, e.g. /kitti_player.color.left.image_rect.shm.1234
+        string segment = boost::str(boost::format("%s.%d") % pub_.getTopic() % getpid());
+        std::replace(segment.begin() + 1, segment.end(), '/', '.');
+        if (!ring_.create(segment, slots, slot_size))
         {
-            index = 0; //should be 12 at the end
-            ROS_DEBUG_STREAM("R_" << camera_name);
-            for (token_iterator++; token_iterator != tok.end(); token_iterator++)
-            {
-                //std::cout << *token_iterator << '\n';
-                R[index++] = boost::lexical_cast<double>(*token_iterator);
-            }
+            ROS_ERROR_STREAM("Fail to create the shared memory segment " << segment << ": " << strerror(errno)
+                             << (errno == EEXIST ? " (left by a crashed player? remove it from /dev/shm)" : ""));
+            pub_.shutdown();
+            return 0;
         }
+        return 1;
+    }
+
+    /**
+     * @brief publish an image
+     * @param header Header of the image
+     * @param encoding image encoding
+     * @param image 8 bit image
+     * @return 1 if the image is published or nobody listens, 0 if it was dropped
+     */
+    int publish(const std_msgs::Header &header, const string &encoding, const cv::Mat &image)
+    {
+        if (!ring_.isOpen() || pub_.getNumSubscribers() == 0)
+            return 1;
+
+        kitti_player::ShmDescriptor msg;
+        msg.type = kitti_player::ShmDescriptor::IMAGE;
+        msg.image.header = header;
+        msg.image.height = image.rows;
+        msg.image.width = image.cols;
+        msg.image.encoding = encoding;
+        msg.image.is_bigendian = 0;
+        msg.image.step = image.cols * image.elemSize();
+
+        uint8_t *data = acquire(msg, msg.image.step * image.rows);
+        if (data == NULL)
+            return 0;
+        for (int r = 0; r < image.rows; r++)
+            memcpy(data + r * msg.image.step, image.ptr(r), msg.image.step);
+        return commit(msg);
+    }
 
-        token_iterator = tok.begin();
-        if (strcmp((*token_iterator).c_str(), ((string)(string("P_rect_") + camera_name + string(":"))).c_str()) == 0) //Projection Matrix Rectified
+    /**
+     * @brief publish a velodyne scan as PointCloud2 with x y z intensity fields
+     * @param header Header of the scan
+     * @param scan scan to publish
+     * @return 1 if the scan is published or nobody listens, 0 if it was dropped
+     */
+    int publish(const std_msgs::Header &header, const kitti_player::VelodyneScan &scan)
+    {
+        if (!ring_.isOpen() || pub_.getNumSubscribers() == 0)
+            return 1;
+
+        kitti_player::ShmDescriptor msg;
+        msg.type = kitti_player::ShmDescriptor::POINTCLOUD2;
+        setVelodyneLayout(msg.cloud, header, scan.size());
+
+        uint8_t *data = acquire(msg, msg.cloud.row_step);
+        if (data == NULL)
+            return 0;
+        if (!scan.empty())
+            memcpy(data, scan.data(), msg.cloud.row_step);
+        return commit(msg);
+    }
+
+private:
+    uint8_t *acquire(kitti_player::ShmDescriptor &msg, size_t size)
+    {
+        if (size > ring_.slotSize())
         {
-            index = 0; //should be 12 at the end
-            ROS_DEBUG_STREAM("P_rect_" << camera_name);
-            for (token_iterator++; token_iterator != tok.end(); token_iterator++)
-            {
-                //std::cout << *token_iterator << '\n';
-                P[index++] = boost::lexical_cast<double>(*token_iterator);
-            }
+            ROS_WARN_STREAM_THROTTLE(5, ring_.name() << ": " << size << " bytes do not fit a slot, increase --shmSlotSize");
+            return NULL;
         }
+        uint8_t *data = ring_.acquire(msg.slot);
+        if (data == NULL)
+            ROS_WARN_STREAM_THROTTLE(5, ring_.name() << ": every slot is held by a reader, dropping");
+        msg.size = size;
+        return data;
+    }
 
+    int commit(kitti_player::ShmDescriptor &msg)
+    {
+        msg.sequence = ring_.commit(msg.size);
+        msg.segment = ring_.name();
+        msg.header = msg.type == kitti_player::ShmDescriptor::IMAGE ? msg.image.header : msg.cloud.header;
+        pub_.publish(msg);
+        return 1;
     }
-    ROS_INFO_STREAM("... ok");
-    return true;
-}
 
-int getGPS(string filename, sensor_msgs::NavSatFix *ros_msgGpsFix, std_msgs::Header *header)
+    kitti_player::ShmRingWriter ring_;
+    ros::Publisher              pub_;
+};
+
+/**
+ * @brief halveCameraInfo adapts a CameraInfo to an image halved by halveImage
+ * @param info CameraInfo, modified in place
+ *
+ * Pixel centers map as u' = (u + 0.5) / 2 - 0.5, so the first two rows of K
+ * and P become 0.5 * row - 0.25 * third row.
+ */
+void halveCameraInfo(sensor_msgs::CameraInfo &info)
 {
-    ifstream file_oxts(filename.c_str());
-    if (!file_oxts.is_open())
+    info.width  /= 2;
+    info.height /= 2;
+    for (int r = 0; r < 2; r++)
     {
-        ROS_ERROR_STREAM("Fail to open " << filename);
-        return 0;
+        for (int c = 0; c < 3; c++)
+            info.K[3 * r + c] = 0.5 * info.K[3 * r + c] - 0.25 * info.K[6 + c];
+        for (int c = 0; c < 4; c++)
+            info.P[4 * r + c] = 0.5 * info.P[4 * r + c] - 0.25 * info.P[8 + c];
     }
+}
 
-    ROS_DEBUG_STREAM("Reading GPS data from oxts file: " << filename );
+/**
+ * @brief The PyramidBuffers struct keeps the levels of a camera from frame to frame
+ */
+struct PyramidBuffers
+{
+    vector<cv::Mat>                             level;
+    vector<MessagePool<sensor_msgs::Image> >    image;
+    vector<MessagePool<sensor_msgs::CameraInfo> > info;
+
+    explicit PyramidBuffers(size_t levels = 0) : level(levels), image(levels), info(levels) {}
+};
+
+/**
+ * @brief publish_pyramid publishes the reduced levels of a camera image
+ * @param pubs publishers of the levels, pubs[l - 1] for level l
+ * @param image full resolution image
+ * @param msg full resolution message, for header and encoding
+ * @param info full resolution CameraInfo
+ * @param buffers levels and messages of the camera, reused
+ * @param pool workers running the resize
+ *
+ * Levels are computed up to the deepest one with subscribers, and published
+ * only if subscribed.
+ */
+void publish_pyramid(const vector<image_transport::CameraPublisher> &pubs, const cv::Mat &image,
+                     const sensor_msgs::Image &msg, const sensor_msgs::CameraInfo &info,
+                     PyramidBuffers &buffers, WorkerPool &pool)
+{
+    size_t depth = 0;
+    for (size_t l = 1; l <= pubs.size(); l++)
+        if (pubs[l - 1].getNumSubscribers() > 0)
+            depth = l;
+    if (depth == 0)
+        return;
+
+    MessagePool<sensor_msgs::CameraInfo>::Ptr level_info;
+    for (size_t l = 1; l <= depth; l++)
+    {
+        const cv::Mat &upper = l == 1 ? image : buffers.level[l - 2];
+        halveImage(upper, buffers.level[l - 1], pool);
 
-    typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
-    boost::char_separator<char> sep {" "};
+        // each level info is halved from the previous one
+        MessagePool<sensor_msgs::CameraInfo>::Ptr upper_info = level_info;
+        level_info = buffers.info[l - 1].acquire();
+        *level_info = upper_info ? *upper_info : info;
+        halveCameraInfo(*level_info);
 
-    string line = "";
+        if (pubs[l - 1].getNumSubscribers() == 0)
+            continue;
 
-    getline(file_oxts, line);
-    tokenizer tok(line, sep);
-    vector<string> s(tok.begin(), tok.end());
+        MessagePool<sensor_msgs::Image>::Ptr level_msg = buffers.image[l - 1].acquire();
+        cv_bridge::CvImage(msg.header, msg.encoding, buffers.level[l - 1]).toImageMsg(*level_msg);
+        pubs[l - 1].publish(level_msg, level_info);
+    }
+}
 
+/**
+ * @brief getGPS
+ * @param oxts oxts packet
+ * @param ros_msgGpsFix output message
+ * @param header Header to use to publish the message
+ * @return 1
+ */
+int getGPS(const kitti_player::OxtsPacket &oxts, sensor_msgs::NavSatFix *ros_msgGpsFix, std_msgs::Header *header)
+{
     ros_msgGpsFix->header.frame_id = ros::this_node::getName();
     ros_msgGpsFix->header.stamp = header->stamp;
+    ros_msgGpsFix->header.seq = header->seq;
 
-    ros_msgGpsFix->latitude  = boost::lexical_cast<double>(s[0]);
-    ros_msgGpsFix->longitude = boost::lexical_cast<double>(s[1]);
-    ros_msgGpsFix->altitude  = boost::lexical_cast<double>(s[2]);
+    ros_msgGpsFix->latitude  = oxts.lat;
+    ros_msgGpsFix->longitude = oxts.lon;
+    ros_msgGpsFix->altitude  = oxts.alt;
 
     ros_msgGpsFix->position_covariance_type = sensor_msgs::NavSatFix::COVARIANCE_TYPE_APPROXIMATED;
     for (int i = 0; i < 9; i++)
         ros_msgGpsFix->position_covariance[i] = 0.0f;
 
-    ros_msgGpsFix->position_covariance[0] = boost::lexical_cast<double>(s[23]);
-    ros_msgGpsFix->position_covariance[4] = boost::lexical_cast<double>(s[23]);
-    ros_msgGpsFix->position_covariance[8] = boost::lexical_cast<double>(s[23]);
+    ros_msgGpsFix->position_covariance[0] = oxts.pos_accuracy;
+    ros_msgGpsFix->position_covariance[4] = oxts.pos_accuracy;
+    ros_msgGpsFix->position_covariance[8] = oxts.pos_accuracy;
 
     ros_msgGpsFix->status.service = sensor_msgs::NavSatStatus::SERVICE_GPS;
     ros_msgGpsFix->status.status  = sensor_msgs::NavSatStatus::STATUS_GBAS_FIX;
@@ -282,50 +972,37 @@ int getGPS(string filename, sensor_msgs::NavSatFix *ros_msgGpsFix, std_msgs::Hea
     return 1;
 }
 
-int getIMU(string filename, sensor_msgs::Imu *ros_msgImu, std_msgs::Header *header)
+/**
+ * @brief getIMU
+ * @param oxts oxts packet
+ * @param ros_msgImu output message
+ * @param header Header to use to publish the message
+ * @return 1
+ */
+int getIMU(const kitti_player::OxtsPacket &oxts, sensor_msgs::Imu *ros_msgImu, std_msgs::Header *header)
 {
-    ifstream file_oxts(filename.c_str());
-    if (!file_oxts.is_open())
-    {
-        ROS_ERROR_STREAM("Fail to open " << filename);
-        return 0;
-    }
-
-    ROS_DEBUG_STREAM("Reading IMU data from oxts file: " << filename );
-
-    typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
-    boost::char_separator<char> sep {" "};
-
-    string line = "";
-
-    getline(file_oxts, line);
-    tokenizer tok(line, sep);
-    vector<string> s(tok.begin(), tok.end());
-
     ros_msgImu->header.frame_id = ros::this_node::getName();
     ros_msgImu->header.stamp = header->stamp;
+    ros_msgImu->header.seq = header->seq;
 
     //    - ax:      acceleration in x, i.e. in direction of vehicle front (m/s^2)
     //    - ay:      acceleration in y, i.e. in direction of vehicle left (m/s^2)
     //    - az:      acceleration in z, i.e. in direction of vehicle top (m/s^2)
-    ros_msgImu->linear_acceleration.x = boost::lexical_cast<double>(s[11]);
-    ros_msgImu->linear_acceleration.y = boost::lexical_cast<double>(s[12]);
-    ros_msgImu->linear_acceleration.z = boost::lexical_cast<double>(s[13]);
+    ros_msgImu->linear_acceleration.x = oxts.ax;
+    ros_msgImu->linear_acceleration.y = oxts.ay;
+    ros_msgImu->linear_acceleration.z = oxts.az;
 
     //    - vf:      forward velocity, i.e. parallel to earth-surface (m/s)
     //    - vl:      leftward velocity, i.e. parallel to earth-surface (m/s)
     //    - vu:      upward velocity, i.e. perpendicular to earth-surface (m/s)
-    ros_msgImu->angular_velocity.x = boost::lexical_cast<double>(s[8]);
-    ros_msgImu->angular_velocity.y = boost::lexical_cast<double>(s[9]);
-    ros_msgImu->angular_velocity.z = boost::lexical_cast<double>(s[10]);
+    ros_msgImu->angular_velocity.x = oxts.vf;
+    ros_msgImu->angular_velocity.y = oxts.vl;
+    ros_msgImu->angular_velocity.z = oxts.vu;
 
     //    - roll:    roll angle (rad),  0 = level, positive = left side up (-pi..pi)
     //    - pitch:   pitch angle (rad), 0 = level, positive = front down (-pi/2..pi/2)
     //    - yaw:     heading (rad),     0 = east,  positive = counter clockwise (-pi..pi)
-    tf::Quaternion q = tf::createQuaternionFromRPY(   boost::lexical_cast<double>(s[3]),
-                                                      boost::lexical_cast<double>(s[4]),
-                                                      boost::lexical_cast<double>(s[5])
-                                                  );
+    tf::Quaternion q = tf::createQuaternionFromRPY(oxts.roll, oxts.pitch, oxts.yaw);
     ros_msgImu->orientation.x = q.getX();
     ros_msgImu->orientation.y = q.getY();
     ros_msgImu->orientation.z = q.getZ();
@@ -334,107 +1011,690 @@ int getIMU(string filename, sensor_msgs::Imu *ros_msgImu, std_msgs::Header *head
     return 1;
 }
 
-/// Cartesian coordinates struct, refs# 522
-struct Xy
-{
-    double x;
-    double y;
-};
-
 /** Conversion between geographic and UTM coordinates
     Adapted from:  http://www.uwgb.edu/dutchs/UsefulData/ConvertUTMNoOZ.HTM
     Refs# 522
 **/
-Xy latlon2xy_helper(double lat, double lngd)
+struct UtmConstants
 {
-    // WGS 84 datum
-    double eqRad = 6378137.0;
-    double flat = 298.2572236;
-
-    // constants used in calculations:
-    double a = eqRad;           // equatorial radius in meters
-    double f = 1.0 / flat;        // polar flattening
-    double b = a * (1.0 - f);     // polar radius
-    double e = sqrt(1.0 - (pow(b, 2) / pow(a, 2))); // eccentricity
-    double k0 = 0.9996;
-    double drad = M_PI / 180.0;
-
-    double phi = lat * drad;   // convert latitude to radians
-    double utmz = 1.0 + floor((lngd + 180.0) / 6.0); // longitude to utm zone
-    double zcm = 3.0 + 6.0 * (utmz - 1.0) - 180.0;     // central meridian of a zone
-    double esq = (1.0 - (b / a) * (b / a));
-    double e0sq = e * e / (1.0 - e * e);
-    double M = 0.0;
-    double M0 = 0.0;
-    double N = a / sqrt(1.0 - pow(e * sin(phi), 2));
-    double T = pow(tan(phi), 2);
-    double C = e0sq * pow(cos(phi), 2);
-    double A = (lngd - zcm) * drad * cos(phi);
-
-    // calculate M (USGS style)
-    M = phi * (1.0 - esq * (1.0 / 4.0 + esq * (3.0 / 64.0 + 5.0 * esq / 256.0)));
-    M = M - sin(2.0 * phi) * (esq * (3.0 / 8.0 + esq * (3.0 / 32.0 + 45.0 * esq / 1024.0)));
-    M = M + sin(4.0 * phi) * (esq * esq * (15.0 / 256.0 + esq * 45.0 / 1024.0));
-    M = M - sin(6.0 * phi) * (esq * esq * esq * (35.0 / 3072.0));
-    M = M * a; // Arc length along standard meridian
-
-    // now we are ready to calculate the UTM values...
-    // first the easting (relative to CM)
-    double x = k0 * N * A * (1.0 + A * A * ((1.0 - T + C) / 6.0 + A * A * (5.0 - 18.0 * T + T * T + 72.0 * C - 58.0 * e0sq) / 120.0));
-    x = x + 500000.0; // standard easting
-
-    // now the northing (from the equator)
-    double y = k0 * (M - M0 + N * tan(phi) * (A * A * (1.0 / 2.0 + A * A * ((5.0 - T + 9.0 * C + 4.0 * C * C) / 24.0 + A * A * (61.0 - 58.0 * T + T * T + 600.0 * C - 330.0 * e0sq) / 720.0))));
-    if (y < 0)
-    {
-        y = 10000000.0 + y; // add in false northing if south of the equator
-    }
-    double easting  = x;
-    double northing = y;
-
-    Xy coords;
-    coords.x = easting;
-    coords.y = northing;
-
-    return coords;
-}
-
-
+    double a;       // equatorial radius in meters
+    double e0sq;
+    double esq;
+    double k0;
+    double drad;
+    double m1, m2, m4, m6; // meridian arc series coefficients (USGS style)
+
+    UtmConstants()
+    {
+        // WGS 84 datum
+        double eqRad = 6378137.0;
+        double flat = 298.2572236;
+
+        a = eqRad;
+        double f = 1.0 / flat;          // polar flattening
+        double b = a * (1.0 - f);       // polar radius
+        double e = sqrt(1.0 - (b * b) / (a * a)); // eccentricity
+        k0 = 0.9996;
+        drad = M_PI / 180.0;
+        esq = (1.0 - (b / a) * (b / a));
+        e0sq = e * e / (1.0 - e * e);
+
+        m1 = 1.0 - esq * (1.0 / 4.0 + esq * (3.0 / 64.0 + 5.0 * esq / 256.0));
+        m2 = esq * (3.0 / 8.0 + esq * (3.0 / 32.0 + 45.0 * esq / 1024.0));
+        m4 = esq * esq * (15.0 / 256.0 + esq * 45.0 / 1024.0);
+        m6 = esq * esq * esq * (35.0 / 3072.0);
+    }
+};
 
 /**
- * @brief parseTime
- * @param timestamp in Epoch
- * @return std_msgs::Header with input timpestamp converted from file input
+ * @brief latlon2xy_batch converts a whole set of fixes to UTM in a single pass
+ * @param lat latitudes  [deg]
+ * @param lon longitudes [deg]
+ * @param x output eastings  [m]
+ * @param y output northings [m]
  *
- * Epoch time conversion
- * http://www.epochconverter.com/programming/functions-c.php
+ * The datum constants are computed once and the central meridian is taken
+ * from the first fix, so a drive crossing a zone border stays continuous.
+ * Only one sin/cos pair is evaluated per fix, the multiple angles of the
+ * meridian arc come from the double-angle identities.
  */
-std_msgs::Header parseTime(string timestamp)
+void latlon2xy_batch(const vector<double> &lat, const vector<double> &lon, vector<double> &x, vector<double> &y)
 {
+    static const UtmConstants c;
 
-    std_msgs::Header header;
-
-    // example: 2011-09-26 13:21:35.134391552
-    //          01234567891111111111222222222
-    //                    0123456789012345678
-    struct tm t = {0};  // Initalize to all 0's
-    t.tm_year = boost::lexical_cast<int>(timestamp.substr(0, 4)) - 1900;
-    t.tm_mon  = boost::lexical_cast<int>(timestamp.substr(5, 2)) - 1;
-    t.tm_mday = boost::lexical_cast<int>(timestamp.substr(8, 2));
-    t.tm_hour = boost::lexical_cast<int>(timestamp.substr(11, 2));
-    t.tm_min  = boost::lexical_cast<int>(timestamp.substr(14, 2));
-    t.tm_sec  = boost::lexical_cast<int>(timestamp.substr(17, 2));
-    t.tm_isdst = -1;
-    time_t timeSinceEpoch = mktime(&t);
-
-    header.stamp.sec  = timeSinceEpoch;
-    header.stamp.nsec = boost::lexical_cast<int>(timestamp.substr(20, 8));
-
-    return header;
-}
+    const size_t n = lat.size();
+    x.resize(n);
+    y.resize(n);
+    if (n == 0)
+        return;
 
+    double utmz = 1.0 + floor((lon[0] + 180.0) / 6.0); // longitude to utm zone
+    double zcm = 3.0 + 6.0 * (utmz - 1.0) - 180.0;      // central meridian of the zone
 
-/**
+    for (size_t i = 0; i < n; i++)
+    {
+        double phi  = lat[i] * c.drad;
+        double sphi = sin(phi);
+        double cphi = cos(phi);
+        double tphi = sphi / cphi;
+
+        double N = c.a / sqrt(1.0 - c.esq * sphi * sphi);
+        double T = tphi * tphi;
+        double C = c.e0sq * cphi * cphi;
+        double A = (lon[i] - zcm) * c.drad * cphi;
+
+        double s2 = 2.0 * sphi * cphi;              // sin(2 phi)
+        double c2 = 1.0 - 2.0 * sphi * sphi;        // cos(2 phi)
+        double s4 = 2.0 * s2 * c2;                  // sin(4 phi)
+        double s6 = s4 * c2 + (2.0 * c2 * c2 - 1.0) * s2; // sin(6 phi)
+
+        double M = c.a * (phi * c.m1 - s2 * c.m2 + s4 * c.m4 - s6 * c.m6); // Arc length along standard meridian
+
+        double A2 = A * A;
+        x[i] = c.k0 * N * A * (1.0 + A2 * ((1.0 - T + C) / 6.0 + A2 * (5.0 - 18.0 * T + T * T + 72.0 * C - 58.0 * c.e0sq) / 120.0)) + 500000.0;
+        y[i] = c.k0 * (M + N * tphi * (A2 * (1.0 / 2.0 + A2 * ((5.0 - T + 9.0 * C + 4.0 * C * C) / 24.0 + A2 * (61.0 - 58.0 * T + T * T + 600.0 * C - 330.0 * c.e0sq) / 720.0))));
+        if (y[i] < 0)
+            y[i] = 10000000.0 + y[i]; // add in false northing if south of the equator
+    }
+}
+
+/**
+ * @brief The OxtsTrajectory struct holds the whole OXTS drive, one entry per frame
+ *
+ * Loaded once at startup; x/y are the UTM coordinates of each fix, pose the
+ * local metric pose of base_link wrt the first frame (world).
+ */
+struct OxtsTrajectory
+{
+    vector<double> lat, lon, alt;
+    vector<double> roll, pitch, yaw;
+    vector<double> x, y;
+    vector<tf::Transform> pose;
+
+    size_t size() const { return pose.size(); }
+};
+
+/**
+ * @brief loadOxtsTrajectory reads every oxts file of the drive and converts it to local poses
+ * @param dir_oxts oxts data directory
+ * @param entries number of frames to load
+ * @param trajectory output table
+ * @return 1 if all the files are correctly read, 0 otherwise
+ */
+int loadOxtsTrajectory(string dir_oxts, unsigned int entries, OxtsTrajectory &trajectory)
+{
+    trajectory = OxtsTrajectory();
+    kitti_player::OxtsPacket oxts;
+
+    for (unsigned int i = 0; i < entries; i++)
+    {
+        string filename = kitti_player::frameFilename(dir_oxts, i, ".txt");
+        if (!kitti_player::loadOxtsPacket(filename, oxts))
+        {
+            ROS_ERROR_STREAM("Fail to read " << filename);
+            return 0;
+        }
+
+        trajectory.lat.push_back  (oxts.lat);
+        trajectory.lon.push_back  (oxts.lon);
+        trajectory.alt.push_back  (oxts.alt);
+        trajectory.roll.push_back (oxts.roll);
+        trajectory.pitch.push_back(oxts.pitch);
+        trajectory.yaw.push_back  (oxts.yaw);
+    }
+
+    latlon2xy_batch(trajectory.lat, trajectory.lon, trajectory.x, trajectory.y);
+
+    trajectory.pose.resize(entries);
+    for (unsigned int i = 0; i < entries; i++)
+    {
+        // yaw: 0 = east, positive = counter clockwise; UTM x = east, y = north
+        trajectory.pose[i].setOrigin(tf::Vector3(trajectory.x[i]   - trajectory.x[0],
+                                                 trajectory.y[i]   - trajectory.y[0],
+                                                 trajectory.alt[i] - trajectory.alt[0]));
+        trajectory.pose[i].setRotation(tf::createQuaternionFromRPY(trajectory.roll[i], trajectory.pitch[i], trajectory.yaw[i]));
+    }
+
+    return 1;
+}
+
+/**
+ * @brief loadOdometryTrajectory reads the ground truth poses of an odometry sequence
+ * @param filename poses/XX.txt
+ * @param calibration calib.txt of the sequence
+ * @param entries number of frames played
+ * @param trajectory output table, pose only
+ * @return 1 if the file holds a pose per frame, 0 otherwise
+ *
+ * The poses are the image_0 ones wrt its frame 0; base_link is the velodyne,
+ * and world its frame 0: pose = Tr^-1 * P_i * Tr.
+ */
+int loadOdometryTrajectory(const string &filename, const kitti_player::OdometryCalibration &calibration, unsigned int entries, OxtsTrajectory &trajectory)
+{
+    trajectory = OxtsTrajectory();
+    vector<double> poses;
+    if (!kitti_player::loadOdometryPoses(filename, poses) || poses.size() / 12 < entries)
+        return 0;
+
+    const double *m = calibration.Tr;
+    tf::Transform velo_to_cam(tf::Matrix3x3(m[0], m[1], m[2], m[4], m[5], m[6], m[8], m[9], m[10]), tf::Vector3(m[3], m[7], m[11]));
+    tf::Transform cam_to_velo = velo_to_cam.inverse();
+
+    trajectory.pose.resize(entries);
+    for (unsigned int i = 0; i < entries; i++)
+    {
+        const double *p = &poses[12 * i];
+        tf::Transform camera(tf::Matrix3x3(p[0], p[1], p[2], p[4], p[5], p[6], p[8], p[9], p[10]), tf::Vector3(p[3], p[7], p[11]));
+        trajectory.pose[i] = cam_to_velo * camera * velo_to_cam;
+    }
+    return 1;
+}
+
+/**
+ * @brief The GpsTrail class keeps the GPS/RTK markers shown in RVIZ, refs #522
+ *
+ * Each new fix is published alone, together with the DELETE of the marker that
+ * falls out of the trail (if gpsTrailLength is set), so the per-frame cost does
+ * not grow with the drive length. Subscribers connecting later receive the
+ * whole trail once, from the connection callback.
+ */
+class GpsTrail
+{
+public:
+    GpsTrail(const string &frame_id, unsigned int max_length, double min_spacing)
+        : frame_id_(frame_id), max_length_(max_length), min_spacing_(min_spacing), next_id_(1)
+    {
+    }
+
+    /**
+     * @brief add a new fix to the trail and publish the incremental update
+     * @param x,y UTM coordinates of the fix
+     * @param stamp timestamp of the marker
+     * @param pub the GT_RTK publisher
+     */
+    void add(double x, double y, const ros::Time &stamp, const ros::Publisher &pub)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        if (!markers_.empty() && min_spacing_ > 0.0)
+        {
+            const geometry_msgs::Point &last = markers_.back().pose.position;
+            if (hypot(x - last.x, y - last.y) < min_spacing_)
+                return;
+        }
+
+        visualization_msgs::MarkerArray update;
+
+        visualization_msgs::Marker RTK_MARKER;
+        RTK_MARKER.header.frame_id = frame_id_;
+        RTK_MARKER.header.stamp = stamp;
+        RTK_MARKER.ns = "RTK_MARKER";
+        RTK_MARKER.id = next_id_++;
+        RTK_MARKER.type = visualization_msgs::Marker::CYLINDER;
+        RTK_MARKER.action = visualization_msgs::Marker::ADD;
+        RTK_MARKER.pose.orientation.w = 1;
+        RTK_MARKER.scale.x = 0.5;
+        RTK_MARKER.scale.y = 0.5;
+        RTK_MARKER.scale.z = 3.5;
+        RTK_MARKER.color.a = 0.80;
+        RTK_MARKER.color.r = 0;
+        RTK_MARKER.color.g = 0.0;
+        RTK_MARKER.color.b = 1.0;
+        RTK_MARKER.pose.position.x = x;
+        RTK_MARKER.pose.position.y = y;
+        RTK_MARKER.pose.position.z = 0;
+
+        ROS_DEBUG_STREAM(RTK_MARKER.pose.position.x << "\t" << RTK_MARKER.pose.position.y);
+
+        markers_.push_back(RTK_MARKER);
+        update.markers.push_back(RTK_MARKER);
+
+        if (max_length_ > 0 && markers_.size() > max_length_)
+        {
+            visualization_msgs::Marker expired = markers_.front();
+            expired.header.stamp = stamp;
+            expired.action = visualization_msgs::Marker::DELETE;
+            update.markers.push_back(expired);
+            markers_.pop_front();
+        }
+
+        pub.publish(update);
+    }
+
+    /**
+     * @brief sendSnapshot publishes the whole trail to a newly connected subscriber
+     * @param pub the publisher bound to the single subscriber
+     */
+    void sendSnapshot(const ros::SingleSubscriberPublisher &pub) const
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        if (markers_.empty())
+            return;
+
+        visualization_msgs::MarkerArray snapshot;
+        snapshot.markers.assign(markers_.begin(), markers_.end());
+        pub.publish(snapshot);
+    }
+
+private:
+    string          frame_id_;
+    unsigned int    max_length_;
+    double          min_spacing_;
+    int             next_id_;
+    deque<visualization_msgs::Marker> markers_;
+    mutable boost::mutex mutex_;    // the snapshot is sent from the spinner
+};
+
+/**
+ * @brief The TrackletPublisher class publishes the labelled boxes of every frame
+ *
+ * tracklet_labels.xml is parsed once at startup into a table indexed by
+ * frame: publishing a frame only walks its range of boxes. The boxes go out as
+ * a kitti_player/TrackletBoxArray and, for RVIZ, as one CUBE marker per box
+ * (its id is the tracklet index, so that RVIZ follows the objects) after a
+ * DELETEALL of the objects of the previous frame.
+ */
+class TrackletPublisher
+{
+public:
+    TrackletPublisher() {}
+
+    /**
+     * @brief open parses the labels and advertises tracklets and tracklets/markers
+     * @param node node handle
+     * @param filename tracklet_labels.xml
+     * @return 1 if the labels are loaded, 0 otherwise
+     */
+    int open(ros::NodeHandle &node, const string &filename)
+    {
+        if (!tracklets_.load(filename))
+            return 0;
+        box_pub_ = node.advertise<kitti_player::TrackletBoxArray>("tracklets", 1);
+        marker_pub_ = node.advertise<visualization_msgs::MarkerArray>("tracklets/markers", 1);
+        return 1;
+    }
+
+    const kitti_player::Tracklets &tracklets() const
+    {
+        return tracklets_;
+    }
+
+    /**
+     * @brief publish the boxes of a frame, if anyone listens
+     * @param frame frame number
+     * @param header stamp and frame of the hdl64e scan of the same frame
+     */
+    void publish(unsigned int frame, const std_msgs::Header &header)
+    {
+        // colors of the object types, as kitti_player::ObjectType
+        static const float colors[kitti_player::OBJECT_TYPES][3] =
+        {
+            { 0.0f, 0.6f, 1.0f }, { 0.0f, 1.0f, 0.6f }, { 0.6f, 0.4f, 1.0f }, { 1.0f, 0.2f, 0.2f },
+            { 1.0f, 0.6f, 0.2f }, { 1.0f, 1.0f, 0.0f }, { 0.8f, 0.0f, 0.8f }, { 0.6f, 0.6f, 0.6f }
+        };
+
+        const kitti_player::TrackletPose *begin = tracklets_.begin(frame);
+        const kitti_player::TrackletPose *end = tracklets_.end(frame);
+
+        if (box_pub_.getNumSubscribers() > 0)
+        {
+            // reused: the vector keeps its capacity frame after frame
+            boxes_.header = header;
+            boxes_.boxes.resize(end - begin);
+            for (const kitti_player::TrackletPose *pose = begin; pose != end; ++pose)
+            {
+                kitti_player::TrackletBox &box = boxes_.boxes[pose - begin];
+                box.id = pose->id;
+                box.type = pose->type;
+                box.x = pose->t[0];
+                box.y = pose->t[1];
+                box.z = pose->t[2];
+                box.roll = pose->r[0];
+                box.pitch = pose->r[1];
+                box.yaw = pose->r[2];
+                box.height = pose->h;
+                box.width = pose->w;
+                box.length = pose->l;
+                box.occlusion = pose->occlusion;
+                box.truncation = pose->truncation;
+            }
+            box_pub_.publish(boxes_);
+        }
+
+        if (marker_pub_.getNumSubscribers() > 0)
+        {
+            markers_.markers.resize(1 + (end - begin));
+            visualization_msgs::Marker &clear = markers_.markers[0];
+            clear.header = header;
+            clear.ns = "tracklets";
+            clear.action = visualization_msgs::Marker::DELETEALL;
+
+            for (const kitti_player::TrackletPose *pose = begin; pose != end; ++pose)
+            {
+                visualization_msgs::Marker &marker = markers_.markers[1 + (pose - begin)];
+                marker.header = header;
+                marker.ns = "tracklets";
+                marker.id = pose->id;
+                marker.type = visualization_msgs::Marker::CUBE;
+                marker.action = visualization_msgs::Marker::ADD;
+                // the labels rotate the boxes around z only: the center is h/2 above the bottom face
+                marker.pose.position.x = pose->t[0];
+                marker.pose.position.y = pose->t[1];
+                marker.pose.position.z = pose->t[2] + 0.5 * pose->h;
+                tf::quaternionTFToMsg(tf::createQuaternionFromRPY(pose->r[0], pose->r[1], pose->r[2]), marker.pose.orientation);
+                marker.scale.x = pose->l;
+                marker.scale.y = pose->w;
+                marker.scale.z = pose->h;
+                marker.color.r = colors[pose->type][0];
+                marker.color.g = colors[pose->type][1];
+                marker.color.b = colors[pose->type][2];
+                marker.color.a = 0.5;
+            }
+            marker_pub_.publish(markers_);
+        }
+    }
+
+private:
+    kitti_player::Tracklets             tracklets_;
+    ros::Publisher                      box_pub_;
+    ros::Publisher                      marker_pub_;
+    kitti_player::TrackletBoxArray      boxes_;
+    visualization_msgs::MarkerArray     markers_;
+};
+
+
+
+/**
+ * @brief loadTimestamps reads a whole timestamps.txt file
+ * @param filename the timestamps file
+ * @param timestamps output table, one entry per frame
+ * @return 1 if file is correctly readed, 0 otherwise
+ */
+int loadTimestamps(string filename, vector<ros::Time> &timestamps)
+{
+    vector<kitti_player::Timestamp> stamps;
+    if (!kitti_player::loadTimestamps(filename, stamps))
+    {
+        ROS_ERROR_STREAM("Fail to open " << filename);
+        return 0;
+    }
+
+    timestamps.resize(stamps.size());
+    for (size_t i = 0; i < stamps.size(); i++)
+        timestamps[i] = ros::Time(stamps[i].sec, stamps[i].nsec);
+
+    ROS_DEBUG_STREAM("Read " << timestamps.size() << " timestamps from " << filename);
+    return 1;
+}
+
+/// A stream job reads and publishes one frame of a stream; false on errors
+typedef boost::function<bool (unsigned int frame, const ros::Time &now)> StreamJob;
+
+/**
+ * @brief The PlaybackClock class maps dataset time onto wall time
+ *
+ * Shared by all the stream threads of an unsynced drive, so that every stream
+ * is played at its own native rate, scaled by speed.
+ */
+class PlaybackClock
+{
+public:
+    PlaybackClock(const ros::Time &start, double speed)
+        : wall_start_(ros::WallTime::now()), start_(start), speed_(speed), paused_(false)
+    {
+    }
+
+    /**
+     * @brief sleepUntil
+     * @param t dataset time
+     * @return false if ROS is shutting down before t is due
+     */
+    bool sleepUntil(const ros::Time &t) const
+    {
+        while (ros::ok())
+        {
+            ros::WallDuration left(0.1);
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                if (!paused_)
+                {
+                    double dataset_left = (t - nowLocked()).toSec();
+                    if (dataset_left <= 0.0)
+                        return true;
+                    left = ros::WallDuration(dataset_left / speed_);
+                }
+            }
+            (left < ros::WallDuration(0.1) ? left : ros::WallDuration(0.1)).sleep();
+        }
+        return false;
+    }
+
+    /// current dataset time
+    ros::Time now() const
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        return nowLocked();
+    }
+
+    /// changes the speed from now on
+    void setSpeed(double speed)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        rebase(nowLocked());
+        speed_ = speed;
+    }
+
+    /// stops or restarts the dataset time
+    void setPaused(bool paused)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        rebase(nowLocked());
+        paused_ = paused;
+    }
+
+    /// moves a paused clock forward
+    void step(const ros::Duration &d)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        rebase(nowLocked() + d);
+    }
+
+private:
+    ros::Time nowLocked() const
+    {
+        if (paused_)
+            return start_;
+        return start_ + ros::Duration((ros::WallTime::now() - wall_start_).toSec() * speed_);
+    }
+
+    void rebase(const ros::Time &t)
+    {
+        wall_start_ = ros::WallTime::now();
+        start_ = t;
+    }
+
+    mutable boost::mutex mutex_;
+    ros::WallTime   wall_start_;
+    ros::Time       start_;
+    double          speed_;
+    bool            paused_;
+};
+
+/**
+ * @brief The ClockPublisher class owns the simulated time published on /clock
+ *
+ * Synced drives advance it frame by frame: advanceTo waits the time between
+ * two frames, scaled by speed, publishing intermediate ticks at 100Hz (wall)
+ * so that timers of the use_sim_time nodes keep running. Pacing is on wall
+ * time, the player never waits on the clock it publishes.
+ */
+class ClockPublisher
+{
+public:
+    ClockPublisher(ros::NodeHandle &node, double speed)
+        : pub_(node.advertise<rosgraph_msgs::Clock>("/clock", 1)), speed_(speed), started_(false)
+    {
+    }
+
+    /// publishes /clock = t
+    void publish(const ros::Time &t)
+    {
+        rosgraph_msgs::Clock msg;
+        msg.clock = t;
+        pub_.publish(msg);
+        current_ = t;
+        started_ = true;
+    }
+
+    /**
+     * @brief advanceTo moves the clock forward to t
+     * @param t simulated time of the next frame
+     * @return false if ROS is shutting down
+     */
+    bool advanceTo(const ros::Time &t)
+    {
+        if (!started_ || speed_ <= 0.0 || !(t > current_))
+        {
+            publish(t);
+            return ros::ok();
+        }
+
+        const ros::Time from = current_;
+        const ros::WallTime wall_from = ros::WallTime::now();
+        const ros::WallDuration tick(0.01);
+        while (ros::ok())
+        {
+            double elapsed = (ros::WallTime::now() - wall_from).toSec() * speed_;
+            if (elapsed >= (t - from).toSec())
+                break;
+            publish(from + ros::Duration(elapsed));
+            tick.sleep();
+        }
+        publish(t);
+        return ros::ok();
+    }
+
+private:
+    ros::Publisher  pub_;
+    double          speed_;
+    bool            started_;
+    ros::Time       current_;
+};
+
+/// One stream of an unsynced drive: its own timestamps, frame count and job
+struct PlaybackStream
+{
+    PlaybackStream() : timestamps(NULL), entries(0), cpu(-1), priority(0), ok(true) {}
+
+    string                      name;
+    const vector<ros::Time>    *timestamps;
+    unsigned int                entries;
+    StreamJob                   job;
+    int                         cpu;        // core of the stream thread, -1 = any
+    int                         priority;   // SCHED_FIFO priority, 0 = default scheduler
+    bool                        ok;         // false if the stream stopped on an error
+};
+
+/**
+ * @brief preferCache switches a stream to the files transcoded by kitti_transcode, when complete
+ * @param dir data directory of the stream, replaced by the cache directory
+ * @param extension file extension of the stream, replaced by the cache one
+ * @param cache_dir cache directory, e.g. image_02/data_kqi/
+ * @param cache_extension e.g. ".kqi"
+ * @return 1 if the stream reads the cache, 0 otherwise
+ */
+int preferCache(string &dir, string &extension, const string &cache_dir, const char *cache_extension)
+{
+    unsigned int files = kitti_player::countFiles(dir);
+    if (files == 0 || kitti_player::countFiles(cache_dir) < files)
+        return 0;
+
+    ROS_INFO_STREAM("Reading the transcoded files of " << dir << " from " << cache_dir);
+    dir = cache_dir;
+    extension = cache_extension;
+    return 1;
+}
+
+/**
+ * @brief parseCpuList
+ * @param list comma separated cores, e.g. "2,3,4"
+ * @param cpus output cores, empty if list is empty
+ * @return 1 if list is valid, 0 otherwise
+ */
+int parseCpuList(const string &list, vector<int> &cpus)
+{
+    cpus.clear();
+    if (list.empty())
+        return 1;
+
+    vector<string> items;
+    boost::split(items, list, boost::is_any_of(","));
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        boost::trim(items[i]);
+        char *end = NULL;
+        long cpu = strtol(items[i].c_str(), &end, 10);
+        if (items[i].empty() || *end != '\0' || cpu < 0 || cpu >= CPU_SETSIZE)
+            return 0;
+        cpus.push_back(cpu);
+    }
+    return 1;
+}
+
+/**
+ * @brief tuneThread applies affinity and real-time scheduling to the calling thread
+ * @param name stream name, for the log
+ * @param cpu core [-1: any core]
+ * @param priority SCHED_FIFO priority [0: default scheduler]
+ *
+ * Failures only warn: without privileges the thread keeps the default scheduler.
+ */
+void tuneThread(const string &name, int cpu, int priority)
+{
+    int error = setThreadAffinity(cpu);
+    if (error)
+        ROS_WARN_STREAM("Cannot pin the " << name << " thread to core " << cpu << ": " << strerror(error));
+
+    error = setThreadRealtime(priority);
+    if (error == EPERM)
+        ROS_WARN_STREAM("No permission for SCHED_FIFO on the " << name << " thread (needs CAP_SYS_NICE or an rtprio limit), using the default scheduler");
+    else if (error)
+        ROS_WARN_STREAM("Cannot set SCHED_FIFO priority " << priority << " on the " << name << " thread: " << strerror(error));
+
+    ROS_DEBUG_STREAM("Stream thread " << name << " on core " << cpu << ", priority " << priority);
+}
+
+/**
+ * @brief playStream plays one stream of an unsynced drive, run on its own thread
+ * @param stream the stream to play
+ * @param clock the playback clock shared by all the streams
+ * @param start dataset time of the first frame to play
+ * @param finished incremented when the stream is over
+ */
+void playStream(PlaybackStream &stream, const PlaybackClock &clock, ros::Time start, std::atomic<unsigned int> *finished)
+{
+    tuneThread(stream.name, stream.cpu, stream.priority);
+
+    const vector<ros::Time> &timestamps = *stream.timestamps;
+    unsigned int frame = lower_bound(timestamps.begin(), timestamps.begin() + stream.entries, start) - timestamps.begin();
+
+    ROS_INFO_STREAM("Playing " << stream.name << " from frame " << frame << " of " << stream.entries);
+    for (; frame < stream.entries; frame++)
+    {
+        if (!clock.sleepUntil(timestamps[frame]))
+            break;
+        if (!stream.job(frame, ros::Time::now()))
+        {
+            stream.ok = false;
+            break;
+        }
+    }
+    (*finished)++;
+}
+
+
+/**
  * @brief main Kitti_player, a player for KITTI raw datasets
  * @param argc
  * @param argv
@@ -467,7 +1727,7 @@ int main(int argc, char **argv)
     desc.add_options()
     ("help,h"                                                                                                    ,  "help message")
     ("directory ,d",  po::value<string>       (&options.path)->required()                                        ,  "*required* - path to the kitti dataset Directory")
-    ("frequency ,f",  po::value<float>        (&options.frequency)        ->default_value(1.0)                     ,  "set replay Frequency")
+    ("frequency ,f",  po::value<float>        (&options.frequency)        ->default_value(1.0)                     ,  "set replay Frequency [0: unlimited]")
     ("all       ,a",  po::value<bool>         (&options.all_data)         ->default_value(0) ->implicit_value(1)   ,  "replay All data")
     ("velodyne  ,v",  po::value<bool>         (&options.velodyne)         ->default_value(0) ->implicit_value(1)   ,  "replay Velodyne data")
     ("gps       ,g",  po::value<bool>         (&options.gps)              ->default_value(0) ->implicit_value(1)   ,  "replay Gps data")
@@ -478,9 +1738,43 @@ int main(int argc, char **argv)
     ("timestamps,T",  po::value<bool>         (&options.timestamps)       ->default_value(0) ->implicit_value(1)   ,  "use KITTI timestamps")
     ("stereoDisp,s",  po::value<bool>         (&options.stereoDisp)       ->default_value(0) ->implicit_value(1)   ,  "use pre-calculated disparities")
     ("viewDisp  ,D ", po::value<bool>         (&options.viewDisparities)  ->default_value(0) ->implicit_value(1)   ,  "view loaded disparity images")
+    ("computeDisp",   po::value<bool>         (&options.computeDisp)      ->default_value(0) ->implicit_value(1)   ,  "compute the disparities missing from disparities/ out of image_00/image_01 (SGBM), and write them there for the next runs (implies -s)")
     ("frame     ,F",  po::value<unsigned int> (&options.startFrame)       ->default_value(0) ->implicit_value(0)   ,  "start playing at frame...")
     ("gpsPoints ,p",  po::value<string>       (&options.gpsReferenceFrame)->default_value("")                      ,  "publish GPS/RTK markers to RVIZ, having reference frame as <reference_frame> [example: -p map]")
     ("synchMode ,S",  po::value<bool>         (&options.synchMode)        ->default_value(0) ->implicit_value(1)   ,  "Enable Synch mode (wait for signal to load next frame [std_msgs/Bool data: true]")
+    ("transform ,t",  po::value<bool>         (&options.sendTransform)    ->default_value(0) ->implicit_value(1)   ,  "publish world->base_link TF, oxts/pose and oxts/path from the OXTS trajectory")
+    ("unsynced  ,u",  po::value<bool>         (&options.unsynced)         ->default_value(0) ->implicit_value(1)   ,  "play an unsynced (extract) drive, every stream at its native rate on its own thread [-f 10: real time]")
+    ("deskew",        po::value<bool>         (&options.deskew)           ->default_value(0) ->implicit_value(1)   ,  "remove the ego-motion distortion from the velodyne scans, using the OXTS velocities")
+    ("compactCloud",  po::value<float>        (&options.compactError)     ->default_value(0.0)                     ,  "publish hdl64e_compact, int16 coordinates within <arg> meters and uint8 reflectance [0: disabled]")
+    ("pyramid",       po::value<unsigned int> (&options.pyramidLevels)    ->default_value(0)                       ,  "publish <arg> reduced levels (1/2, 1/4, ...) of each camera under <camera>/level<N>/ [0: disabled]")
+    ("cropMinRange",  po::value<float>        (&options.cropMinRange)     ->default_value(0.0)                     ,  "publish hdl64e_cropped, the velodyne points farther than <arg> meters [0: no limit]")
+    ("cropMaxRange",  po::value<float>        (&options.cropMaxRange)     ->default_value(0.0)                     ,  "publish hdl64e_cropped, the velodyne points within <arg> meters [0: no limit]")
+    ("cropFrustum",   po::value<bool>         (&options.cropFrustum)      ->default_value(0) ->implicit_value(1)   ,  "publish hdl64e_cropped, the velodyne points in the field of view of image_02 (with the range limits, if any)")
+    ("voxelLeaf",     po::value<float>        (&options.voxelLeaf)        ->default_value(0.0)                     ,  "publish hdl64e_voxel, the velodyne scans downsampled on a grid of <arg> meters voxels: centroid and mean intensity [0: disabled]")
+    ("rangeImage",    po::value<unsigned int> (&options.rangeImageCols)   ->default_value(0)                       ,  "publish hdl64e_range, the velodyne scans projected on a 64 x <arg> range and reflectance image [32FC2] [0: disabled, example: --rangeImage 1024]")
+    ("clock",         po::value<bool>         (&options.clock)            ->default_value(0) ->implicit_value(1)   ,  "publish /clock from the KITTI timestamps, for nodes with use_sim_time (implies -T)")
+    ("clockSpeed",    po::value<float>        (&options.clockSpeed)       ->default_value(1.0)                     ,  "with --clock, simulated time speed wrt real time [0: as fast as possible, or as -S synch allows]")
+    ("adaptive",      po::value<bool>         (&options.adaptive)         ->default_value(0) ->implicit_value(1)   ,  "adapt the replay frequency to the consumers, that echo the processed headers on /kitti_player/ack [std_msgs/Header]")
+    ("minRate",       po::value<float>        (&options.minRate)          ->default_value(0.5)                     ,  "with --adaptive, min replay frequency")
+    ("maxRate",       po::value<float>        (&options.maxRate)          ->default_value(100.0)                   ,  "with --adaptive, max replay frequency")
+    ("targetLag",     po::value<unsigned int> (&options.targetLag)        ->default_value(1)                       ,  "with --adaptive, frames published and not acked yet [1: no drops with queue size 1]")
+    ("shm",           po::value<bool>         (&options.shm)              ->default_value(0) ->implicit_value(1)   ,  "also publish images and velodyne scans through shared memory rings, described on <topic>/shm [kitti_player/ShmDescriptor]")
+    ("shmSlots",      po::value<unsigned int> (&options.shmSlots)         ->default_value(8)                       ,  "with --shm, slots per ring (frames that readers can hold)")
+    ("shmSlotSize",   po::value<float>        (&options.shmSlotSize)      ->default_value(4.0)                     ,  "with --shm, MB per slot")
+    ("streamThreads", po::value<bool>         (&options.streamThreads)    ->default_value(1) ->implicit_value(1)   ,  "publish every stream of a frame from its own thread, all of them waiting for the slowest before the next frame")
+    ("cpuAffinity",   po::value<string>       (&options.cpuAffinity)      ->default_value("")                      ,  "pin the stream threads to these cores, in turn [example: --cpuAffinity 2,3,4]")
+    ("realtime",      po::value<unsigned int> (&options.realtime)         ->default_value(0)                       ,  "run the stream threads with SCHED_FIFO <arg> priority (1-99), if allowed [0: default scheduler]")
+    ("noCache",       po::value<bool>         (&options.noCache)          ->default_value(0) ->implicit_value(1)   ,  "ignore the files transcoded by kitti_transcode (image_0x/data_kqi, velodyne_points/data_kvc), read the raw ones")
+    ("frameCache",    po::value<unsigned int> (&options.frameCache)       ->default_value(0)                       ,  "share the decoded frames with the other players of the user on the host through a <arg> MB shared memory cache, created by the first one [0: disabled]")
+    ("frameCacheName",po::value<string>       (&options.frameCacheName)   ->default_value("/kitti_player.frame_cache") ,  "with --frameCache, shared memory segment of the cache")
+    ("profile",       po::value<bool>         (&options.profile)          ->default_value(0) ->implicit_value(1)   ,  "play headless at unlimited rate, then report frames/s and the time per frame of every stream")
+    ("baseline",      po::value<string>       (&options.baseline)         ->default_value("")                      ,  "with --profile, compare with the results of the same streams in <arg>; exit with an error on regression or if they are missing")
+    ("recordBaseline",po::value<bool>         (&options.recordBaseline)   ->default_value(0) ->implicit_value(1)   ,  "with --baseline, record the results of streams missing from the file instead of failing")
+    ("tolerance",     po::value<float>        (&options.tolerance)        ->default_value(0.2)                     ,  "with --baseline, relative loss accepted [0.2: frames/s down to 80%, stream times up to 120%]")
+    ("tracklets",     po::value<bool>         (&options.tracklets)        ->default_value(0) ->implicit_value(1)   ,  "publish the tracklet_labels.xml boxes of every frame on tracklets [kitti_player/TrackletBoxArray] and tracklets/markers, stamped as hdl64e")
+    ("sequence",      po::value<int>          (&options.sequence)         ->default_value(-1)                      ,  "play sequence <arg> of the odometry benchmark in -d (sequences/<arg>/, poses/<arg>.txt); -t publishes the ground truth on groundtruth/pose and groundtruth/path [-1: -d is a raw drive]")
+    ("gpsTrailLength",  po::value<unsigned int> (&options.gpsTrailLength)   ->default_value(0)                   ,  "max number of GPS/RTK markers kept in RVIZ, older ones are deleted [0: unlimited]")
+    ("gpsTrailSpacing", po::value<float>      (&options.gpsTrailSpacing)  ->default_value(0.0)                   ,  "min distance in meters between two GPS/RTK markers [0: one marker per frame]")
     ;
 
     try // parse options
@@ -524,6 +1818,13 @@ int main(int argc, char **argv)
         cout << "    │   └── data              " << endl;
         cout << "    │     └ timestamps.txt    " << endl;
         cout << "    └── calib_cam_to_cam.txt  " << endl << endl;
+        cout << "or, with --sequence 00, an odometry benchmark tree:" << endl;
+        cout << "├── sequences/00             " << endl;
+        cout << "│   ├── image_0 ... image_3  " << endl;
+        cout << "│   ├── velodyne             " << endl;
+        cout << "│   ├── calib.txt            " << endl;
+        cout << "│   └── times.txt            " << endl;
+        cout << "└── poses/00.txt             " << endl << endl;
 
         ROS_WARN_STREAM("Parse error, shutting down node\n");
         return -1;
@@ -531,7 +1832,7 @@ int main(int argc, char **argv)
 
     ros::init(argc, argv, "kitti_player");
     ros::NodeHandle node("kitti_player");
-    ros::Rate loop_rate(options.frequency);
+    ros::Rate loop_rate(options.frequency > 0.0 ? options.frequency : 1.0);
 
     /// This sets the logger level; use this to disable all ROS prints
     if ( ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Info) )
@@ -539,11 +1840,8 @@ int main(int argc, char **argv)
     else
         std::cout << "Error while setting the logger level!" << std::endl;
 
-    DIR *dir;
-    struct dirent *ent;
     unsigned int total_entries = 0;        //number of elements to be played
     unsigned int entries_played  = 0;      //number of elements played until now
-    unsigned int len = 0;                  //counting elements support variable
     string dir_root             ;
     string dir_image00          ;
     string full_filename_image00;
@@ -559,22 +1857,17 @@ int main(int argc, char **argv)
     string dir_timestamp_image03;
     string dir_image04          ;
     string full_filename_image04;
-    string dir_Disparities    ;
-    string full_filename_Disparities;
     string dir_oxts             ;
     string full_filename_oxts;
     string dir_timestamp_oxts;
     string dir_velodyne_points  ;
     string full_filename_velodyne;
     string dir_timestamp_velodyne; //average of start&end (time of scan)
-    string str_support;
     cv::Mat cv_image00;
     cv::Mat cv_image01;
     cv::Mat cv_image02;
     cv::Mat cv_image03;
     cv::Mat cv_image04;
-    cv::Mat cv_disparities;
-    std_msgs::Header header_support;
 
     image_transport::ImageTransport it(node);
     image_transport::CameraPublisher pub00 = it.advertiseCamera("grayscale/left/image_rect", 1);
@@ -582,10 +1875,37 @@ int main(int argc, char **argv)
     image_transport::CameraPublisher pub02 = it.advertiseCamera("color/left/image_rect", 1);
     image_transport::CameraPublisher pub03 = it.advertiseCamera("color/right/image_rect", 1);
 
-    sensor_msgs::Image ros_msg00;
-    sensor_msgs::Image ros_msg01;
-    sensor_msgs::Image ros_msg02;
-    sensor_msgs::Image ros_msg03;
+    // reduced levels: pyramid_pubXX[l - 1] publishes <camera>/level<l>/<side>/image_rect
+    vector<image_transport::CameraPublisher> pyramid_pub00;
+    vector<image_transport::CameraPublisher> pyramid_pub01;
+    vector<image_transport::CameraPublisher> pyramid_pub02;
+    vector<image_transport::CameraPublisher> pyramid_pub03;
+    for (unsigned int l = 1; l <= options.pyramidLevels; l++)
+    {
+        string level = boost::str(boost::format("/level%d/") % l);
+        pyramid_pub00.push_back(it.advertiseCamera("grayscale" + level + "left/image_rect", 1));
+        pyramid_pub01.push_back(it.advertiseCamera("grayscale" + level + "right/image_rect", 1));
+        pyramid_pub02.push_back(it.advertiseCamera("color" + level + "left/image_rect", 1));
+        pyramid_pub03.push_back(it.advertiseCamera("color" + level + "right/image_rect", 1));
+    }
+
+    // recycled per-stream buffers: steady-state playback does not allocate them again
+    MessagePool<sensor_msgs::Image>         image_pool[4];
+    MessagePool<sensor_msgs::CameraInfo>    info_pool[4];
+    MessagePool<sensor_msgs::PointCloud2>   velodyne_pool;
+    MessagePool<sensor_msgs::PointCloud2>   compact_pool;
+    MessagePool<sensor_msgs::Image>         range_pool;
+    RangeProjection                         range_projection;
+    MessagePool<sensor_msgs::PointCloud2>   cropped_pool;
+    vector<size_t>                          crop_blocks;
+    MessagePool<sensor_msgs::PointCloud2>   voxel_pool;
+    VoxelGrid                               voxel_grid;
+    MessagePool<stereo_msgs::DisparityImage> disparity_pool;
+    vector<uint8_t>                         png_buffer[5];      // image_00 ... image_03, disparities
+    vector<float>                           velodyne_buffer;
+    vector<PyramidBuffers>                  pyramid_buffers;
+    for (int camera = 0; camera < 4; camera++)
+        pyramid_buffers.push_back(PyramidBuffers(options.pyramidLevels));
 
 
 //    sensor_msgs::CameraInfo ros_cameraInfoMsg;
@@ -594,13 +1914,15 @@ int main(int argc, char **argv)
     sensor_msgs::CameraInfo ros_cameraInfoMsg_camera02;
     sensor_msgs::CameraInfo ros_cameraInfoMsg_camera03;
 
-    cv_bridge::CvImage cv_bridge_img;
-
-    ros::Publisher map_pub           = node.advertise<pcl::PointCloud<pcl::PointXYZ> >  ("hdl64e", 1, true);
+    ros::Publisher map_pub           = node.advertise<sensor_msgs::PointCloud2>         ("hdl64e", 1, true);
     ros::Publisher gps_pub           = node.advertise<sensor_msgs::NavSatFix>           ("oxts/gps", 1, true);
     ros::Publisher gps_pub_initial   = node.advertise<sensor_msgs::NavSatFix>           ("oxts/gps_initial", 1, true);
     ros::Publisher imu_pub           = node.advertise<sensor_msgs::Imu>                 ("oxts/imu", 1, true);
     ros::Publisher disp_pub          = node.advertise<stereo_msgs::DisparityImage>      ("preprocessed_disparity", 1, true);
+    ros::Publisher compact_pub       = node.advertise<sensor_msgs::PointCloud2>         ("hdl64e_compact", 1);
+    ros::Publisher range_pub         = node.advertise<sensor_msgs::Image>               ("hdl64e_range", 1);
+    ros::Publisher cropped_pub       = node.advertise<sensor_msgs::PointCloud2>         ("hdl64e_cropped", 1);
+    ros::Publisher voxel_pub         = node.advertise<sensor_msgs::PointCloud2>         ("hdl64e_voxel", 1);
 
     sensor_msgs::NavSatFix  ros_msgGpsFix;
     sensor_msgs::NavSatFix  ros_msgGpsFixInitial;   // This message contains the first reading of the file
@@ -634,74 +1956,243 @@ int main(int argc, char **argv)
         cout << "    │   └── data              " << endl;
         cout << "    │     └ timestamps.txt    " << endl;
         cout << "    └── calib_cam_to_cam.txt  " << endl << endl;
+        cout << "or, with --sequence 00, an odometry benchmark tree:" << endl;
+        cout << "├── sequences/00             " << endl;
+        cout << "│   ├── image_0 ... image_3  " << endl;
+        cout << "│   ├── velodyne             " << endl;
+        cout << "│   ├── calib.txt            " << endl;
+        cout << "│   └── times.txt            " << endl;
+        cout << "└── poses/00.txt             " << endl << endl;
 
         return 1;
     }
 
-    if (!(options.all_data || options.color || options.gps || options.grayscale || options.imu || options.velodyne))
+    // computed disparities are published as the pre-calculated ones
+    if (options.computeDisp)
+        options.stereoDisp = true;
+
+    if (!(options.all_data || options.color || options.gps || options.grayscale || options.imu || options.velodyne || options.tracklets || options.stereoDisp))
     {
         ROS_WARN_STREAM("Job finished without playing the dataset. No 'publishing' parameters provided");
         node.shutdown();
         return 1;
     }
 
-    dir_root             = options.path;
-    dir_image00          = options.path;
-    dir_image01          = options.path;
-    dir_image02          = options.path;
-    dir_image03          = options.path;
-    dir_image04          = options.path;
-    dir_oxts             = options.path;
-    dir_velodyne_points  = options.path;
-    dir_image04          = options.path;
+    if (options.clock)
+    {
+        // simulated time comes from the KITTI timestamps
+        options.timestamps = true;
+    }
 
-    (*(options.path.end() - 1) != '/' ? dir_root            = options.path + "/"                      : dir_root            = options.path);
-    (*(options.path.end() - 1) != '/' ? dir_image00         = options.path + "/image_00/data/"        : dir_image00         = options.path + "image_00/data/");
-    (*(options.path.end() - 1) != '/' ? dir_image01         = options.path + "/image_01/data/"        : dir_image01         = options.path + "image_01/data/");
-    (*(options.path.end() - 1) != '/' ? dir_image02         = options.path + "/image_02/data/"        : dir_image02         = options.path + "image_02/data/");
-    (*(options.path.end() - 1) != '/' ? dir_image03         = options.path + "/image_03/data/"        : dir_image03         = options.path + "image_03/data/");
-    (*(options.path.end() - 1) != '/' ? dir_image04         = options.path + "/disparities/"          : dir_image04         = options.path + "disparities/");
-    (*(options.path.end() - 1) != '/' ? dir_oxts            = options.path + "/oxts/data/"            : dir_oxts            = options.path + "oxts/data/");
-    (*(options.path.end() - 1) != '/' ? dir_velodyne_points = options.path + "/velodyne_points/data/" : dir_velodyne_points = options.path + "velodyne_points/data/");
+    if (options.profile)
+    {
+        // headless, unlimited rate: only the player is measured
+        if (options.unsynced)
+        {
+            ROS_ERROR_STREAM("--profile needs a synced drive, unsynced streams follow their timestamps");
+            node.shutdown();
+            return -1;
+        }
+        if (options.viewer || options.viewDisparities || options.synchMode || options.adaptive || options.clock)
+            ROS_WARN_STREAM("--profile ignores the viewers, synch mode, adaptive rate and /clock");
+        options.viewer = options.viewDisparities = options.synchMode = options.adaptive = options.clock = false;
+        options.frequency = 0.0;
+    }
+    if (!options.baseline.empty() && !options.profile)
+        ROS_WARN_STREAM("--baseline is only used with --profile");
+    if (options.recordBaseline && options.baseline.empty())
+        ROS_WARN_STREAM("--recordBaseline is only used with --baseline");
 
-    (*(options.path.end() - 1) != '/' ? dir_timestamp_image00    = options.path + "/image_00/"            : dir_timestamp_image00   = options.path + "image_00/");
-    (*(options.path.end() - 1) != '/' ? dir_timestamp_image01    = options.path + "/image_01/"            : dir_timestamp_image01   = options.path + "image_01/");
-    (*(options.path.end() - 1) != '/' ? dir_timestamp_image02    = options.path + "/image_02/"            : dir_timestamp_image02   = options.path + "image_02/");
-    (*(options.path.end() - 1) != '/' ? dir_timestamp_image03    = options.path + "/image_03/"            : dir_timestamp_image03   = options.path + "image_03/");
-    (*(options.path.end() - 1) != '/' ? dir_timestamp_oxts       = options.path + "/oxts/"                : dir_timestamp_oxts      = options.path + "oxts/");
-    (*(options.path.end() - 1) != '/' ? dir_timestamp_velodyne   = options.path + "/velodyne_points/"     : dir_timestamp_velodyne  = options.path + "velodyne_points/");
+    if (options.unsynced)
+    {
+        // unsynced streams are only aligned through their own timestamps
+        options.timestamps = true;
+        if (options.frequency <= 0.0)
+        {
+            ROS_ERROR_STREAM("Unsynced drives play at a speed relative to real time, -f must be > 0");
+            node.shutdown();
+            return -1;
+        }
+        if (options.synchMode)
+        {
+            ROS_WARN_STREAM("Synch mode is not available with unsynced drives, ignoring it");
+            options.synchMode = false;
+        }
+        if (options.viewer || options.viewDisparities || options.stereoDisp)
+        {
+            ROS_WARN_STREAM("Viewers and disparities are not available with unsynced drives, ignoring them");
+            options.viewer = options.viewDisparities = options.stereoDisp = options.computeDisp = false;
+        }
+    }
 
-    (*(options.path.end() - 1) != '/' ? dir_timestamp_velodyne   = options.path + "/velodyne_points/"     : dir_timestamp_velodyne  = options.path + "velodyne_points/");
+    if (options.adaptive && (options.unsynced || options.clock || options.synchMode))
+    {
+        ROS_WARN_STREAM("Adaptive rate is not available with unsynced drives, --clock or synch mode, ignoring it");
+        options.adaptive = false;
+    }
+    if (options.adaptive && (options.minRate <= 0.0 || options.maxRate < options.minRate))
+    {
+        ROS_ERROR_STREAM("Adaptive rate needs 0 < minRate <= maxRate");
+        node.shutdown();
+        return -1;
+    }
+    if (options.voxelLeaf < 0.0f || (options.voxelLeaf > 0.0f && options.voxelLeaf < 0.001f))
+    {
+        // voxel coordinates are packed on 21 bits, +-1 km at 1 mm
+        ROS_ERROR_STREAM("--voxelLeaf must be 0 (disabled) or at least 0.001 m");
+        node.shutdown();
+        return -1;
+    }
+
+    // odometry sequences hold the cameras and the velodyne, at a single rate, and the ground truth poses
+    const bool odometry = options.sequence >= 0;
+    if (odometry && (options.gps || options.imu || options.deskew || options.tracklets || options.unsynced || options.gpsReferenceFrame.length() > 1))
+    {
+        ROS_ERROR_STREAM("-g, -i, -p, -u, --deskew and --tracklets need a raw drive, odometry sequences have no OXTS nor labels");
+        node.shutdown();
+        return -1;
+    }
+    const unsigned int frame_digits = odometry ? kitti_player::kOdometryFrameDigits : kitti_player::kRawFrameDigits;
+
+    vector<int> stream_cpus;
+    if (!parseCpuList(options.cpuAffinity, stream_cpus))
+    {
+        ROS_ERROR_STREAM("Invalid --cpuAffinity " << options.cpuAffinity << ", expected a list of cores like 2,3,4");
+        node.shutdown();
+        return -1;
+    }
+    if (options.realtime > 99)
+    {
+        ROS_ERROR_STREAM("--realtime priority must be within 1 and 99");
+        node.shutdown();
+        return -1;
+    }
+
+    // shared memory rings: grayscale left/right, color left/right, velodyne
+    ShmPublisher shm_pub[5];
+    if (options.shm)
+    {
+        const char *topics[] = { "grayscale/left/image_rect", "grayscale/right/image_rect",
+                                 "color/left/image_rect", "color/right/image_rect", "hdl64e" };
+        for (size_t i = 0; i < 5; i++)
+        {
+            if (!shm_pub[i].open(node, topics[i], options.shmSlots, options.shmSlotSize * 1024 * 1024))
+            {
+                node.shutdown();
+                return -1;
+            }
+        }
+    }
+
+    // a drive archive (e.g. 2011_09_26_drive_0001_sync.zip) is played without extracting it
+    if (options.path.size() > 4 && options.path.compare(options.path.size() - 4, 4, ".zip") == 0)
+    {
+        string drive_path;
+        if (!kitti_player::mountDrive(options.path, drive_path))
+        {
+            ROS_ERROR_STREAM("Cannot read the drive archive " << options.path);
+            node.shutdown();
+            return -1;
+        }
+        ROS_INFO_STREAM("Playing " << options.path << " from " << drive_path);
+        options.path = drive_path;
+    }
+
+    dir_root             = options.path;
+    dir_image00          = options.path;
+    dir_image01          = options.path;
+    dir_image02          = options.path;
+    dir_image03          = options.path;
+    dir_image04          = options.path;
+    dir_oxts             = options.path;
+    dir_velodyne_points  = options.path;
+    dir_image04          = options.path;
+
+    (*(options.path.end() - 1) != '/' ? dir_root            = options.path + "/"                      : dir_root            = options.path);
+    (*(options.path.end() - 1) != '/' ? dir_image00         = options.path + "/image_00/data/"        : dir_image00         = options.path + "image_00/data/");
+    (*(options.path.end() - 1) != '/' ? dir_image01         = options.path + "/image_01/data/"        : dir_image01         = options.path + "image_01/data/");
+    (*(options.path.end() - 1) != '/' ? dir_image02         = options.path + "/image_02/data/"        : dir_image02         = options.path + "image_02/data/");
+    (*(options.path.end() - 1) != '/' ? dir_image03         = options.path + "/image_03/data/"        : dir_image03         = options.path + "image_03/data/");
+    (*(options.path.end() - 1) != '/' ? dir_image04         = options.path + "/disparities/"          : dir_image04         = options.path + "disparities/");
+    (*(options.path.end() - 1) != '/' ? dir_oxts            = options.path + "/oxts/data/"            : dir_oxts            = options.path + "oxts/data/");
+    (*(options.path.end() - 1) != '/' ? dir_velodyne_points = options.path + "/velodyne_points/data/" : dir_velodyne_points = options.path + "velodyne_points/data/");
+
+    (*(options.path.end() - 1) != '/' ? dir_timestamp_image00    = options.path + "/image_00/"            : dir_timestamp_image00   = options.path + "image_00/");
+    (*(options.path.end() - 1) != '/' ? dir_timestamp_image01    = options.path + "/image_01/"            : dir_timestamp_image01   = options.path + "image_01/");
+    (*(options.path.end() - 1) != '/' ? dir_timestamp_image02    = options.path + "/image_02/"            : dir_timestamp_image02   = options.path + "image_02/");
+    (*(options.path.end() - 1) != '/' ? dir_timestamp_image03    = options.path + "/image_03/"            : dir_timestamp_image03   = options.path + "image_03/");
+    (*(options.path.end() - 1) != '/' ? dir_timestamp_oxts       = options.path + "/oxts/"                : dir_timestamp_oxts      = options.path + "oxts/");
+    (*(options.path.end() - 1) != '/' ? dir_timestamp_velodyne   = options.path + "/velodyne_points/"     : dir_timestamp_velodyne  = options.path + "velodyne_points/");
+
+    (*(options.path.end() - 1) != '/' ? dir_timestamp_velodyne   = options.path + "/velodyne_points/"     : dir_timestamp_velodyne  = options.path + "velodyne_points/");
+
+    // odometry benchmark: <dataset>/sequences/NN/{image_0 ... image_3, velodyne, calib.txt, times.txt} and <dataset>/poses/NN.txt;
+    // times.txt stands for every timestamps.txt, the ground truth for the OXTS trajectory
+    string odometry_poses;
+    if (odometry)
+    {
+        const string dataset = dir_root;
+        const string sequence = boost::str(boost::format("%02d") % options.sequence);
+        dir_root               = dataset + "sequences/" + sequence + "/";
+        dir_image00            = dir_root + "image_0/";
+        dir_image01            = dir_root + "image_1/";
+        dir_image02            = dir_root + "image_2/";
+        dir_image03            = dir_root + "image_3/";
+        dir_image04            = dir_root + "disparities/";
+        dir_velodyne_points    = dir_root + "velodyne/";
+        dir_oxts               = dataset + "poses/";
+        dir_timestamp_image00  = dir_timestamp_image01 = dir_timestamp_image02 = dir_timestamp_image03 = dir_root;
+        dir_timestamp_velodyne = dir_timestamp_oxts = dir_root;
+        odometry_poses         = dir_oxts + sequence + ".txt";
+
+        // -a: the streams of the sequence, the color images being a separate download
+        if (options.all_data)
+        {
+            options.grayscale = options.velodyne = true;
+            options.color = kitti_player::isDirectory(dir_image02) && kitti_player::isDirectory(dir_image03);
+            options.all_data = false;
+        }
+    }
 
     // Check all the directories
     if (
-        (options.all_data       && (   (opendir(dir_image00.c_str())            == NULL) ||
-                                       (opendir(dir_image01.c_str())            == NULL) ||
-                                       (opendir(dir_image02.c_str())            == NULL) ||
-                                       (opendir(dir_image03.c_str())            == NULL) ||
-                                       (opendir(dir_oxts.c_str())               == NULL) ||
-                                       (opendir(dir_velodyne_points.c_str())    == NULL)))
+        (options.all_data       && (   (!kitti_player::isDirectory(dir_image00)) ||
+                                       (!kitti_player::isDirectory(dir_image01)) ||
+                                       (!kitti_player::isDirectory(dir_image02)) ||
+                                       (!kitti_player::isDirectory(dir_image03)) ||
+                                       (!kitti_player::isDirectory(dir_oxts)) ||
+                                       (!kitti_player::isDirectory(dir_velodyne_points))))
+        ||
+        (options.color          && (   (!kitti_player::isDirectory(dir_image02)) ||
+                                       (!kitti_player::isDirectory(dir_image03))))
+        ||
+        (options.grayscale      && (   (!kitti_player::isDirectory(dir_image00)) ||
+                                       (!kitti_player::isDirectory(dir_image01))))
+        ||
+        (options.imu            && (   (!kitti_player::isDirectory(dir_oxts))))
+        ||
+        (options.gps            && (   (!kitti_player::isDirectory(dir_oxts))))
         ||
-        (options.color          && (   (opendir(dir_image02.c_str())            == NULL) ||
-                                       (opendir(dir_image03.c_str())            == NULL)))
+        (options.sendTransform  && (   (!kitti_player::isDirectory(dir_oxts))))
         ||
-        (options.grayscale      && (   (opendir(dir_image00.c_str())            == NULL) ||
-                                       (opendir(dir_image01.c_str())            == NULL)))
+        (options.stereoDisp     && !options.computeDisp
+                                && (   (!kitti_player::isDirectory(dir_image04))))
         ||
-        (options.imu            && (   (opendir(dir_oxts.c_str())               == NULL)))
+        (options.computeDisp    && (   (!kitti_player::isDirectory(dir_image00)) ||
+                                       (!kitti_player::isDirectory(dir_image01))))
         ||
-        (options.gps            && (   (opendir(dir_oxts.c_str())               == NULL)))
+        (options.velodyne       && (   (!kitti_player::isDirectory(dir_velodyne_points))))
         ||
-        (options.stereoDisp     && (   (opendir(dir_image04.c_str())            == NULL)))
+        (options.tracklets      && (   (!kitti_player::isDirectory(dir_velodyne_points))))
         ||
-        (options.velodyne       && (   (opendir(dir_velodyne_points.c_str())    == NULL)))
+        (options.deskew         && (   (!kitti_player::isDirectory(dir_oxts))))
         ||
-        (options.timestamps     && (   (opendir(dir_timestamp_image00.c_str())      == NULL) ||
-                                       (opendir(dir_timestamp_image01.c_str())      == NULL) ||
-                                       (opendir(dir_timestamp_image02.c_str())      == NULL) ||
-                                       (opendir(dir_timestamp_image03.c_str())      == NULL) ||
-                                       (opendir(dir_timestamp_oxts.c_str())         == NULL) ||
-                                       (opendir(dir_timestamp_velodyne.c_str())     == NULL)))
+        (options.timestamps     && (   (!kitti_player::isDirectory(dir_timestamp_image00)) ||
+                                       (!kitti_player::isDirectory(dir_timestamp_image01)) ||
+                                       (!kitti_player::isDirectory(dir_timestamp_image02)) ||
+                                       (!kitti_player::isDirectory(dir_timestamp_image03)) ||
+                                       (!kitti_player::isDirectory(dir_timestamp_oxts)) ||
+                                       (!kitti_player::isDirectory(dir_timestamp_velodyne))))
 
     )
     {
@@ -719,112 +2210,85 @@ int main(int argc, char **argv)
 
     if (options.all_data)
     {
-        dir = opendir(dir_image02.c_str());
-        while ((ent = readdir(dir)))
-        {
-            //skip . & ..
-            len = strlen (ent->d_name);
-            //skip . & ..
-            if (len > 2)
-                total_entries++;
-        }
-        closedir (dir);
+        total_entries = kitti_player::countFiles(dir_image02);
     }
     else
     {
         bool done = false;
         if (!done && options.color)
         {
-            total_entries = 0;
-            dir = opendir(dir_image02.c_str());
-            while ((ent = readdir(dir)))
-            {
-                //skip . & ..
-                len = strlen (ent->d_name);
-                //skip . & ..
-                if (len > 2)
-                    total_entries++;
-            }
-            closedir (dir);
+            total_entries = kitti_player::countFiles(dir_image02);
             done = true;
         }
         if (!done && options.grayscale)
         {
-            total_entries = 0;
-            dir = opendir(dir_image00.c_str());
-            while ((ent = readdir(dir)))
-            {
-                //skip . & ..
-                len = strlen (ent->d_name);
-                //skip . & ..
-                if (len > 2)
-                    total_entries++;
-            }
-            closedir (dir);
+            total_entries = kitti_player::countFiles(dir_image00);
             done = true;
         }
         if (!done && options.gps)
         {
-            total_entries = 0;
-            dir = opendir(dir_oxts.c_str());
-            while ((ent = readdir(dir)))
-            {
-                //skip . & ..
-                len = strlen (ent->d_name);
-                //skip . & ..
-                if (len > 2)
-                    total_entries++;
-            }
-            closedir (dir);
+            total_entries = kitti_player::countFiles(dir_oxts);
             done = true;
         }
         if (!done && options.imu)
         {
-            total_entries = 0;
-            dir = opendir(dir_oxts.c_str());
-            while ((ent = readdir(dir)))
-            {
-                //skip . & ..
-                len = strlen (ent->d_name);
-                //skip . & ..
-                if (len > 2)
-                    total_entries++;
-            }
-            closedir (dir);
+            total_entries = kitti_player::countFiles(dir_oxts);
             done = true;
         }
         if (!done && options.velodyne)
         {
-            total_entries = 0;
-            dir = opendir(dir_oxts.c_str());
-            while ((ent = readdir(dir)))
-            {
-                //skip . & ..
-                len = strlen (ent->d_name);
-                //skip . & ..
-                if (len > 2)
-                    total_entries++;
-            }
-            closedir (dir);
+            total_entries = kitti_player::countFiles(dir_oxts);
             done = true;
         }
         if (!done && options.stereoDisp)
         {
-            total_entries = 0;
-            dir = opendir(dir_image04.c_str());
-            while ((ent = readdir(dir)))
-            {
-                //skip . & ..
-                len = strlen (ent->d_name);
-                //skip . & ..
-                if (len > 2)
-                    total_entries++;
-            }
-            closedir (dir);
+            total_entries = kitti_player::countFiles(options.computeDisp ? dir_image00 : dir_image04);
+            done = true;
+        }
+        if (!done && options.tracklets)
+        {
+            total_entries = kitti_player::countFiles(dir_velodyne_points);
             done = true;
         }
     }
 
+    // odometry: the frames of times.txt, read once with the calibration of the sequence
+    vector<double> odometry_times;
+    kitti_player::OdometryCalibration odometry_calibration;
+    if (odometry)
+    {
+        if (!kitti_player::loadOdometryTimes(dir_root + "times.txt", odometry_times) ||
+            !kitti_player::loadOdometryCalibration(dir_root + "calib.txt", odometry_calibration))
+        {
+            ROS_ERROR_STREAM("Fail to read " << dir_root << "times.txt and calib.txt");
+            node.shutdown();
+            return -1;
+        }
+        total_entries = odometry_times.size();
+    }
+
+    // extract drives store the velodyne scans as text
+    string velodyne_extension = ".bin";
+    if (options.unsynced && kitti_player::countFiles(dir_velodyne_points) > 0 &&
+        !kitti_player::fileExists(dir_velodyne_points + "0000000000.bin"))
+        velodyne_extension = ".txt";
+
+    // files transcoded by kitti_transcode are read in place of the raw ones, when complete
+    // (raw drives only: kitti_transcode names its files as them)
+    string image_extension[4] = { ".png", ".png", ".png", ".png" };
+    if (!options.noCache && !odometry)
+    {
+        string *dir_images[4] = { &dir_image00, &dir_image01, &dir_image02, &dir_image03 };
+        for (int c = 0; c < 4; c++)
+        {
+            bool enabled = options.all_data || (c < 2 ? options.grayscale : options.color);
+            if (enabled)
+                preferCache(*dir_images[c], image_extension[c], kitti_player::imageCacheDirectory(*dir_images[c]), ".kqi");
+        }
+        if (options.velodyne || options.all_data)
+            preferCache(dir_velodyne_points, velodyne_extension, kitti_player::velodyneCacheDirectory(dir_velodyne_points), ".kvc");
+    }
+
     // Check options.startFrame and total_entries
     if (options.startFrame > total_entries)
     {
@@ -838,34 +2302,19 @@ int main(int argc, char **argv)
         ROS_INFO_STREAM("The entry point (frame number) is: " << entries_played);
     }
 
-    if (options.viewer)
+    // the windows are drawn by the viewer thread, fed with the latest frame of each stream
+    FrameViewer viewer;
+    int color_window = -1, grayscale_window = -1, disparity_window = -1;
+    if (options.viewer && (options.color || options.all_data))
+        color_window = viewer.addWindow("CameraSimulator Color Viewer");
+    if (options.viewer && (options.grayscale || options.all_data))
+        grayscale_window = viewer.addWindow("CameraSimulator Grayscale Viewer");
+    if (options.viewDisparities)
+        disparity_window = viewer.addWindow("Precomputed Disparities", true);
+    if (options.viewer || options.viewDisparities)
     {
         ROS_INFO_STREAM("Opening CV viewer(s)");
-        if (options.color || options.all_data)
-        {
-            ROS_DEBUG_STREAM("color||all " << options.color << " " << options.all_data);
-            cv::namedWindow("CameraSimulator Color Viewer", CV_WINDOW_AUTOSIZE);
-            full_filename_image02 = dir_image02 + boost::str(boost::format("%010d") % 0 ) + ".png";
-            cv_image02 = cv::imread(full_filename_image02, CV_LOAD_IMAGE_UNCHANGED);
-            cv::waitKey(5);
-        }
-        if (options.grayscale || options.all_data)
-        {
-            ROS_DEBUG_STREAM("grayscale||all " << options.grayscale << " " << options.all_data);
-            cv::namedWindow("CameraSimulator Grayscale Viewer", CV_WINDOW_AUTOSIZE);
-            full_filename_image00 = dir_image00 + boost::str(boost::format("%010d") % 0 ) + ".png";
-            cv_image00 = cv::imread(full_filename_image00, CV_LOAD_IMAGE_UNCHANGED);
-            cv::waitKey(5);
-        }
-        if (options.viewDisparities || options.all_data)
-        {
-            ROS_DEBUG_STREAM("viewDisparities||all " << options.grayscale << " " << options.all_data);
-            cv::namedWindow("Precomputed Disparities", CV_WINDOW_AUTOSIZE);
-            full_filename_Disparities = dir_Disparities + boost::str(boost::format("%010d") % 0 ) + ".png";
-            cv_disparities = cv::imread(full_filename_Disparities, CV_LOAD_IMAGE_UNCHANGED);
-            cv::waitKey(5);
-        }
-        ROS_INFO_STREAM("Opening CV viewer(s)... OK");
+        viewer.start();
     }
 
     // CAMERA INFO SECTION: read one for all
@@ -900,7 +2349,10 @@ int main(int argc, char **argv)
 
     if (options.color || options.all_data)
     {
-        if (
+        if (odometry ?
+            !(getOdometryCalibration(odometry_calibration, 2, ros_cameraInfoMsg_camera02.K.data(), ros_cameraInfoMsg_camera02.R.data(), ros_cameraInfoMsg_camera02.P.data()) &&
+              getOdometryCalibration(odometry_calibration, 3, ros_cameraInfoMsg_camera03.K.data(), ros_cameraInfoMsg_camera03.R.data(), ros_cameraInfoMsg_camera03.P.data()))
+            :
             !(getCalibration(dir_root, "02", ros_cameraInfoMsg_camera02.K.data(), ros_cameraInfoMsg_camera02.D, ros_cameraInfoMsg_camera02.R.data(), ros_cameraInfoMsg_camera02.P.data()) &&
               getCalibration(dir_root, "03", ros_cameraInfoMsg_camera03.K.data(), ros_cameraInfoMsg_camera03.D, ros_cameraInfoMsg_camera03.R.data(), ros_cameraInfoMsg_camera03.P.data()))
         )
@@ -910,16 +2362,17 @@ int main(int argc, char **argv)
             return -1;
         }
         //Assume same height/width for the camera pair
-        full_filename_image02 = dir_image02 + boost::str(boost::format("%010d") % 0 ) + ".png";
-        cv_image02 = cv::imread(full_filename_image02, CV_LOAD_IMAGE_UNCHANGED);
-        cv::waitKey(5);
+        kitti_player::loadImage(kitti_player::frameFilename(dir_image02, 0, image_extension[2].c_str(), frame_digits), cv_image02);
         ros_cameraInfoMsg_camera03.height = ros_cameraInfoMsg_camera02.height = cv_image02.rows;// -1;TODO: CHECK, qui potrebbe essere -1
         ros_cameraInfoMsg_camera03.width  = ros_cameraInfoMsg_camera02.width  = cv_image02.cols;// -1;
     }
 
     if (options.grayscale || options.all_data)
     {
-        if (
+        if (odometry ?
+            !(getOdometryCalibration(odometry_calibration, 0, ros_cameraInfoMsg_camera00.K.data(), ros_cameraInfoMsg_camera00.R.data(), ros_cameraInfoMsg_camera00.P.data()) &&
+              getOdometryCalibration(odometry_calibration, 1, ros_cameraInfoMsg_camera01.K.data(), ros_cameraInfoMsg_camera01.R.data(), ros_cameraInfoMsg_camera01.P.data()))
+            :
             !(getCalibration(dir_root, "00", ros_cameraInfoMsg_camera00.K.data(), ros_cameraInfoMsg_camera00.D, ros_cameraInfoMsg_camera00.R.data(), ros_cameraInfoMsg_camera00.P.data()) &&
               getCalibration(dir_root, "01", ros_cameraInfoMsg_camera01.K.data(), ros_cameraInfoMsg_camera01.D, ros_cameraInfoMsg_camera01.R.data(), ros_cameraInfoMsg_camera01.P.data()))
         )
@@ -929,413 +2382,914 @@ int main(int argc, char **argv)
             return -1;
         }
         //Assume same height/width for the camera pair
-        full_filename_image00 = dir_image00 + boost::str(boost::format("%010d") % 0 ) + ".png";
-        cv_image00 = cv::imread(full_filename_image00, CV_LOAD_IMAGE_UNCHANGED);
-        cv::waitKey(5);
+        kitti_player::loadImage(kitti_player::frameFilename(dir_image00, 0, image_extension[0].c_str(), frame_digits), cv_image00);
         ros_cameraInfoMsg_camera01.height = ros_cameraInfoMsg_camera00.height = cv_image00.rows;// -1; TODO: CHECK -1?
         ros_cameraInfoMsg_camera01.width  = ros_cameraInfoMsg_camera00.width  = cv_image00.cols;// -1;
     }
 
-    boost::progress_display progress(total_entries) ;
-    double cv_min, cv_max = 0.0f;
-    ros::Publisher publisher_GT_RTK;
-    publisher_GT_RTK = node.advertise<visualization_msgs::MarkerArray> ("/kitti_player/GT_RTK", 1);
-
-    // This is the main KITTI_PLAYER Loop
-    do
+    // disparity to depth, Z = f * T / d: focal length and baseline of the rectified grayscale pair
+    double disparity_f = 0.0, disparity_T = 0.0;
+    if (options.stereoDisp)
     {
-        // this refs #600 synchMode
-        if (options.synchMode)
+        double K[9], R[9], P00[12], P01[12];
+        vector<double> D;
+        bool calibrated = odometry ? getOdometryCalibration(odometry_calibration, 0, K, R, P00) && getOdometryCalibration(odometry_calibration, 1, K, R, P01)
+                                   : getCalibration(dir_root, "00", K, D, R, P00) && getCalibration(dir_root, "01", K, D, R, P01);
+        if (calibrated && P01[0] != 0.0)
         {
-            if (waitSynch == true)
-            {
-                //ROS_DEBUG_STREAM("Waiting for synch...");
-                ros::spinOnce();
-                continue;
-            }
-            else
-            {
-                ROS_DEBUG_STREAM("Run after received synch...");
-                waitSynch = true;
-            }
+            // P_rect_01 (P1 of the odometry sequences) = K * [I | -baseline]
+            disparity_f = P00[0];
+            disparity_T = -P01[3] / P01[0];
         }
+        else if (options.computeDisp)
+        {
+            ROS_ERROR_STREAM("Error reading CAMERA00/CAMERA01 calibration, needed by --computeDisp");
+            node.shutdown();
+            return -1;
+        }
+        else
+            ROS_WARN_STREAM("No CAMERA00/CAMERA01 calibration, disparities published with f = T = 0");
+    }
 
-        // single timestamp for all published stuff
-        Time current_timestamp = ros::Time::now();
+    // computed disparities are cached next to the pre-calculated ones, when the drive is writable
+    bool cache_disparities = false;
+    if (options.computeDisp)
+    {
+        struct stat st;
+        cache_disparities = (mkdir(dir_image04.c_str(), 0755) == 0 || errno == EEXIST) &&
+                            stat(dir_image04.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+        if (!cache_disparities)
+            ROS_WARN_STREAM("Cannot write " << dir_image04 << ", the computed disparities are not cached");
+    }
 
-        if (options.stereoDisp)
+    // Timestamp tables: read once here instead of re-opening timestamps.txt at every frame
+    vector<ros::Time> timestamps_image00;
+    vector<ros::Time> timestamps_image01;
+    vector<ros::Time> timestamps_image02;
+    vector<ros::Time> timestamps_image03;
+    vector<ros::Time> timestamps_oxts;
+    vector<ros::Time> timestamps_velodyne;
+    if (options.timestamps && odometry)
+    {
+        // times.txt counts from the start of the sequence, played as now; the streams share it
+        const ros::Time start = ros::Time::now();
+        timestamps_velodyne.resize(odometry_times.size());
+        for (size_t i = 0; i < odometry_times.size(); i++)
+            timestamps_velodyne[i] = start + ros::Duration(odometry_times[i]);
+        timestamps_image00 = timestamps_image01 = timestamps_image02 = timestamps_image03 = timestamps_oxts = timestamps_velodyne;
+    }
+    else if (options.timestamps)
+    {
+        if (
+            ((options.grayscale || options.all_data)    && (!loadTimestamps(dir_timestamp_image00  + "timestamps.txt", timestamps_image00) ||
+                                                            !loadTimestamps(dir_timestamp_image01  + "timestamps.txt", timestamps_image01)))
+            ||
+            ((options.color || options.all_data)        && (!loadTimestamps(dir_timestamp_image02  + "timestamps.txt", timestamps_image02) ||
+                                                            !loadTimestamps(dir_timestamp_image03  + "timestamps.txt", timestamps_image03)))
+            ||
+            ((options.gps || options.imu || options.sendTransform || options.deskew || options.all_data)
+                                                        && (!loadTimestamps(dir_timestamp_oxts     + "timestamps.txt", timestamps_oxts)))
+            ||
+            ((options.velodyne || options.tracklets || options.all_data)
+                                                        && (!loadTimestamps(dir_timestamp_velodyne + "timestamps.txt", timestamps_velodyne)))
+        )
         {
-            // Allocate new disparity image message
-            stereo_msgs::DisparityImagePtr disp_msg = boost::make_shared<stereo_msgs::DisparityImage>();
+            ROS_ERROR_STREAM("Error reading the KITTI timestamps, use --help for details");
+            node.shutdown();
+            return -1;
+        }
+    }
 
-            full_filename_image04 = dir_image04 + boost::str(boost::format("%010d") % entries_played ) + ".png";
-            cv_image04 = cv::imread(full_filename_image04, CV_LOAD_IMAGE_GRAYSCALE);
+    // per-frame processing stages run on these threads
+    WorkerPool pool;
 
-            cv::minMaxLoc(cv_image04, &cv_min, &cv_max);
+    // decoded frames shared with the other players, keyed by the absolute drive path
+    kitti_player::FrameCache frame_cache;
+    kitti_player::FrameCacheView image_view[4];     // cached image_00 ... image_03 in use
+    string cache_drive = dir_root;
+    if (options.frameCache > 0)
+    {
+        char *resolved = realpath(dir_root.c_str(), NULL);
+        if (resolved != NULL)
+        {
+            cache_drive = resolved;
+            free(resolved);
+        }
+        if (frame_cache.open(options.frameCacheName, size_t(options.frameCache) << 20, kFrameCacheSlot))
+            ROS_INFO_STREAM("Frames cache " << options.frameCacheName << ": " << frame_cache.slotCount() << " frames of "
+                            << frame_cache.slotSize() / 1024 << " KB");
+        else
+            ROS_WARN_STREAM("Cannot open the frames cache " << options.frameCacheName << ": " << strerror(errno) << ", decoding every frame");
+    }
 
-            disp_msg->min_disparity = (int)cv_min;
-            disp_msg->max_disparity = (int)cv_max;
+    // hdl64e_compact: coordinate step is twice the allowed error, declared for the consumers
+    float compact_scale = 2.0f * options.compactError;
+    if (options.compactError > 0.0f)
+    {
+        node.setParam("hdl64e_compact/scale", compact_scale);
+        node.setParam("hdl64e_compact/offset", 0.0);
+        node.setParam("hdl64e_compact/intensity_scale", 1.0 / 255.0);
+    }
 
-            disp_msg->valid_window.x_offset = 0;  // should be safe, checked!
-            disp_msg->valid_window.y_offset = 0;  // should be safe, checked!
-            disp_msg->valid_window.width    = 0;  // should be safe, checked!
-            disp_msg->valid_window.height   = 0;  // should be safe, checked!
-            disp_msg->T                     = 0;  // should be safe, checked!
-            disp_msg->f                     = 0;  // should be safe, checked!
-            disp_msg->delta_d               = 0;  // should be safe, checked!
-            disp_msg->header.stamp          = current_timestamp;
-            disp_msg->header.frame_id       = ros::this_node::getName();
-            disp_msg->header.seq            = progress.count();
+    // Velodyne deskewing: IMU to velodyne calibration, identity if missing
+    double R_imu_to_velo[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+    double T_imu_to_velo[3] = { 0, 0, 0 };
+    if (options.deskew && !kitti_player::loadImuToVelo(dir_root, R_imu_to_velo, T_imu_to_velo))
+        ROS_WARN_STREAM("calib_imu_to_velo.txt not found, deskewing with IMU and velodyne frames aligned");
 
-            sensor_msgs::Image& dimage = disp_msg->image;
-            dimage.width  = cv_image04.size().width ;
-            dimage.height = cv_image04.size().height ;
-            dimage.encoding = sensor_msgs::image_encodings::TYPE_32FC1;
-            dimage.step = dimage.width * sizeof(float);
-            dimage.data.resize(dimage.step * dimage.height);
-            cv::Mat_<float> dmat(dimage.height, dimage.width, reinterpret_cast<float*>(&dimage.data[0]), dimage.step);
+    // hdl64e_cropped
+    const bool crop = options.cropMinRange > 0.0f || options.cropMaxRange > 0.0f || options.cropFrustum;
+    CropRegion crop_region;
+    if (crop && !getCropRegion(dir_root, options, odometry ? &odometry_calibration : NULL, crop_region))
+    {
+        ROS_ERROR_STREAM("Error reading the " << (odometry ? "calib.txt calibration and image_2 size" : "calib_cam_to_cam.txt and calib_velo_to_cam.txt calibration")
+                         << ", needed by --cropFrustum");
+        node.shutdown();
+        return -1;
+    }
 
-            cv_image04.convertTo(dmat, dmat.type());
+    // in unsynced drives OXTS has its own frame count (100Hz)
+    unsigned int oxts_entries = total_entries;
+    if (options.unsynced)
+        oxts_entries = min<size_t>(kitti_player::countFiles(dir_oxts), timestamps_oxts.size());
+
+    // Whole-drive trajectory, converted once and then read by frame index
+    OxtsTrajectory trajectory;
+    tf::TransformBroadcaster tf_broadcaster;
+    ros::Publisher pose_pub;
+    ros::Publisher path_pub;
+    if (odometry && options.sendTransform)
+    {
+        if (!loadOdometryTrajectory(odometry_poses, odometry_calibration, total_entries, trajectory))
+        {
+            ROS_ERROR_STREAM("Error loading the ground truth poses from " << odometry_poses << " (sequences 00 to 10 only)");
+            node.shutdown();
+            return -1;
+        }
+        ROS_INFO_STREAM("Ground truth: " << trajectory.size() << " poses");
+    }
+    else if (options.sendTransform || options.gpsReferenceFrame.length() > 1)
+    {
+        ROS_INFO_STREAM("Loading OXTS trajectory...");
+        if (!loadOxtsTrajectory(dir_oxts, oxts_entries, trajectory))
+        {
+            ROS_ERROR_STREAM("Error loading the OXTS trajectory from " << dir_oxts);
+            node.shutdown();
+            return -1;
+        }
+        ROS_INFO_STREAM("Loading OXTS trajectory... OK (" << trajectory.size() << " poses)");
+    }
+    if (options.sendTransform)
+    {
+        const string trajectory_ns = odometry ? "groundtruth" : "oxts";
+        pose_pub = node.advertise<geometry_msgs::PoseStamped>(trajectory_ns + "/pose", 1, true);
+        path_pub = node.advertise<nav_msgs::Path>(trajectory_ns + "/path", 1, true);
+
+        // the path is the same for the whole drive: publish it once, latched
+        nav_msgs::Path path;
+        path.header.frame_id = "world";
+        path.header.stamp = ros::Time::now();
+        path.poses.resize(trajectory.size());
+        for (size_t i = 0; i < trajectory.size(); i++)
+        {
+            path.poses[i].header.frame_id = path.header.frame_id;
+            tf::poseTFToMsg(trajectory.pose[i], path.poses[i].pose);
+        }
+        path_pub.publish(path);
+    }
 
-            disp_pub.publish(disp_msg);
+    GpsTrail gps_trail(options.gpsReferenceFrame, options.gpsTrailLength, options.gpsTrailSpacing);
+    ros::Publisher publisher_GT_RTK;
+    publisher_GT_RTK = node.advertise<visualization_msgs::MarkerArray> ("/kitti_player/GT_RTK", 100, boost::bind(&GpsTrail::sendSnapshot, &gps_trail, _1));
 
+    // tracklet labels: parsed once here, then published frame by frame with the hdl64e stamps
+    TrackletPublisher tracklet_pub;
+    if (options.tracklets)
+    {
+        if (options.unsynced)
+        {
+            ROS_ERROR_STREAM("--tracklets needs a synced drive, the labels index its frames");
+            node.shutdown();
+            return -1;
         }
-
-        if (options.viewDisparities)
+        if (!tracklet_pub.open(node, dir_root + "tracklet_labels.xml"))
         {
-            full_filename_Disparities = dir_Disparities + boost::str(boost::format("%010d") % entries_played ) + ".png";
-            cv_disparities = cv::imread(full_filename_Disparities, CV_LOAD_IMAGE_UNCHANGED);
-            cv::putText(cv_disparities, "KittiPlayer", cvPoint(20, 15), CV_FONT_HERSHEY_SIMPLEX, 0.4, cvScalar(0, 255, 0), 1, CV_AA);
-            cv::putText(cv_disparities, boost::str(boost::format("%5d") % entries_played ), cvPoint(cv_disparities.size().width - 100, 30), CV_FONT_HERSHEY_DUPLEX, 1.0, cvScalar(0, 0, 255), 1, CV_AA);
-            cv::waitKey(5);
+            ROS_ERROR_STREAM("Fail to read " << dir_root << "tracklet_labels.xml");
+            node.shutdown();
+            return -1;
         }
+        ROS_INFO_STREAM("Tracklets: " << tracklet_pub.tracklets().tracklets() << " objects, "
+                        << tracklet_pub.tracklets().size() << " boxes over " << tracklet_pub.tracklets().frames() << " frames");
+    }
 
-        if (options.color || options.all_data)
-        {
-            full_filename_image02 = dir_image02 + boost::str(boost::format("%010d") % entries_played ) + ".png";
-            full_filename_image03 = dir_image03 + boost::str(boost::format("%010d") % entries_played ) + ".png";
-            ROS_DEBUG_STREAM ( full_filename_image02 << endl << full_filename_image03 << endl << endl);
+    // stamp of a frame: the KITTI timestamp if requested, the loop timestamp otherwise
+    auto frameStamp = [&](const vector<ros::Time> &table, unsigned int frame, const ros::Time & now) -> ros::Time
+    {
+        if (options.timestamps && frame < table.size())
+            return table[frame];
+        return now;
+    };
 
-            cv_image02 = cv::imread(full_filename_image02, CV_LOAD_IMAGE_UNCHANGED);
-            cv_image03 = cv::imread(full_filename_image03, CV_LOAD_IMAGE_UNCHANGED);
+    // STREAM JOBS: each one reads and publishes a single frame of its stream.
+    // They only share read-only state, so the unsynced mode can run them on
+    // their own threads.
 
-            if ( (cv_image02.data == NULL) || (cv_image03.data == NULL) )
-            {
-                ROS_ERROR_STREAM("Error reading color images (02 & 03)");
-                ROS_ERROR_STREAM(full_filename_image02 << endl << full_filename_image03);
-                node.shutdown();
-                return -1;
-            }
+    // matcher state and images of the computed disparities, apart from the grayscale stream ones
+    StereoBands stereo_bands;
+    cv::Mat cv_stereo_left, cv_stereo_right, cv_disparity_view;
+    vector<uint8_t> stereo_buffer[2];
 
-            if (options.viewer)
-            {
-                //display the left image only
-                cv::imshow("CameraSimulator Color Viewer", cv_image02);
-                //give some time to draw images
-                cv::waitKey(5);
-            }
+    StreamJob publish_disparity = [&](unsigned int frame, const ros::Time & now) -> bool
+    {
+        double cv_min, cv_max = 0.0f;
 
-            cv_bridge_img.encoding = sensor_msgs::image_encodings::BGR8;
-            cv_bridge_img.header.frame_id = ros::this_node::getName();
+        // recycled disparity image message
+        MessagePool<stereo_msgs::DisparityImage>::Ptr disp_msg = disparity_pool.acquire();
 
-            if (!options.timestamps)
+        // 8 bit pre-calculated disparities, or 16 bit (kDisparityScale) computed ones
+        kitti_player::frameFilename(dir_image04, frame, ".png", full_filename_image04, frame_digits);
+        if (options.computeDisp && !kitti_player::fileExists(full_filename_image04))
+        {
+            string left = kitti_player::frameFilename(dir_image00, frame, image_extension[0].c_str(), frame_digits);
+            string right = kitti_player::frameFilename(dir_image01, frame, image_extension[1].c_str(), frame_digits);
+            if (!kitti_player::loadImage(left, cv_stereo_left, stereo_buffer[0]) ||
+                !kitti_player::loadImage(right, cv_stereo_right, stereo_buffer[1]))
             {
-                cv_bridge_img.header.stamp = current_timestamp ;
-                ros_msg02.header.stamp = ros_cameraInfoMsg_camera02.header.stamp = cv_bridge_img.header.stamp;
+                ROS_ERROR_STREAM("Error reading the stereo pair " << left << ", " << right);
+                return false;
             }
-            else
-            {
+            computeDisparity(cv_stereo_left, cv_stereo_right, cv_image04, stereo_bands, pool);
 
-                str_support = dir_timestamp_image02 + "timestamps.txt";
-                ifstream timestamps(str_support.c_str());
-                if (!timestamps.is_open())
+            // written aside, in a file of this player, and renamed: a concurrent run never loads a partial file
+            if (cache_disparities)
+            {
+                string temporary = boost::str(boost::format("%s.%d.tmp.png") % full_filename_image04 % getpid());
+                vector<int> params(1, cv::IMWRITE_PNG_COMPRESSION);
+                params.push_back(1);
+                if (!cv::imwrite(temporary, cv_image04, params) || rename(temporary.c_str(), full_filename_image04.c_str()) != 0)
                 {
-                    ROS_ERROR_STREAM("Fail to open " << timestamps);
-                    node.shutdown();
-                    return -1;
+                    ROS_WARN_STREAM("Cannot write " << full_filename_image04 << ", the next disparities are not cached");
+                    remove(temporary.c_str());
+                    cache_disparities = false;
                 }
-                timestamps.seekg(30 * entries_played);
-                getline(timestamps, str_support);
-                cv_bridge_img.header.stamp = parseTime(str_support).stamp;
-                ros_msg02.header.stamp = ros_cameraInfoMsg_camera02.header.stamp = cv_bridge_img.header.stamp;
             }
-            cv_bridge_img.image = cv_image02;
-            cv_bridge_img.toImageMsg(ros_msg02);
+        }
+        else if (!kitti_player::loadImage(full_filename_image04, cv_image04, png_buffer[4], CV_LOAD_IMAGE_ANYDEPTH))
+        {
+            ROS_ERROR_STREAM("Error reading disparity image " << full_filename_image04);
+            return false;
+        }
+        const double scale = cv_image04.depth() == CV_16U ? 1.0 / kDisparityScale : 1.0;
 
-            if (!options.timestamps)
+        if (disparity_window >= 0)
+        {
+            cv_image04.convertTo(cv_disparity_view, CV_8U, scale);
+            viewer.post(disparity_window, cv_disparity_view, frame);
+        }
+        cv::minMaxLoc(cv_image04, &cv_min, &cv_max);
+
+        disp_msg->min_disparity = cv_min * scale;
+        disp_msg->max_disparity = cv_max * scale;
+
+        disp_msg->valid_window.x_offset = 0;  // should be safe, checked!
+        disp_msg->valid_window.y_offset = 0;  // should be safe, checked!
+        disp_msg->valid_window.width    = 0;  // should be safe, checked!
+        disp_msg->valid_window.height   = 0;  // should be safe, checked!
+        disp_msg->T                     = disparity_T;
+        disp_msg->f                     = disparity_f;
+        disp_msg->delta_d               = scale;
+        disp_msg->header.stamp          = now;
+        disp_msg->header.frame_id       = ros::this_node::getName();
+        disp_msg->header.seq            = frame;
+
+        sensor_msgs::Image& dimage = disp_msg->image;
+        dimage.width  = cv_image04.size().width ;
+        dimage.height = cv_image04.size().height ;
+        dimage.encoding = sensor_msgs::image_encodings::TYPE_32FC1;
+        dimage.step = dimage.width * sizeof(float);
+        dimage.data.resize(dimage.step * dimage.height);
+        cv::Mat_<float> dmat(dimage.height, dimage.width, reinterpret_cast<float*>(&dimage.data[0]), dimage.step);
+
+        cv_image04.convertTo(dmat, dmat.type(), scale);
+
+        disp_pub.publish(disp_msg);
+        return true;
+    };
+
+    StreamJob view_disparities = [&](unsigned int frame, const ros::Time & now) -> bool
+    {
+        kitti_player::frameFilename(dir_image04, frame, ".png", full_filename_image04, frame_digits);
+        if (!kitti_player::loadImage(full_filename_image04, cv_image04, png_buffer[4], CV_LOAD_IMAGE_ANYDEPTH))
+        {
+            ROS_ERROR_STREAM("Error reading disparity image " << full_filename_image04);
+            return false;
+        }
+        cv_image04.convertTo(cv_disparity_view, CV_8U, cv_image04.depth() == CV_16U ? 1.0 / kDisparityScale : 1.0);
+        viewer.post(disparity_window, cv_disparity_view, frame);
+        return true;
+    };
+
+    // the kernel reads the next frame ahead (archive members included) while this one is published
+    auto prefetch_next = [&](const string & dir, unsigned int frame, const string & extension)
+    {
+        if (frame + 1 < total_entries)
+            kitti_player::prefetchFile(kitti_player::frameFilename(dir, frame + 1, extension.c_str(), frame_digits));
+    };
+
+    StreamJob publish_color = [&](unsigned int frame, const ros::Time & now) -> bool
+    {
+        kitti_player::frameFilename(dir_image02, frame, image_extension[2].c_str(), full_filename_image02, frame_digits);
+        kitti_player::frameFilename(dir_image03, frame, image_extension[3].c_str(), full_filename_image03, frame_digits);
+        ROS_DEBUG_STREAM ( full_filename_image02 << endl << full_filename_image03 << endl << endl);
+
+        if (!loadCachedImage(frame_cache, kitti_player::FrameCache::key(cache_drive, kitti_player::IMAGE_02, frame),
+                             full_filename_image02, cv_image02, png_buffer[2], image_view[2]) ||
+            !loadCachedImage(frame_cache, kitti_player::FrameCache::key(cache_drive, kitti_player::IMAGE_03, frame),
+                             full_filename_image03, cv_image03, png_buffer[3], image_view[3]))
+        {
+            ROS_ERROR_STREAM("Error reading color images (02 & 03)");
+            ROS_ERROR_STREAM(full_filename_image02 << endl << full_filename_image03);
+            return false;
+        }
+        prefetch_next(dir_image02, frame, image_extension[2]);
+        prefetch_next(dir_image03, frame, image_extension[3]);
+
+        //display the left image only
+        viewer.post(color_window, cv_image02, frame);
+
+        cv_bridge::CvImage cv_bridge_img;
+        cv_bridge_img.encoding = sensor_msgs::image_encodings::BGR8;
+        cv_bridge_img.header.frame_id = ros::this_node::getName();
+        cv_bridge_img.header.seq = frame;
+
+        MessagePool<sensor_msgs::Image>::Ptr msg02 = image_pool[2].acquire();
+        MessagePool<sensor_msgs::Image>::Ptr msg03 = image_pool[3].acquire();
+        MessagePool<sensor_msgs::CameraInfo>::Ptr info02 = info_pool[2].acquire();
+        MessagePool<sensor_msgs::CameraInfo>::Ptr info03 = info_pool[3].acquire();
+
+        cv_bridge_img.header.stamp = frameStamp(timestamps_image02, frame, now);
+        cv_bridge_img.image = cv_image02;
+        cv_bridge_img.toImageMsg(*msg02);
+        *info02 = ros_cameraInfoMsg_camera02;
+        info02->header.stamp = cv_bridge_img.header.stamp;
+        shm_pub[2].publish(msg02->header, cv_bridge_img.encoding, cv_image02);
+
+        cv_bridge_img.header.stamp = frameStamp(timestamps_image03, frame, now);
+        cv_bridge_img.image = cv_image03;
+        cv_bridge_img.toImageMsg(*msg03);
+        *info03 = ros_cameraInfoMsg_camera03;
+        info03->header.stamp = cv_bridge_img.header.stamp;
+        shm_pub[3].publish(msg03->header, cv_bridge_img.encoding, cv_image03);
+
+        pub02.publish(msg02, info02);
+        pub03.publish(msg03, info03);
+
+        publish_pyramid(pyramid_pub02, cv_image02, *msg02, *info02, pyramid_buffers[2], pool);
+        publish_pyramid(pyramid_pub03, cv_image03, *msg03, *info03, pyramid_buffers[3], pool);
+        return true;
+    };
+
+    StreamJob publish_grayscale = [&](unsigned int frame, const ros::Time & now) -> bool
+    {
+        kitti_player::frameFilename(dir_image00, frame, image_extension[0].c_str(), full_filename_image00, frame_digits);
+        kitti_player::frameFilename(dir_image01, frame, image_extension[1].c_str(), full_filename_image01, frame_digits);
+        ROS_DEBUG_STREAM ( full_filename_image00 << endl << full_filename_image01 << endl << endl);
+
+        if (!loadCachedImage(frame_cache, kitti_player::FrameCache::key(cache_drive, kitti_player::IMAGE_00, frame),
+                             full_filename_image00, cv_image00, png_buffer[0], image_view[0]) ||
+            !loadCachedImage(frame_cache, kitti_player::FrameCache::key(cache_drive, kitti_player::IMAGE_01, frame),
+                             full_filename_image01, cv_image01, png_buffer[1], image_view[1]))
+        {
+            ROS_ERROR_STREAM("Error reading color images (00 & 01)");
+            ROS_ERROR_STREAM(full_filename_image00 << endl << full_filename_image01);
+            return false;
+        }
+        prefetch_next(dir_image00, frame, image_extension[0]);
+        prefetch_next(dir_image01, frame, image_extension[1]);
+
+        //display the left image only
+        viewer.post(grayscale_window, cv_image00, frame);
+
+        cv_bridge::CvImage cv_bridge_img;
+        cv_bridge_img.encoding = sensor_msgs::image_encodings::MONO8;
+        cv_bridge_img.header.frame_id = ros::this_node::getName();
+        cv_bridge_img.header.seq = frame;
+
+        MessagePool<sensor_msgs::Image>::Ptr msg00 = image_pool[0].acquire();
+        MessagePool<sensor_msgs::Image>::Ptr msg01 = image_pool[1].acquire();
+        MessagePool<sensor_msgs::CameraInfo>::Ptr info00 = info_pool[0].acquire();
+        MessagePool<sensor_msgs::CameraInfo>::Ptr info01 = info_pool[1].acquire();
+
+        cv_bridge_img.header.stamp = frameStamp(timestamps_image00, frame, now);
+        cv_bridge_img.image = cv_image00;
+        cv_bridge_img.toImageMsg(*msg00);
+        *info00 = ros_cameraInfoMsg_camera00;
+        info00->header.stamp = cv_bridge_img.header.stamp;
+        shm_pub[0].publish(msg00->header, cv_bridge_img.encoding, cv_image00);
+
+        cv_bridge_img.header.stamp = frameStamp(timestamps_image01, frame, now);
+        cv_bridge_img.image = cv_image01;
+        cv_bridge_img.toImageMsg(*msg01);
+        *info01 = ros_cameraInfoMsg_camera01;
+        info01->header.stamp = cv_bridge_img.header.stamp;
+        shm_pub[1].publish(msg01->header, cv_bridge_img.encoding, cv_image01);
+
+        pub00.publish(msg00, info00);
+        pub01.publish(msg01, info01);
+
+        publish_pyramid(pyramid_pub00, cv_image00, *msg00, *info00, pyramid_buffers[0], pool);
+        publish_pyramid(pyramid_pub01, cv_image01, *msg01, *info01, pyramid_buffers[1], pool);
+        return true;
+    };
+
+    StreamJob publish_velodyne_scan = [&](unsigned int frame, const ros::Time & now) -> bool
+    {
+        std_msgs::Header header;
+        header.stamp = frameStamp(timestamps_velodyne, frame, now);
+        header.seq = frame;
+        kitti_player::frameFilename(dir_velodyne_points, frame, velodyne_extension.c_str(), full_filename_velodyne, frame_digits);
+
+        kitti_player::VelodyneScan scan;
+        if (!loadCachedScan(frame_cache, kitti_player::FrameCache::key(cache_drive, kitti_player::VELODYNE_POINTS, frame),
+                            full_filename_velodyne, scan, velodyne_buffer))
+        {
+            ROS_ERROR_STREAM("Could not read file: " << full_filename_velodyne);
+            return true;
+        }
+        prefetch_next(dir_velodyne_points, frame, velodyne_extension);
+
+        if (options.deskew && oxts_entries > 0)
+        {
+            // the oxts packet of the scan: same index, or the closest in time if unsynced
+            unsigned int oxts_frame = frame;
+            if (options.unsynced)
+                oxts_frame = min<size_t>(lower_bound(timestamps_oxts.begin(), timestamps_oxts.end(), header.stamp) - timestamps_oxts.begin(),
+                                         oxts_entries - 1);
+
+            kitti_player::OxtsPacket oxts;
+            string full_filename_oxts = kitti_player::frameFilename(dir_oxts, oxts_frame, ".txt");
+            if (kitti_player::loadOxtsPacket(full_filename_oxts, oxts))
             {
-                cv_bridge_img.header.stamp = current_timestamp;
-                ros_msg03.header.stamp = ros_cameraInfoMsg_camera03.header.stamp = cv_bridge_img.header.stamp;
+                // in place, in the reading buffer
+                EgoMotion motion;
+                getVelodyneMotion(oxts, R_imu_to_velo, T_imu_to_velo, motion);
+                deskewScan(scan.data(), scan.size(), motion, 0.1f, pool);
             }
             else
-            {
+                ROS_ERROR_STREAM("Fail to read " << full_filename_oxts);
+        }
 
-                str_support = dir_timestamp_image03 + "timestamps.txt";
-                ifstream timestamps(str_support.c_str());
-                if (!timestamps.is_open())
-                {
-                    ROS_ERROR_STREAM("Fail to open " << timestamps);
-                    node.shutdown();
-                    return -1;
-                }
-                timestamps.seekg(30 * entries_played);
-                getline(timestamps, str_support);
-                cv_bridge_img.header.stamp = parseTime(str_support).stamp;
-                ros_msg03.header.stamp = ros_cameraInfoMsg_camera03.header.stamp = cv_bridge_img.header.stamp;
+        // --profile times the full cloud, with or without subscribers
+        if (options.profile || map_pub.getNumSubscribers() > 0)
+            publish_velodyne(map_pub, scan, &header, velodyne_pool);
+        shm_pub[4].publish(header, scan);
+        if (crop && cropped_pub.getNumSubscribers() > 0)
+            publish_velodyne_cropped(cropped_pub, scan, crop_region, &header, pool, crop_blocks, cropped_pool);
+        if (options.voxelLeaf > 0.0f && voxel_pub.getNumSubscribers() > 0)
+            publish_velodyne_voxel(voxel_pub, scan, options.voxelLeaf, &header, pool, voxel_grid, voxel_pool);
+        if (options.compactError > 0.0f && compact_pub.getNumSubscribers() > 0)
+            publish_velodyne_compact(compact_pub, scan, compact_scale, &header, pool, compact_pool);
+        if (options.rangeImageCols > 0 && range_pub.getNumSubscribers() > 0)
+            publish_range_image(range_pub, scan, options.rangeImageCols, &header, pool, range_projection, range_pool);
+        return true;
+    };
+
+    StreamJob publish_tracklets = [&](unsigned int frame, const ros::Time & now) -> bool
+    {
+        // same stamp and frame as the hdl64e scan
+        std_msgs::Header header;
+        header.stamp = frameStamp(timestamps_velodyne, frame, now);
+        header.seq = frame;
+        header.frame_id = "base_link";
+        tracklet_pub.publish(frame, header);
+        return true;
+    };
+
+    StreamJob publish_gps = [&](unsigned int frame, const ros::Time & now) -> bool
+    {
+        std_msgs::Header header;
+        header.stamp = frameStamp(timestamps_oxts, frame, now);
+        header.seq = frame;
+
+        kitti_player::OxtsPacket oxts;
+        string full_filename_oxts = kitti_player::frameFilename(dir_oxts, frame, ".txt");
+        if (!kitti_player::loadOxtsPacket(full_filename_oxts, oxts))
+        {
+            ROS_ERROR_STREAM("Fail to open " << full_filename_oxts);
+            return false;
+        }
+        getGPS(oxts, &ros_msgGpsFix, &header);
+
+        if (firstGpsData)
+        {
+            // this refs to BUG #551 - If a starting frame is specified, a wrong
+            // initial-gps-fix is taken. Fixing this issue forcing filename to
+            // 0000000001.txt
+            // The FULL dataset should be always downloaded.
+            full_filename_oxts = dir_oxts + "0000000001.txt";
+            if (!kitti_player::loadOxtsPacket(full_filename_oxts, oxts))
+            {
+                ROS_ERROR_STREAM("Fail to open " << full_filename_oxts);
+                return false;
             }
+            getGPS(oxts, &ros_msgGpsFixInitial, &header);
+            ROS_DEBUG_STREAM("Setting initial GPS fix at " << endl << ros_msgGpsFixInitial);
+            firstGpsData = false;
+            ros_msgGpsFixInitial.header.frame_id = "/local_map";
+            ros_msgGpsFixInitial.altitude = 0.0f;
+        }
 
-            cv_bridge_img.image = cv_image03;
-            cv_bridge_img.toImageMsg(ros_msg03);
+        gps_pub.publish(ros_msgGpsFix);
+        gps_pub_initial.publish(ros_msgGpsFixInitial);
 
-            pub02.publish(ros_msg02, ros_cameraInfoMsg_camera02);
-            pub03.publish(ros_msg03, ros_cameraInfoMsg_camera03);
+        // this refs #522 - adding GPS-RTK Markers (published RVIZ markers)
+        if (options.gpsReferenceFrame.length() > 1 && frame < trajectory.size())
+            gps_trail.add(trajectory.x[frame], trajectory.y[frame], now, publisher_GT_RTK);
 
+        return true;
+    };
+
+    StreamJob publish_imu = [&](unsigned int frame, const ros::Time & now) -> bool
+    {
+        std_msgs::Header header;
+        header.stamp = frameStamp(timestamps_oxts, frame, now);
+        header.seq = frame;
+
+        kitti_player::OxtsPacket oxts;
+        string full_filename_oxts = kitti_player::frameFilename(dir_oxts, frame, ".txt");
+        if (!kitti_player::loadOxtsPacket(full_filename_oxts, oxts))
+        {
+            ROS_ERROR_STREAM("Fail to open " << full_filename_oxts);
+            return false;
         }
+        getIMU(oxts, &ros_msgImu, &header);
+        imu_pub.publish(ros_msgImu);
+        return true;
+    };
 
+    StreamJob publish_pose = [&](unsigned int frame, const ros::Time & now) -> bool
+    {
+        if (frame >= trajectory.size())
+            return true;
+
+        ros::Time stamp = frameStamp(timestamps_oxts, frame, now);
+
+        const tf::Transform &pose = trajectory.pose[frame];
+        tf_broadcaster.sendTransform(tf::StampedTransform(pose, stamp, "world", "base_link"));
+
+        geometry_msgs::PoseStamped ros_msgPose;
+        ros_msgPose.header.frame_id = "world";
+        ros_msgPose.header.stamp = stamp;
+        ros_msgPose.header.seq = frame;
+        tf::poseTFToMsg(pose, ros_msgPose.pose);
+        pose_pub.publish(ros_msgPose);
+        return true;
+    };
+
+    // live control of rate, pause and single step; starts from the command line values
+    dynamic_reconfigure::Server<kitti_player::kitti_playerConfig> reconfigure_server;
+    kitti_player::kitti_playerConfig config = kitti_player::kitti_playerConfig::__getDefault__();
+    config.loop_rate = control.loop_rate = options.frequency;
+    config.start = true;
+    config.publish = false;
+    config.continuous = false;
+    reconfigure_server.updateConfig(config);
+    reconfigure_server.setCallback(boost::bind(&reconfigureCallback, _1, _2));
+    control.rate_changed = false;
+
+    if (options.unsynced)
+    {
+        // Every stream gets its own thread, index and timestamp table; a single
+        // PlaybackClock keeps them aligned. -f 10 is real time.
+        vector<PlaybackStream> streams;
+        PlaybackStream stream;
+        if (options.color || options.all_data)
+        {
+            stream.name = "color";
+            stream.timestamps = &timestamps_image02;
+            stream.entries = min<size_t>(kitti_player::countFiles(dir_image02), timestamps_image02.size());
+            stream.job = publish_color;
+            streams.push_back(stream);
+        }
         if (options.grayscale || options.all_data)
         {
-            full_filename_image00 = dir_image00 + boost::str(boost::format("%010d") % entries_played ) + ".png";
-            full_filename_image01 = dir_image01 + boost::str(boost::format("%010d") % entries_played ) + ".png";
-            ROS_DEBUG_STREAM ( full_filename_image00 << endl << full_filename_image01 << endl << endl);
+            stream.name = "grayscale";
+            stream.timestamps = &timestamps_image00;
+            stream.entries = min<size_t>(kitti_player::countFiles(dir_image00), timestamps_image00.size());
+            stream.job = publish_grayscale;
+            streams.push_back(stream);
+        }
+        if (options.velodyne || options.all_data)
+        {
+            stream.name = "velodyne";
+            stream.timestamps = &timestamps_velodyne;
+            stream.entries = min<size_t>(kitti_player::countFiles(dir_velodyne_points), timestamps_velodyne.size());
+            stream.job = publish_velodyne_scan;
+            streams.push_back(stream);
+        }
+        if (options.gps || options.all_data)
+        {
+            stream.name = "gps";
+            stream.timestamps = &timestamps_oxts;
+            stream.entries = oxts_entries;
+            stream.job = publish_gps;
+            streams.push_back(stream);
+        }
+        if (options.imu || options.all_data)
+        {
+            stream.name = "imu";
+            stream.timestamps = &timestamps_oxts;
+            stream.entries = oxts_entries;
+            stream.job = publish_imu;
+            streams.push_back(stream);
+        }
+        if (options.sendTransform)
+        {
+            stream.name = "pose";
+            stream.timestamps = &timestamps_oxts;
+            stream.entries = oxts_entries;
+            stream.job = publish_pose;
+            streams.push_back(stream);
+        }
 
-            cv_image00 = cv::imread(full_filename_image00, CV_LOAD_IMAGE_UNCHANGED);
-            cv_image01 = cv::imread(full_filename_image01, CV_LOAD_IMAGE_UNCHANGED);
+        // the start frame refers to the first enabled stream
+        if (streams.empty() || options.startFrame >= streams[0].entries)
+        {
+            ROS_ERROR("Error, start number > total entries in the dataset");
+            node.shutdown();
+            return -1;
+        }
+        ros::Time start = (*streams[0].timestamps)[options.startFrame];
+        double speed = options.frequency / 10.0;
+        if (options.clock)
+        {
+            if (options.clockSpeed <= 0.0)
+                ROS_WARN_STREAM("Unsynced streams cannot run as fast as possible, playing in real time");
+            speed = options.clockSpeed > 0.0 ? options.clockSpeed : 1.0;
+        }
+        PlaybackClock clock(start, speed);
+        boost::shared_ptr<ClockPublisher> clock_pub;
+        if (options.clock)
+            clock_pub.reset(new ClockPublisher(node, 0.0));
 
-            if ( (cv_image00.data == NULL) || (cv_image01.data == NULL) )
-            {
-                ROS_ERROR_STREAM("Error reading color images (00 & 01)");
-                ROS_ERROR_STREAM(full_filename_image00 << endl << full_filename_image01);
-                node.shutdown();
-                return -1;
-            }
+        for (size_t i = 0; i < streams.size(); i++)
+        {
+            streams[i].cpu = stream_cpus.empty() ? -1 : stream_cpus[i % stream_cpus.size()];
+            streams[i].priority = options.realtime;
+        }
 
-            if (options.viewer)
+        std::atomic<unsigned int> finished(0);
+        boost::thread_group threads;
+        for (size_t i = 0; i < streams.size(); i++)
+            threads.create_thread(boost::bind(&playStream, boost::ref(streams[i]), boost::cref(clock), start, &finished));
+
+        while (finished < streams.size() && ros::ok())
+        {
+            // live control: the streams follow the shared clock (loop_rate 10 = real time)
+            if (control.rate_changed && !options.clock)
+                clock.setSpeed(control.loop_rate / 10.0);
+            control.rate_changed = false;
+            clock.setPaused(!control.playing);
+            if (control.step)
             {
-                //display the left image only
-                cv::imshow("CameraSimulator Grayscale Viewer", cv_image00);
-                //give some time to draw images
-                cv::waitKey(5);
+                clock.step(ros::Duration(0.1)); // one camera frame
+                control.step = false;
             }
 
-            cv_bridge_img.encoding = sensor_msgs::image_encodings::MONO8;
-            cv_bridge_img.header.frame_id = ros::this_node::getName();
+            if (clock_pub)
+                clock_pub->publish(clock.now());
+            ros::spinOnce();
+            ros::WallDuration(0.01).sleep();
+        }
+        threads.join_all();
 
-            if (!options.timestamps)
+        for (size_t i = 0; i < streams.size(); i++)
+        {
+            if (!streams[i].ok)
             {
-                cv_bridge_img.header.stamp = current_timestamp;
-                ros_msg00.header.stamp = ros_cameraInfoMsg_camera00.header.stamp = cv_bridge_img.header.stamp;
+                node.shutdown();
+                return -1;
             }
-            else
-            {
+        }
+    }
+    else
+    {
+        // Synced drives: all the streams share the frame index, in this order
+        vector<StreamJob> jobs;
+        vector<string> job_names;
+        if (options.stereoDisp)
+        {
+            jobs.push_back(publish_disparity);
+            job_names.push_back("disparity");
+        }
+        else if (options.viewDisparities)
+        {
+            // publish_disparity shows the disparities it loads
+            jobs.push_back(view_disparities);
+            job_names.push_back("disparity viewer");
+        }
+        if (options.color || options.all_data)
+        {
+            jobs.push_back(publish_color);
+            job_names.push_back("color");
+        }
+        if (options.grayscale || options.all_data)
+        {
+            jobs.push_back(publish_grayscale);
+            job_names.push_back("grayscale");
+        }
+        if (options.velodyne || options.all_data)
+        {
+            jobs.push_back(publish_velodyne_scan);
+            job_names.push_back("velodyne");
+        }
+        if (options.tracklets)
+        {
+            jobs.push_back(publish_tracklets);
+            job_names.push_back("tracklets");
+        }
+        if (options.gps || options.all_data)
+        {
+            jobs.push_back(publish_gps);
+            job_names.push_back("gps");
+        }
+        if (options.imu || options.all_data)
+        {
+            jobs.push_back(publish_imu);
+            job_names.push_back("imu");
+        }
+        if (options.sendTransform)
+        {
+            jobs.push_back(publish_pose);
+            job_names.push_back("pose");
+        }
 
-                str_support = dir_timestamp_image02 + "timestamps.txt";
-                ifstream timestamps(str_support.c_str());
-                if (!timestamps.is_open())
-                {
-                    ROS_ERROR_STREAM("Fail to open " << timestamps);
-                    node.shutdown();
-                    return -1;
-                }
-                timestamps.seekg(30 * entries_played);
-                getline(timestamps, str_support);
-                cv_bridge_img.header.stamp = parseTime(str_support).stamp;
-                ros_msg00.header.stamp = ros_cameraInfoMsg_camera00.header.stamp = cv_bridge_img.header.stamp;
-            }
-            cv_bridge_img.image = cv_image00;
-            cv_bridge_img.toImageMsg(ros_msg00);
+        // --profile times every stream; the baseline is kept per combination of streams
+        string combination;
+        for (size_t j = 0; j < job_names.size(); j++)
+            combination += (j > 0 ? "+" : "") + job_names[j];
+        if (options.timestamps)
+            combination += "+timestamps";
+        ThroughputProfile profile(combination);
+        if (options.profile)
+        {
+            for (size_t j = 0; j < jobs.size(); j++)
+                jobs[j] = profile.wrap(job_names[j], jobs[j]);
+        }
 
-            if (!options.timestamps)
-            {
-                cv_bridge_img.header.stamp = current_timestamp;
-                ros_msg01.header.stamp = ros_cameraInfoMsg_camera01.header.stamp = cv_bridge_img.header.stamp;
-            }
-            else
+        // with --streamThreads the streams publish in parallel, frame by frame
+        StreamThreads stream_threads;
+        if (options.streamThreads)
+        {
+            stream_threads.start(jobs, [&stream_cpus, &options, job_names](size_t index)
             {
+                tuneThread(job_names[index], stream_cpus.empty() ? -1 : stream_cpus[index % stream_cpus.size()], options.realtime);
+            });
+        }
+        else if (!stream_cpus.empty() || options.realtime > 0)
+            tuneThread("main", stream_cpus.empty() ? -1 : stream_cpus[0], options.realtime);
 
-                str_support = dir_timestamp_image02 + "timestamps.txt";
-                ifstream timestamps(str_support.c_str());
-                if (!timestamps.is_open())
-                {
-                    ROS_ERROR_STREAM("Fail to open " << timestamps);
-                    node.shutdown();
-                    return -1;
-                }
-                timestamps.seekg(30 * entries_played);
-                getline(timestamps, str_support);
-                cv_bridge_img.header.stamp = parseTime(str_support).stamp;
-                ros_msg01.header.stamp = ros_cameraInfoMsg_camera01.header.stamp = cv_bridge_img.header.stamp;
+        // simulated time follows the first stream with timestamps
+        const vector<ros::Time> *clock_timestamps = NULL;
+        boost::shared_ptr<ClockPublisher> clock_pub;
+        if (options.clock)
+        {
+            const vector<ros::Time> *tables[] = { &timestamps_image02, &timestamps_image00, &timestamps_velodyne, &timestamps_oxts };
+            for (int t = 0; t < 4 && clock_timestamps == NULL; t++)
+                if (tables[t]->size() >= total_entries)
+                    clock_timestamps = tables[t];
+            if (clock_timestamps == NULL)
+            {
+                ROS_ERROR_STREAM("No timestamps to drive /clock, enable a camera, velodyne or oxts stream");
+                node.shutdown();
+                return -1;
             }
-            cv_bridge_img.image = cv_image01;
-            cv_bridge_img.toImageMsg(ros_msg01);
+            clock_pub.reset(new ClockPublisher(node, options.clockSpeed));
+        }
 
-            pub00.publish(ros_msg00, ros_cameraInfoMsg_camera00);
-            pub01.publish(ros_msg01, ros_cameraInfoMsg_camera01);
+        boost::shared_ptr<AdaptiveRate> adaptive;
+        if (options.adaptive)
+            adaptive.reset(new AdaptiveRate(node, options.frequency, options.minRate, options.maxRate, options.targetLag));
 
-        }
+        boost::progress_display progress(total_entries) ;
 
-        if (options.velodyne || options.all_data)
+        // -f 0: as fast as the streams go, until the rate is set live
+        bool unlimited = options.frequency <= 0.0;
+        if (options.profile)
+            profile.start();
+
+        // This is the main KITTI_PLAYER Loop
+        do
         {
-            header_support.stamp = current_timestamp;
-            full_filename_velodyne = dir_velodyne_points + boost::str(boost::format("%010d") % entries_played ) + ".bin";
+            // live control from dynamic_reconfigure
+            if (!control.playing && !control.step)
+            {
+                ros::spinOnce();
+                ros::WallDuration(0.01).sleep();
+                continue;
+            }
+            bool stepping = control.step;
+            control.step = false;
+            if (control.rate_changed && control.loop_rate > 0.0)
+            {
+                loop_rate = ros::Rate(control.loop_rate);
+                unlimited = false;
+            }
+            control.rate_changed = false;
 
-            if (!options.timestamps)
-                publish_velodyne(map_pub, full_filename_velodyne, &header_support);
-            else
+            // wait for the consumers to keep up, then follow their pace
+            double adaptive_rate;
+            if (adaptive && control.playing && !stepping)
             {
-                str_support = dir_timestamp_velodyne + "timestamps.txt";
-                ifstream timestamps(str_support.c_str());
-                if (!timestamps.is_open())
+                if (!adaptive->waitFor(entries_played))
+                    break;
+                if (adaptive->rateChanged(adaptive_rate))
                 {
-                    ROS_ERROR_STREAM("Fail to open " << timestamps);
-                    node.shutdown();
-                    return -1;
+                    loop_rate = ros::Rate(adaptive_rate);
+                    unlimited = false;
                 }
-                timestamps.seekg(30 * entries_played);
-                getline(timestamps, str_support);
-                header_support.stamp = parseTime(str_support).stamp;
-                publish_velodyne(map_pub, full_filename_velodyne, &header_support);
             }
 
-
-        }
-
-        if (options.gps || options.all_data)
-        {
-            header_support.stamp = current_timestamp; //ros::Time::now();
-            if (options.timestamps)
+            // this refs #600 synchMode
+            if (options.synchMode && !control.continuous && !stepping)
             {
-                str_support = dir_timestamp_oxts + "timestamps.txt";
-                ifstream timestamps(str_support.c_str());
-                if (!timestamps.is_open())
+                if (waitSynch == true)
                 {
-                    ROS_ERROR_STREAM("Fail to open " << timestamps);
-                    node.shutdown();
-                    return -1;
+                    //ROS_DEBUG_STREAM("Waiting for synch...");
+                    ros::spinOnce();
+                    continue;
+                }
+                else
+                {
+                    ROS_DEBUG_STREAM("Run after received synch...");
+                    waitSynch = true;
                 }
-                timestamps.seekg(30 * entries_played);
-                getline(timestamps, str_support);
-                header_support.stamp = parseTime(str_support).stamp;
             }
 
-            full_filename_oxts = dir_oxts + boost::str(boost::format("%010d") % entries_played ) + ".txt";
-            if (!getGPS(full_filename_oxts, &ros_msgGpsFix, &header_support))
+            // single timestamp for all published stuff
+            Time current_timestamp = ros::Time::now();
+            if (clock_pub)
             {
-                ROS_ERROR_STREAM("Fail to open " << full_filename_oxts);
-                node.shutdown();
-                return -1;
+                current_timestamp = (*clock_timestamps)[entries_played];
+                if (!clock_pub->advanceTo(current_timestamp))
+                    break;
             }
 
-            if (firstGpsData)
+            bool frame_ok = true;
+            if (options.streamThreads)
+                frame_ok = stream_threads.run(entries_played, current_timestamp);
+            else
             {
-                // this refs to BUG #551 - If a starting frame is specified, a wrong
-                // initial-gps-fix is taken. Fixing this issue forcing filename to
-                // 0000000001.txt
-                // The FULL dataset should be always downloaded.
-                full_filename_oxts = dir_oxts + "0000000001.txt";
-                if (!getGPS(full_filename_oxts, &ros_msgGpsFix, &header_support))
-                {
-                    ROS_ERROR_STREAM("Fail to open " << full_filename_oxts);
-                    node.shutdown();
-                    return -1;
-                }
-                ROS_DEBUG_STREAM("Setting initial GPS fix at " << endl << ros_msgGpsFix);
-                firstGpsData = false;
-                ros_msgGpsFixInitial = ros_msgGpsFix;
-                ros_msgGpsFixInitial.header.frame_id = "/local_map";
-                ros_msgGpsFixInitial.altitude = 0.0f;
+                for (size_t j = 0; j < jobs.size() && frame_ok; j++)
+                    frame_ok = jobs[j](entries_played, current_timestamp);
             }
-
-            gps_pub.publish(ros_msgGpsFix);
-            gps_pub_initial.publish(ros_msgGpsFixInitial);
-
-            // this refs #522 - adding GPS-RTK Markers (published RVIZ markers)
-            if (options.gpsReferenceFrame.length() > 1)
+            if (!frame_ok)
             {
+                node.shutdown();
+                return -1;
+            }
 
-                Xy xyFromLatLon;
-                xyFromLatLon = latlon2xy_helper(ros_msgGpsFix.latitude, ros_msgGpsFix.longitude);
-
-                static visualization_msgs::MarkerArray marker_array_GT_RTK;
-                visualization_msgs::Marker RTK_MARKER;
-
-                static int gps_track = 1;
-                RTK_MARKER.header.frame_id = options.gpsReferenceFrame;
-                RTK_MARKER.header.stamp = current_timestamp;
-                RTK_MARKER.ns = "RTK_MARKER";
-                RTK_MARKER.id = gps_track++; //unused
-                RTK_MARKER.type = visualization_msgs::Marker::CYLINDER;
-                RTK_MARKER.action = visualization_msgs::Marker::ADD;
-                RTK_MARKER.pose.orientation.w = 1;
-                RTK_MARKER.scale.x = 0.5;
-                RTK_MARKER.scale.y = 0.5;
-                RTK_MARKER.scale.z = 3.5;
-                RTK_MARKER.color.a = 0.80;
-                RTK_MARKER.color.r = 0;
-                RTK_MARKER.color.g = 0.0;
-                RTK_MARKER.color.b = 1.0;
-                RTK_MARKER.pose.position.x = xyFromLatLon.x;
-                RTK_MARKER.pose.position.y = xyFromLatLon.y;
-                RTK_MARKER.pose.position.z = 0;
-
-                ROS_DEBUG_STREAM(RTK_MARKER.pose.position.x << "\t" << RTK_MARKER.pose.position.y);
-
-                marker_array_GT_RTK.markers.push_back(RTK_MARKER);
-
-                // Push back line_list
-                publisher_GT_RTK.publish(marker_array_GT_RTK);
+            ++progress;
+            entries_played++;
+            if (options.profile)
+                profile.frame();
 
-            }
+            // serve the callbacks (e.g. GPS trail snapshot for new RVIZ subscribers)
+            ros::spinOnce();
+
+            if ((!options.synchMode || control.continuous) && !clock_pub && control.playing && !unlimited)
+                loop_rate.sleep();
         }
+        while (entries_played <= total_entries - 1 && ros::ok());
 
-        if (options.imu || options.all_data)
+        if (options.profile)
         {
-            header_support.stamp = current_timestamp; //ros::Time::now();
-            if (options.timestamps)
+            profile.stop();
+            std::ostringstream report;
+            profile.report(report);
+            ROS_INFO_STREAM(report.str());
+
+            if (!options.baseline.empty())
             {
-                str_support = dir_timestamp_oxts + "timestamps.txt";
-                ifstream timestamps(str_support.c_str());
-                if (!timestamps.is_open())
+                std::ostringstream comparison;
+                if (!profile.check(options.baseline, options.tolerance, options.recordBaseline, comparison))
                 {
-                    ROS_ERROR_STREAM("Fail to open " << timestamps);
+                    ROS_ERROR_STREAM("Throughput regression wrt " << options.baseline << " (tolerance " << options.tolerance << ")"
+                                     << endl << comparison.str());
                     node.shutdown();
                     return -1;
                 }
-                timestamps.seekg(30 * entries_played);
-                getline(timestamps, str_support);
-                header_support.stamp = parseTime(str_support).stamp;
+                ROS_INFO_STREAM(comparison.str());
             }
-
-
-            full_filename_oxts = dir_oxts + boost::str(boost::format("%010d") % entries_played ) + ".txt";
-            if (!getIMU(full_filename_oxts, &ros_msgImu, &header_support))
-            {
-                ROS_ERROR_STREAM("Fail to open " << full_filename_oxts);
-                node.shutdown();
-                return -1;
-            }
-            imu_pub.publish(ros_msgImu);
-
         }
-
-        ++progress;
-        entries_played++;
-
-        if (!options.synchMode)
-            loop_rate.sleep();
     }
-    while (entries_played <= total_entries - 1 && ros::ok());
 
 
-    if (options.viewer)
+    if (options.viewer || options.viewDisparities)
     {
         ROS_INFO_STREAM(" Closing CV viewer(s)");
-        if (options.color || options.all_data)
-            cv::destroyWindow("CameraSimulator Color Viewer");
-        if (options.grayscale || options.all_data)
-            cv::destroyWindow("CameraSimulator Grayscale Viewer");
-        if (options.viewDisparities)
-            cv::destroyWindow("Reprojection of Detected Lines");
-        ROS_INFO_STREAM(" Closing CV viewer(s)... OK");
+        viewer.stop();
+        ROS_INFO_STREAM(" Closing CV viewer(s)... OK, " << viewer.dropped() << " frames not shown");
     }
 
 
@@ -0,0 +1,855 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * kitti_reader: ROS-free loaders for KITTI raw drives.
+ */
+
+#include <kitti_player/image_codec.h>
+#include <kitti_player/kitti_reader.h>
+#include <kitti_player/velodyne_codec.h>
+#include <kitti_player/zip_archive.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+using namespace std;
+
+namespace kitti_player
+{
+
+namespace
+{
+
+/// frees a memory mapped scan
+struct Unmapper
+{
+    size_t bytes;
+
+    void operator()(void *base) const
+    {
+        munmap(base, bytes);
+    }
+};
+
+/// reads count numbers following the "name:" key of a calibration line
+bool parseCalibrationLine(const string &line, const string &key, double *values, size_t count)
+{
+    if (line.compare(0, key.size(), key) != 0)
+        return false;
+
+    istringstream tokens(line.substr(key.size()));
+    for (size_t i = 0; i < count && (tokens >> values[i]); i++)
+        ;
+    return true;
+}
+
+/// appends the numbers of a text file content, whatever the separators; buffer gets a terminating 0
+void parseNumbers(vector<uint8_t> &buffer, vector<double> &values)
+{
+    buffer.push_back('\0');
+    const char *next = reinterpret_cast<const char*>(buffer.data());
+    for (;;)
+    {
+        char *end;
+        double value = strtod(next, &end);
+        if (end == next)
+            break;
+        values.push_back(value);
+        next = end;
+    }
+}
+
+const unsigned int kNotLoading = 0xffffffffu;
+
+/// member of the mounted archive holding filename; NULL (and archive NULL) if filename is not in a mounted archive
+const ZipArchive::Member *findMember(const string &filename, boost::shared_ptr<const ZipArchive> &archive)
+{
+    string member;
+    archive = findMounted(filename, member);
+    return archive ? archive->find(member) : NULL;
+}
+
+/// opens a text file of the filesystem or of a mounted archive, NULL if missing
+boost::shared_ptr<istream> openText(const string &filename)
+{
+    string member;
+    if (!findMounted(filename, member))
+    {
+        boost::shared_ptr<ifstream> file(new ifstream(filename.c_str()));
+        return file->is_open() ? file : boost::shared_ptr<istream>();
+    }
+
+    vector<uint8_t> buffer;
+    if (!readFile(filename, buffer))
+        return boost::shared_ptr<istream>();
+    return boost::shared_ptr<istream>(new istringstream(string(buffer.begin(), buffer.end())));
+}
+
+/// calibration file of a drive: in the drive directory, or in the day directory above it (KITTI layout)
+string calibrationFile(const string &dir_root, const string &name)
+{
+    if (fileExists(dir_root + name) || dir_root.size() < 2)
+        return dir_root + name;
+    size_t slash = dir_root.find_last_of('/', dir_root.size() - 2);
+    return (slash == string::npos ? string() : dir_root.substr(0, slash + 1)) + name;
+}
+
+bool hasExtension(const string &filename, const char *extension)
+{
+    size_t length = strlen(extension);
+    return filename.size() > length && filename.compare(filename.size() - length, length, extension) == 0;
+}
+
+/// encoded file and inflate buffers of the .kvc scans, one set per thread
+struct KvcBuffers
+{
+    vector<uint8_t> file;
+    vector<uint8_t> scratch;
+};
+
+KvcBuffers &kvcBuffers()
+{
+    static thread_local KvcBuffers buffers;
+    return buffers;
+}
+
+} // namespace
+
+int parseTimestamp(const string &line, Timestamp &stamp)
+{
+    // example: 2011-09-26 13:21:35.134391552
+    //          01234567891111111111222222222
+    //                    0123456789012345678
+    if (line.length() < 19 || line[4] != '-' || line[7] != '-' || line[13] != ':' || line[16] != ':')
+        return 0;
+
+    const char *s = line.c_str();
+    struct tm t = {0};  // Initalize to all 0's
+    t.tm_year = atoi(s + 0) - 1900;
+    t.tm_mon  = atoi(s + 5) - 1;
+    t.tm_mday = atoi(s + 8);
+    t.tm_hour = atoi(s + 11);
+    t.tm_min  = atoi(s + 14);
+    t.tm_sec  = atoi(s + 17);
+    t.tm_isdst = -1;
+    stamp.sec = mktime(&t);
+
+    // fraction of second, up to nanoseconds
+    stamp.nsec = 0;
+    unsigned int digits = 0;
+    if (line.length() > 20 && line[19] == '.')
+    {
+        for (size_t i = 20; i < line.length() && digits < 9 && line[i] >= '0' && line[i] <= '9'; i++, digits++)
+            stamp.nsec = 10 * stamp.nsec + (line[i] - '0');
+    }
+    for (; digits < 9; digits++)
+        stamp.nsec *= 10;
+
+    return 1;
+}
+
+int loadTimestamps(const string &filename, vector<Timestamp> &timestamps)
+{
+    boost::shared_ptr<istream> file = openText(filename);
+    if (!file)
+        return 0;
+
+    timestamps.clear();
+    string line = "";
+    Timestamp stamp;
+    while (getline(*file, line))
+    {
+        if (parseTimestamp(line, stamp))
+            timestamps.push_back(stamp);
+    }
+    return 1;
+}
+
+unsigned int countFiles(const string &dir)
+{
+    string member;
+    boost::shared_ptr<const ZipArchive> archive = findMounted(dir, member);
+    if (archive)
+        return archive->countFiles(member);
+
+    unsigned int entries = 0;
+    DIR *d = opendir(dir.c_str());
+    if (d == NULL)
+        return 0;
+
+    struct dirent *ent;
+    while ((ent = readdir(d)))
+    {
+        //skip . & ..
+        if (strlen(ent->d_name) > 2)
+            entries++;
+    }
+    closedir(d);
+    return entries;
+}
+
+bool isDirectory(const string &dir)
+{
+    string member;
+    if (findMounted(dir, member))
+        return member.empty() || member[member.size() - 1] == '/';
+
+    struct stat st;
+    return stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool fileExists(const string &filename)
+{
+    string member;
+    boost::shared_ptr<const ZipArchive> archive = findMounted(filename, member);
+    if (archive)
+        return archive->find(member) != NULL;
+
+    struct stat st;
+    return stat(filename.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+int readFile(const string &filename, vector<uint8_t> &buffer)
+{
+    boost::shared_ptr<const ZipArchive> archive;
+    const ZipArchive::Member *entry = findMember(filename, archive);
+    if (archive)
+    {
+        if (entry == NULL || entry->size == 0)
+            return 0;
+        buffer.resize(entry->size);
+        return archive->read(*entry, buffer.data());
+    }
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return 0;
+    }
+    buffer.resize(st.st_size);
+    ssize_t got = pread(fd, buffer.data(), buffer.size(), 0);
+    ::close(fd);
+    return got == ssize_t(buffer.size());
+}
+
+void prefetchFile(const string &filename)
+{
+    boost::shared_ptr<const ZipArchive> archive;
+    const ZipArchive::Member *entry = findMember(filename, archive);
+    if (archive)
+    {
+        if (entry != NULL)
+            archive->prefetch(*entry);
+        return;
+    }
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    ::close(fd);
+}
+
+string frameFilename(const string &dir, unsigned int frame, const char *extension, unsigned int digits)
+{
+    string filename;
+    frameFilename(dir, frame, extension, filename, digits);
+    return filename;
+}
+
+void frameFilename(const string &dir, unsigned int frame, const char *extension, string &filename, unsigned int digits)
+{
+    char number[16];
+    snprintf(number, sizeof(number), "%0*u", int(digits), frame);
+    filename.assign(dir).append(number).append(extension);
+}
+
+CameraCalibration::CameraCalibration()
+{
+    fill(K, K + 9, 0.0);
+    fill(D, D + 5, 0.0);
+    fill(R, R + 9, 0.0);
+    fill(P, P + 12, 0.0);
+    fill(R_rect, R_rect + 9, 0.0);
+    fill(S_rect, S_rect + 2, 0.0);
+}
+
+int loadCameraCalibration(const string &dir_root, const string &camera_name, CameraCalibration &calibration)
+{
+    boost::shared_ptr<istream> file_c2c = openText(calibrationFile(dir_root, "calib_cam_to_cam.txt"));
+    if (!file_c2c)
+        return 0;
+
+    string line = "";
+    while (getline(*file_c2c, line))
+    {
+        parseCalibrationLine(line, "K_" + camera_name + ":", calibration.K, 9) ||
+        parseCalibrationLine(line, "D_" + camera_name + ":", calibration.D, 5) ||
+        parseCalibrationLine(line, "R_" + camera_name + ":", calibration.R, 9) ||
+        parseCalibrationLine(line, "P_rect_" + camera_name + ":", calibration.P, 12) ||
+        parseCalibrationLine(line, "R_rect_" + camera_name + ":", calibration.R_rect, 9) ||
+        parseCalibrationLine(line, "S_rect_" + camera_name + ":", calibration.S_rect, 2);
+    }
+    return 1;
+}
+
+int loadImuToVelo(const string &dir_root, double *R, double *T)
+{
+    boost::shared_ptr<istream> file_i2v = openText(calibrationFile(dir_root, "calib_imu_to_velo.txt"));
+    if (!file_i2v)
+        return 0;
+
+    string line = "";
+    while (getline(*file_i2v, line))
+    {
+        parseCalibrationLine(line, "R:", R, 9) ||
+        parseCalibrationLine(line, "T:", T, 3);
+    }
+    return 1;
+}
+
+int loadVeloToCam(const string &dir_root, double *R, double *T)
+{
+    boost::shared_ptr<istream> file_v2c = openText(calibrationFile(dir_root, "calib_velo_to_cam.txt"));
+    if (!file_v2c)
+        return 0;
+
+    string line = "";
+    while (getline(*file_v2c, line))
+    {
+        parseCalibrationLine(line, "R:", R, 9) ||
+        parseCalibrationLine(line, "T:", T, 3);
+    }
+    return 1;
+}
+
+OdometryCalibration::OdometryCalibration()
+{
+    fill(&P[0][0], &P[0][0] + 4 * 12, 0.0);
+    fill(Tr, Tr + 12, 0.0);
+}
+
+int loadOdometryCalibration(const string &filename, OdometryCalibration &calibration)
+{
+    boost::shared_ptr<istream> file = openText(filename);
+    if (!file)
+        return 0;
+
+    int found = 0;
+    string line = "";
+    while (getline(*file, line))
+    {
+        for (int c = 0; c < 4; c++)
+            if (parseCalibrationLine(line, boost::str(boost::format("P%d:") % c), calibration.P[c], 12))
+                found |= 1 << c;
+        if (parseCalibrationLine(line, "Tr:", calibration.Tr, 12))
+            found |= 1 << 4;
+    }
+    return found == 0x1f;
+}
+
+int loadOdometryTimes(const string &filename, vector<double> &times)
+{
+    vector<uint8_t> buffer;
+    if (!readFile(filename, buffer))
+        return 0;
+
+    // one number per line, e.g. 1.036224e-01
+    times.clear();
+    times.reserve(buffer.size() / 13);
+    parseNumbers(buffer, times);
+    return 1;
+}
+
+int loadOdometryPoses(const string &filename, vector<double> &poses)
+{
+    vector<uint8_t> buffer;
+    if (!readFile(filename, buffer))
+        return 0;
+
+    // 12 numbers per line, about 13 characters each
+    poses.clear();
+    poses.reserve(buffer.size() / 13 + 12);
+    parseNumbers(buffer, poses);
+    poses.resize(poses.size() - poses.size() % 12);
+    return 1;
+}
+
+OxtsPacket::OxtsPacket()
+{
+    memset(this, 0, sizeof(*this));
+}
+
+int parseOxtsPacket(const string &line, OxtsPacket &packet)
+{
+    // the fields, in file order
+    static double OxtsPacket::* const fields[] =
+    {
+        &OxtsPacket::lat, &OxtsPacket::lon, &OxtsPacket::alt,
+        &OxtsPacket::roll, &OxtsPacket::pitch, &OxtsPacket::yaw,
+        &OxtsPacket::vn, &OxtsPacket::ve,
+        &OxtsPacket::vf, &OxtsPacket::vl, &OxtsPacket::vu,
+        &OxtsPacket::ax, &OxtsPacket::ay, &OxtsPacket::az,
+        &OxtsPacket::af, &OxtsPacket::al, &OxtsPacket::au,
+        &OxtsPacket::wx, &OxtsPacket::wy, &OxtsPacket::wz,
+        &OxtsPacket::wf, &OxtsPacket::wl, &OxtsPacket::wu,
+        &OxtsPacket::pos_accuracy, &OxtsPacket::vel_accuracy,
+        &OxtsPacket::navstat, &OxtsPacket::numsats,
+        &OxtsPacket::posmode, &OxtsPacket::velmode, &OxtsPacket::orimode
+    };
+    const size_t count = sizeof(fields) / sizeof(fields[0]);
+
+    packet = OxtsPacket();
+    const char *s = line.c_str();
+    size_t parsed = 0;
+    for (; parsed < count; parsed++)
+    {
+        char *end;
+        double value = strtod(s, &end);
+        if (end == s)
+            break;
+        packet.*fields[parsed] = value;
+        s = end;
+    }
+    // the status fields are not used by the player
+    return parsed > 24;
+}
+
+int loadOxtsPacket(const string &filename, OxtsPacket &packet)
+{
+    boost::shared_ptr<istream> file_oxts = openText(filename);
+    if (!file_oxts)
+        return 0;
+
+    string line = "";
+    getline(*file_oxts, line);
+    return parseOxtsPacket(line, packet);
+}
+
+int VelodyneScan::load(const string &filename)
+{
+    storage_.reset();
+    points_ = NULL;
+    count_ = 0;
+
+    if (hasExtension(filename, ".kvc"))
+    {
+        // transcoded scan (kitti_transcode)
+        KvcBuffers &kvc = kvcBuffers();
+        boost::shared_ptr<vector<float> > points(new vector<float>);
+        if (!readFile(filename, kvc.file) || !decodeVelodyneScan(kvc.file.data(), kvc.file.size(), *points, kvc.scratch))
+            return 0;
+
+        storage_ = points;
+        points_ = points->data();
+        count_ = points->size() / 4;
+        return 1;
+    }
+
+    if (hasExtension(filename, ".txt"))
+    {
+        // unsynced (extract) drives store the scans as text, one "x y z r" per line
+        boost::shared_ptr<istream> text = openText(filename);
+        if (!text)
+            return 0;
+
+        boost::shared_ptr<vector<float> > points(new vector<float>);
+        float value;
+        while (*text >> value)
+            points->push_back(value);
+        points->resize(points->size() - points->size() % 4);
+
+        storage_ = points;
+        points_ = points->data();
+        count_ = points->size() / 4;
+        return 1;
+    }
+
+    boost::shared_ptr<const ZipArchive> archive;
+    const ZipArchive::Member *entry = findMember(filename, archive);
+    if (archive)
+    {
+        if (entry == NULL)
+            return 0;
+        size_t count = entry->size / (4 * sizeof(float));
+        if (count == 0)
+            return 1;
+
+        // stored member: mapped from the archive as the plain files; deflated: inflated here
+        boost::shared_ptr<uint8_t> mapping = archive->map(*entry);
+        if (mapping)
+        {
+            storage_ = mapping;
+            points_ = reinterpret_cast<float*>(mapping.get());
+        }
+        else
+        {
+            boost::shared_ptr<vector<float> > points(new vector<float>((entry->size + sizeof(float) - 1) / sizeof(float)));
+            if (!archive->read(*entry, points->data()))
+                return 0;
+            storage_ = points;
+            points_ = points->data();
+        }
+        count_ = count;
+        return 1;
+    }
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return 0;
+    }
+
+    size_t count = st.st_size / (4 * sizeof(float));
+    if (count > 0)
+    {
+        // private writable mapping: in-place stages (deskew) copy only the pages they touch
+        void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED)
+        {
+            ::close(fd);
+            return 0;
+        }
+        madvise(base, st.st_size, MADV_SEQUENTIAL);
+        Unmapper unmapper = { size_t(st.st_size) };
+        storage_.reset(base, unmapper);
+        points_ = static_cast<float*>(base);
+        count_ = count;
+    }
+    ::close(fd);
+    return 1;
+}
+
+int VelodyneScan::load(const string &filename, vector<float> &buffer)
+{
+    storage_.reset();
+    points_ = NULL;
+    count_ = 0;
+    buffer.clear();
+    boost::shared_ptr<const ZipArchive> archive;
+
+    if (hasExtension(filename, ".kvc"))
+    {
+        KvcBuffers &kvc = kvcBuffers();
+        if (!readFile(filename, kvc.file) || !decodeVelodyneScan(kvc.file.data(), kvc.file.size(), buffer, kvc.scratch))
+            return 0;
+    }
+    else if (hasExtension(filename, ".txt"))
+    {
+        boost::shared_ptr<istream> text = openText(filename);
+        if (!text)
+            return 0;
+
+        float value;
+        while (*text >> value)
+            buffer.push_back(value);
+        buffer.resize(buffer.size() - buffer.size() % 4);
+    }
+    else if (const ZipArchive::Member *entry = findMember(filename, archive))
+    {
+        // decompressed straight into the buffer
+        buffer.resize((entry->size + sizeof(float) - 1) / sizeof(float));
+        if (!archive->read(*entry, buffer.data()))
+            return 0;
+        buffer.resize(entry->size / sizeof(float) / 4 * 4);
+    }
+    else
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return 0;
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return 0;
+        }
+
+        // resize within the capacity of the previous scans does not allocate
+        buffer.resize(st.st_size / sizeof(float) / 4 * 4);
+        size_t bytes = buffer.size() * sizeof(float);
+        ssize_t got = bytes > 0 ? pread(fd, buffer.data(), bytes, 0) : 0;
+        ::close(fd);
+        if (got != ssize_t(bytes))
+            return 0;
+    }
+
+    wrap(buffer.data(), buffer.size() / 4);
+    return 1;
+}
+
+void VelodyneScan::wrap(float *points, size_t count)
+{
+    storage_.reset();
+    points_ = points;
+    count_ = count;
+}
+
+int loadImage(const string &filename, cv::Mat &image)
+{
+    string member;
+    if (hasExtension(filename, ".kqi") || findMounted(filename, member))
+    {
+        vector<uint8_t> file_buffer;
+        image.release();
+        return loadImage(filename, image, file_buffer);
+    }
+
+    image = cv::imread(filename, CV_LOAD_IMAGE_UNCHANGED);
+    return image.data != NULL;
+}
+
+int loadImage(const string &filename, cv::Mat &image, vector<uint8_t> &file_buffer, int flags)
+{
+    // stored archive member: decoded from the mapping, without copy
+    boost::shared_ptr<const ZipArchive> archive;
+    const ZipArchive::Member *entry = findMember(filename, archive);
+    boost::shared_ptr<uint8_t> mapping = entry ? archive->map(*entry) : boost::shared_ptr<uint8_t>();
+    if (mapping)
+    {
+        if (hasExtension(filename, ".kqi"))
+            return decodeImage(mapping.get(), entry->size, image);
+        cv::imdecode(cv::Mat(1, entry->size, CV_8UC1, mapping.get()), flags, &image);
+        return image.data != NULL;
+    }
+
+    if (!readFile(filename, file_buffer))
+        return 0;
+
+    // transcoded image (kitti_transcode), always as stored
+    if (hasExtension(filename, ".kqi"))
+        return decodeImage(file_buffer.data(), file_buffer.size(), image);
+
+    // decoded in place when image already has the right size and type
+    cv::imdecode(file_buffer, flags, &image);
+    return image.data != NULL;
+}
+
+Drive::Drive()
+    : sensors_(0), size_(0), use_caches_(true), window_(0), prefetch_(0), loading_(kNotLoading), stop_(false)
+{
+}
+
+Drive::~Drive()
+{
+    stopPrefetch();
+}
+
+string Drive::directory(Sensor sensor) const
+{
+    static const char *names[SENSORS] = { "image_00", "image_01", "image_02", "image_03", "velodyne_points", "oxts" };
+    return path_ + names[sensor] + "/data/";
+}
+
+int Drive::open(const string &path, unsigned int sensors)
+{
+    stopPrefetch();
+
+    path_ = path;
+    if (hasExtension(path_, ".zip") && !mountDrive(path, path_))
+        return 0;
+    if (!path_.empty() && path_[path_.size() - 1] != '/')
+        path_ += "/";
+    sensors_ = sensors & ALL_SENSORS;
+    size_ = 0;
+
+    bool first = true;
+    for (int s = 0; s < SENSORS; s++)
+    {
+        timestamps_[s].clear();
+        if (!(sensors_ & (1 << s)))
+            continue;
+
+        Sensor sensor = Sensor(s);
+        unsigned int files = countFiles(directory(sensor));
+        if (files == 0)
+            return 0;
+        size_ = first ? files : min<size_t>(size_, files);
+        first = false;
+
+        // timestamps and calibration are optional
+        string data = directory(sensor);
+        loadTimestamps(data.substr(0, data.size() - 5) + "timestamps.txt", timestamps_[s]);
+        data_directory_[s] = data;
+        extension_[s] = ".txt";
+        string cache;
+        if (sensor <= IMAGE_03)
+        {
+            loadCameraCalibration(path_, boost::str(boost::format("%02d") % s), calibration_[s]);
+            extension_[s] = ".png";
+            cache = imageCacheDirectory(data);
+        }
+        if (sensor == VELODYNE_POINTS)
+        {
+            // unsynced (extract) drives store the scans as text
+            extension_[s] = fileExists(frameFilename(data, 0, ".bin")) ? ".bin" : ".txt";
+            cache = velodyneCacheDirectory(data);
+        }
+
+        // a complete transcoded copy is read in place of the raw files
+        if (use_caches_ && !cache.empty() && countFiles(cache) >= files)
+        {
+            data_directory_[s] = cache;
+            extension_[s] = sensor == VELODYNE_POINTS ? ".kvc" : ".kqi";
+        }
+    }
+
+    // the prefetch depth set before open() applies to the new drive
+    window_ = 0;
+    startPrefetch();
+    return 1;
+}
+
+int Drive::load(unsigned int index, Frame &frame) const
+{
+    if (index >= size_)
+        return 0;
+
+    frame.index = index;
+    for (int s = 0; s < SENSORS; s++)
+    {
+        if (!(sensors_ & (1 << s)))
+            continue;
+
+        frame.stamp[s] = index < timestamps_[s].size() ? timestamps_[s][index] : Timestamp();
+        string filename = frameFilename(data_directory_[s], index, extension_[s].c_str());
+        if (s <= IMAGE_03)
+        {
+            if (!loadImage(filename, frame.image[s]))
+                return 0;
+        }
+        else if (s == VELODYNE_POINTS)
+        {
+            if (!frame.velodyne.load(filename))
+                return 0;
+        }
+        else if (s == OXTS)
+        {
+            if (!loadOxtsPacket(filename, frame.oxts))
+                return 0;
+        }
+    }
+    return 1;
+}
+
+FrameConstPtr Drive::at(unsigned int index)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        if (prefetch_ > 0)
+        {
+            // slide the window: drop the frames behind and beyond it, wake the loader
+            window_ = index;
+            ready_.erase(ready_.begin(), ready_.lower_bound(index));
+            ready_.erase(ready_.lower_bound(index + prefetch_), ready_.end());
+            cv_.notify_all();
+
+            while (loading_ == index)
+                cv_.wait(lock);
+            std::map<unsigned int, FrameConstPtr>::const_iterator it = ready_.find(index);
+            if (it != ready_.end())
+                return it->second;
+        }
+    }
+
+    boost::shared_ptr<Frame> frame(new Frame);
+    if (!load(index, *frame))
+        frame.reset();
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if (prefetch_ > 0 && index >= window_ && index < window_ + prefetch_)
+        ready_[index] = frame;
+    return frame;
+}
+
+void Drive::setPrefetch(unsigned int frames)
+{
+    stopPrefetch();
+    prefetch_ = frames;
+    startPrefetch();
+}
+
+Drive::iterator Drive::begin()
+{
+    return iterator(this, 0);
+}
+
+Drive::iterator Drive::end()
+{
+    return iterator(this, size_);
+}
+
+void Drive::stopPrefetch()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        stop_ = true;
+        cv_.notify_all();
+    }
+    if (thread_.joinable())
+        thread_.join();
+
+    boost::mutex::scoped_lock lock(mutex_);
+    stop_ = false;
+    loading_ = kNotLoading;
+    ready_.clear();
+}
+
+void Drive::startPrefetch()
+{
+    if (prefetch_ > 0 && size_ > 0 && !thread_.joinable())
+        thread_ = boost::thread(&Drive::prefetchLoop, this);
+}
+
+void Drive::prefetchLoop()
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    while (!stop_)
+    {
+        // first frame of the window not loaded yet; failures are kept as NULL
+        unsigned int next = window_;
+        while (next < window_ + prefetch_ && next < size_ && ready_.count(next))
+            next++;
+        if (next >= window_ + prefetch_ || next >= size_)
+        {
+            cv_.wait(lock);
+            continue;
+        }
+
+        loading_ = next;
+        lock.unlock();
+        boost::shared_ptr<Frame> frame(new Frame);
+        if (!load(next, *frame))
+            frame.reset();
+        lock.lock();
+
+        loading_ = kNotLoading;
+        if (next >= window_ && next < window_ + prefetch_)
+            ready_[next] = frame;
+        cv_.notify_all();
+    }
+}
+
+} // namespace kitti_player
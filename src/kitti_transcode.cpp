@@ -0,0 +1,311 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * kitti_transcode: converts the raw files of a drive into the compact caches
+ * that kitti_player reads in place of them.
+ *
+ *   velodyne_points/data/*.bin  ->  velodyne_points/data_kvc/*.kvc
+ *   image_0x/data/*.png         ->  image_0x/data_kqi/*.kqi
+ *
+ * Every file is written under a temporary name and renamed when complete, so
+ * the player never reads a partial cache; it uses a cache only when it holds
+ * as many files as the raw directory.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+#include <boost/thread.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <kitti_player/image_codec.h>
+#include <kitti_player/kitti_reader.h>
+#include <kitti_player/velodyne_codec.h>
+
+#include "worker_pool.h"
+
+using namespace std;
+namespace po = boost::program_options;
+
+struct kitti_transcode_options
+{
+    string          path;
+    bool            velodyne;         // transcode the velodyne scans
+    float           velodyneError;    // max coordinate error [m], 0 = lossless
+    int             level;            // zlib level
+    bool            grayscale;        // transcode image_00 and image_01
+    bool            color;            // transcode image_02 and image_03
+    unsigned int    threads;          // 0 = one per hardware thread
+    bool            verify;           // decode every file back and check it
+};
+
+/**
+ * @brief writeFile writes data under a temporary name, then renames it
+ * @param filename destination
+ * @param data file content
+ * @return 1 if written, 0 otherwise
+ */
+int writeFile(const string &filename, const vector<uint8_t> &data)
+{
+    // a file of its own: concurrent runs on the drive never rename a file torn by the other one
+    string temporary = filename + ".XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if (fd < 0)
+        return 0;
+    fchmod(fd, 0644);
+    ::close(fd);
+    {
+        ofstream file(temporary.c_str(), ios::binary | ios::trunc);
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        if (!file.good())
+        {
+            unlink(temporary.c_str());
+            return 0;
+        }
+    }
+    if (rename(temporary.c_str(), filename.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief makeDirectory
+ * @param dir directory to create, if missing
+ * @return 1 if dir exists, 0 otherwise
+ */
+int makeDirectory(const string &dir)
+{
+    return mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+/**
+ * @brief transcodeVelodyne writes the .kvc copy of every scan of a drive
+ * @param data_dir velodyne_points/data/ directory
+ * @param options tool options
+ * @param pool workers, a scan per item
+ * @return 1 if every scan is transcoded, 0 otherwise
+ */
+int transcodeVelodyne(const string &data_dir, const kitti_transcode_options &options, WorkerPool &pool)
+{
+    const string cache_dir = kitti_player::velodyneCacheDirectory(data_dir);
+    const unsigned int entries = kitti_player::countFiles(data_dir);
+    if (entries == 0 || !makeDirectory(cache_dir))
+    {
+        cerr << "Cannot transcode " << data_dir << " into " << cache_dir << endl;
+        return 0;
+    }
+
+    // unsynced (extract) drives store the scans as text
+    struct stat st;
+    const char *extension = stat(kitti_player::frameFilename(data_dir, 0, ".bin").c_str(), &st) == 0 ? ".bin" : ".txt";
+
+    std::atomic<unsigned int> failed(0);
+    std::atomic<unsigned long long> raw_bytes(0), kvc_bytes(0), decode_ns(0);
+    boost::mutex error_mutex;
+    double max_error = 0.0;
+
+    pool.parallel_for(entries, [&](size_t begin, size_t end)
+    {
+        vector<uint8_t> file;
+        vector<uint8_t> scratch;
+        vector<float> decoded;
+        for (size_t frame = begin; frame < end; frame++)
+        {
+            string filename = kitti_player::frameFilename(data_dir, frame, extension);
+            kitti_player::VelodyneScan scan;
+            if (!scan.load(filename) ||
+                !kitti_player::encodeVelodyneScan(scan.data(), scan.size(), options.velodyneError, file, options.level) ||
+                !writeFile(kitti_player::frameFilename(cache_dir, frame, ".kvc"), file))
+            {
+                cerr << "Fail to transcode " << filename << endl;
+                failed++;
+                continue;
+            }
+            struct stat raw;
+            if (stat(filename.c_str(), &raw) == 0)
+                raw_bytes += raw.st_size;
+            kvc_bytes += file.size();
+
+            if (!options.verify)
+                continue;
+
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            bool decoded_ok = kitti_player::decodeVelodyneScan(file.data(), file.size(), decoded, scratch);
+            decode_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            if (!decoded_ok || decoded.size() != 4 * scan.size())
+            {
+                cerr << "Fail to decode the transcoded " << filename << endl;
+                failed++;
+                continue;
+            }
+
+            double error = 0.0;
+            for (size_t i = 0; i < decoded.size(); i++)
+                error = max(error, fabs(double(decoded[i]) - double(scan.data()[i])));
+            boost::mutex::scoped_lock lock(error_mutex);
+            max_error = max(max_error, error);
+        }
+    });
+
+    cout << data_dir << ": " << entries - failed << " scans, "
+         << raw_bytes / 1048576.0 << " MB -> " << kvc_bytes / 1048576.0 << " MB";
+    if (kvc_bytes > 0)
+        cout << " (" << double(raw_bytes) / kvc_bytes << ":1)";
+    cout << endl;
+    if (options.verify && entries > failed)
+    {
+        double decode_ms = decode_ns / 1e6 / (entries - failed);
+        cout << "  decode " << decode_ms << " ms/scan on one core (" << 1000.0 / decode_ms << " Hz), "
+             << "max error " << max_error << endl;
+    }
+    return failed == 0;
+}
+
+/**
+ * @brief transcodeImages writes the .kqi copy of every image of a camera
+ * @param data_dir image_0x/data/ directory
+ * @param options tool options
+ * @param pool workers, an image per item
+ * @return 1 if every image is transcoded, 0 otherwise
+ */
+int transcodeImages(const string &data_dir, const kitti_transcode_options &options, WorkerPool &pool)
+{
+    const string cache_dir = kitti_player::imageCacheDirectory(data_dir);
+    const unsigned int entries = kitti_player::countFiles(data_dir);
+    if (entries == 0 || !makeDirectory(cache_dir))
+    {
+        cerr << "Cannot transcode " << data_dir << " into " << cache_dir << endl;
+        return 0;
+    }
+
+    std::atomic<unsigned int> failed(0);
+    std::atomic<unsigned long long> png_bytes(0), kqi_bytes(0), png_ns(0), kqi_ns(0);
+
+    pool.parallel_for(entries, [&](size_t begin, size_t end)
+    {
+        vector<uint8_t> png;
+        vector<uint8_t> file;
+        cv::Mat image, decoded;
+        for (size_t frame = begin; frame < end; frame++)
+        {
+            string filename = kitti_player::frameFilename(data_dir, frame, ".png");
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            bool loaded = kitti_player::loadImage(filename, image, png);
+            png_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            if (!loaded ||
+                !kitti_player::encodeImage(image, file) ||
+                !writeFile(kitti_player::frameFilename(cache_dir, frame, ".kqi"), file))
+            {
+                cerr << "Fail to transcode " << filename << endl;
+                failed++;
+                continue;
+            }
+            png_bytes += png.size();
+            kqi_bytes += file.size();
+
+            if (!options.verify)
+                continue;
+
+            start = chrono::steady_clock::now();
+            bool decoded_ok = kitti_player::decodeImage(file.data(), file.size(), decoded);
+            kqi_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            if (!decoded_ok || decoded.size() != image.size() || decoded.type() != image.type() ||
+                cv::norm(decoded, image, cv::NORM_INF) != 0)
+            {
+                cerr << "Fail to decode the transcoded " << filename << endl;
+                failed++;
+            }
+        }
+    });
+
+    cout << data_dir << ": " << entries - failed << " images, "
+         << png_bytes / 1048576.0 << " MB -> " << kqi_bytes / 1048576.0 << " MB" << endl;
+    if (options.verify && kqi_ns > 0)
+        cout << "  decode " << kqi_ns / 1e6 / entries << " ms/image, png " << png_ns / 1e6 / entries
+             << " ms/image (" << double(png_ns) / kqi_ns << "x), lossless" << endl;
+    return failed == 0;
+}
+
+/**
+ * @brief main kitti_transcode, writes the caches of a KITTI raw drive
+ * @param argc
+ * @param argv
+ * @return 0 if every file is transcoded, 1 otherwise
+ */
+int main(int argc, char **argv)
+{
+    kitti_transcode_options options;
+    po::variables_map vm;
+
+    po::options_description desc("kitti_transcode, converts a KITTI raw drive into the caches read by kitti_player\n\nAllowed options", 200);
+    desc.add_options()
+    ("help,h"                                                                                                    ,  "help message")
+    ("directory ,d",  po::value<string>       (&options.path)->required()                                        ,  "*required* - path to the kitti dataset Directory")
+    ("velodyne  ,v",  po::value<bool>         (&options.velodyne)         ->default_value(0) ->implicit_value(1)   ,  "transcode the Velodyne scans into velodyne_points/data_kvc")
+    ("grayscale ,G",  po::value<bool>         (&options.grayscale)        ->default_value(0) ->implicit_value(1)   ,  "transcode the Stereo Grayscale images into image_0[01]/data_kqi")
+    ("color     ,C",  po::value<bool>         (&options.color)            ->default_value(0) ->implicit_value(1)   ,  "transcode the Stereo Color images into image_0[23]/data_kqi")
+    ("velodyneError", po::value<float>        (&options.velodyneError)    ->default_value(0.002)                   ,  "max coordinate error in meters of the transcoded scans [0: lossless]")
+    ("level",         po::value<int>          (&options.level)            ->default_value(6)                       ,  "zlib compression level, 1 (fast) ... 9 (small)")
+    ("threads",       po::value<unsigned int> (&options.threads)          ->default_value(0)                       ,  "transcoding threads [0: one per core]")
+    ("verify",        po::value<bool>         (&options.verify)           ->default_value(1) ->implicit_value(1)   ,  "decode every file back, report decoding speed and max error")
+    ;
+
+    try // parse options
+    {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help"))
+        {
+            cout << desc << endl;
+            return 0;
+        }
+        po::notify(vm);
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << endl << endl << desc << endl;
+        return 1;
+    }
+
+    if (!(options.velodyne || options.grayscale || options.color))
+    {
+        cerr << "Nothing to transcode, enable at least one stream" << endl << endl << desc << endl;
+        return 1;
+    }
+    if (options.velodyneError < 0.0f || options.level < 1 || options.level > 9)
+    {
+        cerr << "velodyneError must be >= 0 and level within 1 and 9" << endl;
+        return 1;
+    }
+
+    string root = options.path;
+    if (!root.empty() && root[root.size() - 1] != '/')
+        root += "/";
+
+    WorkerPool pool(options.threads);
+    bool ok = true;
+    if (options.velodyne)
+        ok = transcodeVelodyne(root + "velodyne_points/data/", options, pool) && ok;
+    for (int c = 0; c < 4; c++)
+    {
+        if (c < 2 ? options.grayscale : options.color)
+            ok = transcodeImages(root + "image_0" + char('0' + c) + "/data/", options, pool) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * MessagePool: recycled per-stream messages, so that playback does not
+ * allocate new multi-megabyte buffers at every frame.
+ */
+
+#ifndef KITTI_PLAYER_MESSAGE_POOL_H
+#define KITTI_PLAYER_MESSAGE_POOL_H
+
+#include <vector>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * @brief The MessagePool class hands out recycled messages of one stream
+ *
+ * A message is free again as soon as the pool holds its last reference, i.e.
+ * when every subscriber queue and publisher is done with it. Its vectors keep
+ * their capacity, so refilling it with a frame of the same size does not
+ * allocate: once the pool holds as many messages as are in flight, playback
+ * runs without new buffers. Copies of a pool share the same messages.
+ */
+template <class M>
+class MessagePool
+{
+public:
+    typedef boost::shared_ptr<M> Ptr;
+
+    /**
+     * @brief MessagePool
+     * @param capacity max number of messages kept for reuse
+     */
+    explicit MessagePool(size_t capacity = 4)
+        : shared_(boost::make_shared<Shared>())
+    {
+        shared_->capacity = capacity;
+        shared_->messages.reserve(capacity);
+    }
+
+    /**
+     * @brief acquire
+     * @return a message referenced only by the caller, recycled when possible
+     *
+     * The message content is the one of its last use: every field has to be
+     * set again.
+     */
+    Ptr acquire()
+    {
+        boost::mutex::scoped_lock lock(shared_->mutex);
+
+        std::vector<Ptr> &messages = shared_->messages;
+        for (size_t i = 0; i < messages.size(); i++)
+        {
+            // nobody else can get a reference but through acquire()
+            if (messages[i].use_count() == 1)
+                return messages[i];
+        }
+
+        Ptr message = boost::make_shared<M>();
+        if (messages.size() < shared_->capacity)
+            messages.push_back(message);
+        return message;
+    }
+
+private:
+    struct Shared
+    {
+        boost::mutex        mutex;
+        std::vector<Ptr>    messages;
+        size_t              capacity;
+    };
+
+    boost::shared_ptr<Shared> shared_;
+};
+
+#endif // KITTI_PLAYER_MESSAGE_POOL_H
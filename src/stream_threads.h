@@ -0,0 +1,181 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * StreamThreads: one publisher thread per stream, released frame by frame.
+ */
+
+#ifndef KITTI_PLAYER_STREAM_THREADS_H
+#define KITTI_PLAYER_STREAM_THREADS_H
+
+#include <cerrno>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <pthread.h>
+#include <ros/time.h>
+#include <sched.h>
+
+/**
+ * @brief setThreadAffinity pins the calling thread to a core
+ * @param cpu core index [-1: any core]
+ * @return 0 if pinned, the error code otherwise
+ */
+inline int setThreadAffinity(int cpu)
+{
+    if (cpu < 0)
+        return 0;
+    if (cpu >= CPU_SETSIZE)
+        return EINVAL;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/**
+ * @brief setThreadRealtime moves the calling thread to SCHED_FIFO
+ * @param priority SCHED_FIFO priority, 1 (lowest) ... 99 [0: keep the default scheduler]
+ * @return 0 if set, the error code otherwise (EPERM without CAP_SYS_NICE or rtprio limits)
+ */
+inline int setThreadRealtime(int priority)
+{
+    if (priority <= 0)
+        return 0;
+
+    sched_param param;
+    param.sched_priority = priority;
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+/**
+ * @brief The StreamThreads class publishes every stream of a frame from its own thread
+ *
+ * run() releases all the jobs on the same frame and returns when every one of
+ * them is done with it (release() and wait() split it, so that the caller can
+ * work meanwhile): the frame is a barrier, so a slow stream (e.g. the
+ * velodyne serialization) no longer delays the others, while the next frame
+ * still starts with all of them together, as in the sequential loop.
+ */
+class StreamThreads
+{
+public:
+    typedef boost::function<bool (unsigned int frame, const ros::Time &now)> Job;
+
+    /// called on every new thread with its job index, before the first frame
+    typedef boost::function<void (size_t index)> Setup;
+
+    StreamThreads() : frame_(0), pending_(0), generation_(0), failed_(false), stop_(false) {}
+
+    ~StreamThreads()
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        threads_.join_all();
+    }
+
+    /**
+     * @brief start creates one thread per job
+     * @param jobs the streams, each one called with every frame
+     * @param setup thread setup (affinity, scheduling), may be empty
+     */
+    void start(const std::vector<Job> &jobs, const Setup &setup = Setup())
+    {
+        jobs_ = jobs;
+        for (size_t i = 0; i < jobs_.size(); i++)
+            threads_.create_thread(boost::bind(&StreamThreads::worker, this, i, setup));
+    }
+
+    /// number of jobs
+    size_t size() const
+    {
+        return jobs_.size();
+    }
+
+    /**
+     * @brief release starts a frame on every thread, and returns at once
+     * @param frame frame number
+     * @param now timestamp of the frame
+     */
+    void release(unsigned int frame, const ros::Time &now)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        frame_ = frame;
+        now_ = now;
+        pending_ = jobs_.size();
+        failed_ = false;
+        generation_++;
+        work_cv_.notify_all();
+    }
+
+    /**
+     * @brief wait waits for every thread to be done with the released frame
+     * @return true if every job succeeded, false otherwise
+     */
+    bool wait()
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (pending_ > 0)
+            done_cv_.wait(lock);
+        return !failed_;
+    }
+
+    /**
+     * @brief run plays a frame on every thread and waits for all of them
+     * @param frame frame number
+     * @param now timestamp of the frame
+     * @return true if every job succeeded, false otherwise
+     */
+    bool run(unsigned int frame, const ros::Time &now)
+    {
+        release(frame, now);
+        return wait();
+    }
+
+private:
+    void worker(size_t index, Setup setup)
+    {
+        if (setup)
+            setup(index);
+
+        unsigned int seen = 0;
+        boost::mutex::scoped_lock lock(mutex_);
+        while (true)
+        {
+            while (!stop_ && generation_ == seen)
+                work_cv_.wait(lock);
+            if (stop_)
+                return;
+            seen = generation_;
+
+            unsigned int frame = frame_;
+            ros::Time now = now_;
+            lock.unlock();
+            bool ok = jobs_[index](frame, now);
+            lock.lock();
+
+            if (!ok)
+                failed_ = true;
+            if (--pending_ == 0)
+                done_cv_.notify_all();
+        }
+    }
+
+    std::vector<Job>            jobs_;
+    boost::mutex                mutex_;
+    boost::condition_variable   work_cv_;
+    boost::condition_variable   done_cv_;
+    boost::thread_group         threads_;
+
+    unsigned int    frame_;
+    ros::Time       now_;
+    size_t          pending_;       // jobs not done with the current frame
+    unsigned int    generation_;    // incremented at every frame
+    bool            failed_;
+    bool            stop_;
+};
+
+#endif // KITTI_PLAYER_STREAM_THREADS_H
@@ -0,0 +1,205 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * ThroughputProfile: frames per second and time per stream of a playback,
+ * checked against a stored baseline (--profile, --baseline, --tolerance).
+ */
+
+#ifndef KITTI_PLAYER_THROUGHPUT_PROFILE_H
+#define KITTI_PLAYER_THROUGHPUT_PROFILE_H
+
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <stdint.h>
+#include <boost/function.hpp>
+#include <ros/time.h>
+
+/**
+ * @brief The ThroughputProfile class measures a playback and compares it with a baseline
+ *
+ * Every stream job is wrapped to time its calls; each stage is only updated
+ * by the thread running its job, and read once the playback is over.
+ *
+ * The baseline file holds "<combination> <metric> <value>" lines, the
+ * combination being the played streams (e.g. color+velodyne+timestamps) and
+ * the metrics fps and <stream>_ms, the mean time of a stream per frame. A
+ * combination missing from the file fails the check, unless it is recorded
+ * (--recordBaseline).
+ */
+class ThroughputProfile
+{
+public:
+    typedef boost::function<bool (unsigned int frame, const ros::Time &now)> Job;
+
+    /// stage regressions smaller than this are timer noise, whatever the tolerance
+    static constexpr double kMinRegressionMs = 0.05;
+
+    explicit ThroughputProfile(const std::string &combination)
+        : combination_(combination), frames_(0), seconds_(0.0)
+    {
+        // a single field of the baseline lines
+        for (size_t i = 0; i < combination_.size(); i++)
+            if (combination_[i] == ' ')
+                combination_[i] = '_';
+    }
+
+    const std::string &combination() const
+    {
+        return combination_;
+    }
+
+    /**
+     * @brief wrap times every call of a stream job
+     * @param stage stream name, used in the metric names
+     * @param job the stream job
+     * @return the timed job, that must not outlive the profile
+     */
+    Job wrap(const std::string &stage, const Job &job)
+    {
+        Stage s = { stage, 0, 0 };
+        for (size_t i = 0; i < s.name.size(); i++)
+            if (s.name[i] == ' ')
+                s.name[i] = '_';
+        stages_.push_back(s);
+        Stage *timed = &stages_.back();
+
+        return [timed, job](unsigned int frame, const ros::Time &now) -> bool
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            bool ok = job(frame, now);
+            timed->ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            timed->calls++;
+            return ok;
+        };
+    }
+
+    /// starts the playback clock
+    void start()
+    {
+        start_ = std::chrono::steady_clock::now();
+        frames_ = 0;
+    }
+
+    /// counts a played frame
+    void frame()
+    {
+        frames_++;
+    }
+
+    /// stops the playback clock
+    void stop()
+    {
+        seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    /// fps, frames and <stage>_ms
+    std::map<std::string, double> metrics() const
+    {
+        std::map<std::string, double> values;
+        values["frames"] = frames_;
+        values["fps"] = seconds_ > 0.0 ? frames_ / seconds_ : 0.0;
+        for (size_t i = 0; i < stages_.size(); i++)
+            values[stages_[i].name + "_ms"] = stages_[i].calls > 0 ? stages_[i].ns / 1e6 / stages_[i].calls : 0.0;
+        return values;
+    }
+
+    /// human readable results
+    void report(std::ostream &out) const
+    {
+        std::map<std::string, double> values = metrics();
+        out << "Profile of " << combination_ << ": " << frames_ << " frames in " << seconds_ << " s, "
+            << values["fps"] << " frames/s" << std::endl;
+        for (size_t i = 0; i < stages_.size(); i++)
+            out << "  " << stages_[i].name << ": " << values[stages_[i].name + "_ms"] << " ms/frame" << std::endl;
+    }
+
+    /**
+     * @brief check compares the results with the baseline of the combination
+     * @param filename baseline file
+     * @param tolerance relative loss accepted, e.g. 0.2: fps down to 80%, stages up to 120%
+     * @param record when the file has no baseline of the combination, append the results to it
+     * @param log comparison details
+     * @return 1 if no metric regressed (or the baseline is recorded), 0 otherwise
+     */
+    int check(const std::string &filename, double tolerance, bool record, std::ostream &log) const
+    {
+        std::map<std::string, double> baseline;
+        {
+            std::ifstream file(filename.c_str());
+            std::string line;
+            while (std::getline(file, line))
+            {
+                std::istringstream fields(line);
+                std::string combination, metric;
+                double value;
+                if (line.empty() || line[0] == '#' || !(fields >> combination >> metric >> value))
+                    continue;
+                if (combination == combination_)
+                    baseline[metric] = value;
+            }
+        }
+
+        std::map<std::string, double> values = metrics();
+        if (baseline.empty() && !record)
+        {
+            log << "No baseline of " << combination_ << " in " << filename << ", run once with --recordBaseline" << std::endl;
+            return 0;
+        }
+        if (baseline.empty())
+        {
+            std::ofstream file(filename.c_str(), std::ios::app);
+            for (std::map<std::string, double>::const_iterator it = values.begin(); it != values.end(); ++it)
+                if (it->first != "frames")
+                    file << combination_ << " " << it->first << " " << it->second << std::endl;
+            if (!file.good())
+            {
+                log << "Cannot write the baseline " << filename << std::endl;
+                return 0;
+            }
+            log << "Baseline of " << combination_ << " recorded in " << filename << std::endl;
+            return 1;
+        }
+
+        bool regressed = false;
+        for (std::map<std::string, double>::const_iterator it = baseline.begin(); it != baseline.end(); ++it)
+        {
+            std::map<std::string, double>::const_iterator measured = values.find(it->first);
+            if (measured == values.end())
+            {
+                log << "  " << it->first << ": not measured" << std::endl;
+                continue;
+            }
+
+            bool worse;
+            if (it->first == "fps")
+                worse = measured->second < it->second * (1.0 - tolerance);
+            else
+                worse = measured->second > it->second * (1.0 + tolerance) && measured->second - it->second > kMinRegressionMs;
+            regressed = regressed || worse;
+            log << "  " << it->first << ": " << measured->second << " (baseline " << it->second << ")"
+                << (worse ? " REGRESSION" : "") << std::endl;
+        }
+        return !regressed;
+    }
+
+private:
+    struct Stage
+    {
+        std::string     name;
+        uint64_t        ns;         // time spent in the job
+        unsigned int    calls;
+    };
+
+    std::string         combination_;
+    std::deque<Stage>   stages_;        // stable addresses, captured by the wrapped jobs
+    unsigned int        frames_;
+    double              seconds_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#endif // KITTI_PLAYER_THROUGHPUT_PROFILE_H
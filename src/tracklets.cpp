@@ -0,0 +1,125 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * tracklets: the object labels of a drive (tracklet_labels.xml).
+ */
+
+#include <kitti_player/kitti_reader.h>
+#include <kitti_player/tracklets.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include <boost/foreach.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+
+using namespace std;
+namespace pt = boost::property_tree;
+
+namespace kitti_player
+{
+
+namespace
+{
+
+const char *type_names[OBJECT_TYPES] =
+{
+    "Car", "Van", "Truck", "Pedestrian", "Person (sitting)", "Cyclist", "Tram", "Misc"
+};
+
+/// occlusion and truncation of tracklet_labels.xml, 99 (unset) -> -1
+int8_t labelState(int value)
+{
+    return value >= 0 && value < 99 ? int8_t(value) : int8_t(-1);
+}
+
+} // namespace
+
+ObjectType parseObjectType(const string &name)
+{
+    for (int t = 0; t < OBJECT_TYPES; t++)
+        if (name == type_names[t])
+            return ObjectType(t);
+    return MISC;
+}
+
+const char *objectTypeName(ObjectType type)
+{
+    return type < OBJECT_TYPES ? type_names[type] : type_names[MISC];
+}
+
+int Tracklets::load(const string &filename)
+{
+    poses_.clear();
+    offsets_.assign(1, 0);
+    tracklets_ = 0;
+
+    vector<uint8_t> buffer;
+    if (!readFile(filename, buffer))
+        return 0;
+
+    // boost::serialization layout: tracklets/item*, each with its poses/item*
+    pt::ptree tree;
+    vector<uint32_t> frames;     // frame of every pose, in file order
+    try
+    {
+        istringstream xml(string(buffer.begin(), buffer.end()));
+        pt::read_xml(xml, tree, pt::xml_parser::no_comments);
+
+        BOOST_FOREACH(const pt::ptree::value_type &item, tree.get_child("boost_serialization.tracklets"))
+        {
+            if (item.first != "item")
+                continue;
+
+            TrackletPose pose;
+            pose.id = tracklets_++;
+            pose.type = parseObjectType(item.second.get<string>("objectType"));
+            pose.h = item.second.get<float>("h");
+            pose.w = item.second.get<float>("w");
+            pose.l = item.second.get<float>("l");
+            uint32_t frame = item.second.get<uint32_t>("first_frame");
+
+            BOOST_FOREACH(const pt::ptree::value_type &p, item.second.get_child("poses"))
+            {
+                if (p.first != "item")
+                    continue;
+                pose.t[0] = p.second.get<float>("tx");
+                pose.t[1] = p.second.get<float>("ty");
+                pose.t[2] = p.second.get<float>("tz");
+                pose.r[0] = p.second.get<float>("rx");
+                pose.r[1] = p.second.get<float>("ry");
+                pose.r[2] = p.second.get<float>("rz");
+                pose.occlusion = labelState(p.second.get<int>("occlusion", 99));
+                pose.truncation = labelState(p.second.get<int>("truncation", 99));
+                poses_.push_back(pose);
+                frames.push_back(frame++);
+            }
+        }
+    }
+    catch (const pt::ptree_error &)
+    {
+        poses_.clear();
+        tracklets_ = 0;
+        return 0;
+    }
+
+    // counting sort by frame, stable: the boxes of a frame stay in tracklet order
+    uint32_t last = 0;
+    for (size_t i = 0; i < frames.size(); i++)
+        last = max(last, frames[i] + 1);
+    offsets_.assign(last + 1, 0);
+    for (size_t i = 0; i < frames.size(); i++)
+        offsets_[frames[i] + 1]++;
+    for (size_t f = 0; f < last; f++)
+        offsets_[f + 1] += offsets_[f];
+
+    vector<TrackletPose> sorted(poses_.size());
+    vector<uint32_t> next(offsets_.begin(), offsets_.end() - 1);
+    for (size_t i = 0; i < poses_.size(); i++)
+        sorted[next[frames[i]]++] = poses_[i];
+    poses_.swap(sorted);
+    return 1;
+}
+
+} // namespace kitti_player
@@ -0,0 +1,174 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * velodyne_codec: compact velodyne scan files (.kvc).
+ */
+
+#include <kitti_player/velodyne_codec.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <zlib.h>
+
+using namespace std;
+
+namespace kitti_player
+{
+
+namespace
+{
+
+inline uint32_t zigzag(uint32_t delta)
+{
+    return (delta << 1) ^ uint32_t(int32_t(delta) >> 31);
+}
+
+inline uint32_t unzigzag(uint32_t value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+inline uint8_t *putVarint(uint8_t *out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = uint8_t(value);
+    return out;
+}
+
+/// returns NULL past end or on a varint longer than 5 bytes
+inline const uint8_t *getVarint(const uint8_t *in, const uint8_t *end, uint32_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35 && in < end; shift += 7)
+    {
+        uint8_t byte = *in++;
+        value |= uint32_t(byte & 0x7f) << shift;
+        if (byte < 0x80)
+            return in;
+    }
+    return NULL;
+}
+
+inline uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float bitsFloat(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/// true if every value of the channels quantized with step fits an int32
+bool quantizable(const float *points, size_t count, float xyz_step, float reflectance_step)
+{
+    const float limit = float(numeric_limits<int32_t>::max() / 2);
+    for (size_t i = 0; i < 4 * count; i++)
+    {
+        float q = points[i] / ((i & 3) < 3 ? xyz_step : reflectance_step);
+        if (!(fabs(q) < limit))     // false for NaN too
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+string velodyneCacheDirectory(const string &data_dir)
+{
+    string dir = data_dir;
+    if (!dir.empty() && dir[dir.size() - 1] == '/')
+        dir.erase(dir.size() - 1);
+    return dir + "_kvc/";
+}
+
+int encodeVelodyneScan(const float *points, size_t count, float max_error, vector<uint8_t> &file, int level)
+{
+    if (count >= numeric_limits<uint32_t>::max() / 20)
+        return 0;
+
+    KvcHeader header;
+    memcpy(header.magic, kKvcMagic, sizeof(header.magic));
+    header.version = kKvcVersion;
+    header.points = count;
+    header.xyz_step = max_error > 0.0f ? 2.0f * max_error : 0.0f;
+    header.reflectance_step = max_error > 0.0f ? kKvcReflectanceStep : 0.0f;
+    header.reserved = 0;
+    if (header.xyz_step > 0.0f && !quantizable(points, count, header.xyz_step, header.reflectance_step))
+        header.xyz_step = header.reflectance_step = 0.0f;
+
+    // channel by channel: x of every point, then y, z and reflectance
+    vector<uint8_t> varints(4 * count * 5);
+    uint8_t *out = varints.data();
+    for (size_t c = 0; c < 4; c++)
+    {
+        float step = c < 3 ? header.xyz_step : header.reflectance_step;
+        uint32_t previous = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            float value = points[4 * i + c];
+            uint32_t current = step > 0.0f ? uint32_t(int32_t(lrintf(value / step))) : floatBits(value);
+            out = putVarint(out, zigzag(current - previous));
+            previous = current;
+        }
+    }
+    header.varint_bytes = out - varints.data();
+
+    uLongf packed = compressBound(header.varint_bytes);
+    file.resize(sizeof(header) + packed);
+    if (compress2(file.data() + sizeof(header), &packed, varints.data(), header.varint_bytes, level) != Z_OK)
+        return 0;
+    header.packed_bytes = packed;
+    memcpy(file.data(), &header, sizeof(header));
+    file.resize(sizeof(header) + packed);
+    return 1;
+}
+
+int decodeVelodyneScan(const uint8_t *file, size_t size, vector<float> &points, vector<uint8_t> &scratch)
+{
+    KvcHeader header;
+    if (size < sizeof(header))
+        return 0;
+    memcpy(&header, file, sizeof(header));
+    if (memcmp(header.magic, kKvcMagic, sizeof(header.magic)) != 0 || header.version != kKvcVersion ||
+        sizeof(header) + size_t(header.packed_bytes) > size || size_t(header.varint_bytes) < 4 * size_t(header.points))
+        return 0;
+
+    scratch.resize(header.varint_bytes);
+    uLongf inflated = header.varint_bytes;
+    if (uncompress(scratch.data(), &inflated, file + sizeof(header), header.packed_bytes) != Z_OK ||
+        inflated != header.varint_bytes)
+        return 0;
+
+    const size_t count = header.points;
+    points.resize(4 * count);
+    const uint8_t *in = scratch.data();
+    const uint8_t *end = in + inflated;
+    for (size_t c = 0; c < 4; c++)
+    {
+        float step = c < 3 ? header.xyz_step : header.reflectance_step;
+        float *out = points.data() + c;
+        uint32_t current = 0;
+        uint32_t delta;
+        for (size_t i = 0; i < count; i++, out += 4)
+        {
+            if ((in = getVarint(in, end, delta)) == NULL)
+                return 0;
+            current += unzigzag(delta);
+            *out = step > 0.0f ? float(int32_t(current)) * step : bitsFloat(current);
+        }
+    }
+    return 1;
+}
+
+} // namespace kitti_player
@@ -0,0 +1,435 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * Processing stages applied to the Velodyne scans before publishing.
+ */
+
+#include "velodyne_stages.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+
+/**
+ * @brief fast_atan2 branch-free atan2, |error| < 1e-5 rad
+ *
+ * Written with selects only, so that the per-point loops vectorize.
+ */
+inline float fast_atan2(float y, float x)
+{
+    const float ax = std::fabs(x);
+    const float ay = std::fabs(y);
+    const float mx = ax > ay ? ax : ay;
+    const float mn = ax > ay ? ay : ax;
+    const float a  = mn / (mx + 1e-30f);
+    const float s  = a * a;
+    float r = a * (0.99997726f + s * (-0.33262347f + s * (0.19354346f + s * (-0.11643287f + s * (0.05265332f - s * 0.01172120f)))));
+    r = ay > ax ? 1.57079637f - r : r;
+    r = x < 0.0f ? 3.14159274f - r : r;
+    return y < 0.0f ? -r : r;
+}
+
+/// points per chunk: small enough to balance, large enough to amortize the wake-up
+const size_t kPointsPerChunk = 4096;
+
+/// largest coordinate, in steps, of a compact point
+const float kCompactRange = 32767.0f;
+
+/// vertical field of view of the range images [rad]
+const float kRangeFovUp = 3.0f * float(M_PI) / 180.0f;
+const float kRangeFovDown = -25.0f * float(M_PI) / 180.0f;
+
+/**
+ * @brief quantizePoint scalar version of the compact packing
+ * @return false if the point is out of the int16 range
+ */
+inline bool quantizePoint(const float *p, float inv_scale, uint8_t *out)
+{
+    int16_t xyz[3];
+    for (int k = 0; k < 3; k++)
+    {
+        float v = p[k] * inv_scale;
+        if (!(std::fabs(v) <= kCompactRange))
+            return false;
+        xyz[k] = (int16_t) lrintf(v);
+    }
+    float r = p[3] * 255.0f;
+    r = r < 0.0f ? 0.0f : (r > 255.0f ? 255.0f : r);
+
+    memcpy(out, xyz, sizeof(xyz));
+    out[6] = (uint8_t) lrintf(r);
+    out[7] = 0;
+    return true;
+}
+
+/**
+ * @brief quantizeChunk packs points [begin, end) at their own index
+ * @return false if a point is out of range, the chunk must then be compacted
+ */
+bool quantizeChunk(const float *points, size_t begin, size_t end, float inv_scale, uint8_t *out)
+{
+    size_t i = begin;
+    bool in_range = true;
+
+#ifdef __SSE2__
+    // two points per iteration: x, y, z scaled to steps and reflectance to
+    // 0..255 in the fourth lane, rounded and packed to int16 with saturation.
+    // Little endian, the reflectance int16 gives the uint8 and the padding byte.
+    const __m128 k     = _mm_setr_ps(inv_scale, inv_scale, inv_scale, 255.0f);
+    const __m128 lo    = _mm_setr_ps(-FLT_MAX, -FLT_MAX, -FLT_MAX, 0.0f);
+    const __m128 hi    = _mm_setr_ps( FLT_MAX,  FLT_MAX,  FLT_MAX, 255.0f);
+    const __m128 range = _mm_setr_ps(kCompactRange, kCompactRange, kCompactRange, FLT_MAX);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 out_of_range = _mm_setzero_ps();
+
+    for (; i + 2 <= end; i += 2)
+    {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(points + 4 * i), k);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(points + 4 * i + 4), k);
+        out_of_range = _mm_or_ps(out_of_range, _mm_cmpgt_ps(_mm_and_ps(a, abs_mask), range));
+        out_of_range = _mm_or_ps(out_of_range, _mm_cmpgt_ps(_mm_and_ps(b, abs_mask), range));
+        a = _mm_min_ps(_mm_max_ps(a, lo), hi);
+        b = _mm_min_ps(_mm_max_ps(b, lo), hi);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i *)(out + kCompactPointStep * i), packed);
+    }
+    in_range = _mm_movemask_ps(out_of_range) == 0;
+#endif
+
+    for (; i < end; i++)
+        in_range &= quantizePoint(points + 4 * i, inv_scale, out + kCompactPointStep * i);
+
+    return in_range;
+}
+
+/**
+ * @brief inRegion scalar version of the crop tests
+ * @return 1 if the point is kept, 0 otherwise
+ */
+inline int inRegion(const float *p, const CropRegion &region, float min_range2, float max_range2)
+{
+    const float x = p[0], y = p[1], z = p[2];
+    const float r2 = x * x + y * y + z * z;
+    const float *m = region.projection;
+    const float u = m[0] * x + m[1] * y + m[2]  * z + m[3];
+    const float v = m[4] * x + m[5] * y + m[6]  * z + m[7];
+    const float w = m[8] * x + m[9] * y + m[10] * z + m[11];
+    const int seen = (w > 0.0f) & (u >= 0.0f) & (u < region.width * w) & (v >= 0.0f) & (v < region.height * w);
+    return (r2 >= min_range2) & (r2 <= max_range2) & (seen | !region.frustum);
+}
+
+/**
+ * @brief cropBlock packs the kept points of [begin, end) at out
+ * @return number of points written
+ */
+size_t cropBlock(const float *points, size_t begin, size_t end, const CropRegion &region, float *out)
+{
+    const float min_range2 = region.min_range * region.min_range;
+    const float max_range2 = region.max_range > 0.0f ? region.max_range * region.max_range : FLT_MAX;
+    size_t i = begin, n = 0;
+
+#ifdef __SSE2__
+    // four points per iteration, transposed to x, y, z lanes
+    const float *m = region.projection;
+    const __m128 r_min = _mm_set1_ps(min_range2), r_max = _mm_set1_ps(max_range2);
+    const __m128 width = _mm_set1_ps(region.width), height = _mm_set1_ps(region.height);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 any = region.frustum ? zero : _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+    for (; i + 4 <= end; i += 4)
+    {
+        const float *p = points + 4 * i;
+        __m128 x = _mm_loadu_ps(p), y = _mm_loadu_ps(p + 4), z = _mm_loadu_ps(p + 8), r = _mm_loadu_ps(p + 12);
+        _MM_TRANSPOSE4_PS(x, y, z, r);
+
+        __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        __m128 keep = _mm_and_ps(_mm_cmpge_ps(r2, r_min), _mm_cmple_ps(r2, r_max));
+
+        __m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0]), x), _mm_mul_ps(_mm_set1_ps(m[1]), y)),
+                              _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2]), z), _mm_set1_ps(m[3])));
+        __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[4]), x), _mm_mul_ps(_mm_set1_ps(m[5]), y)),
+                              _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[6]), z), _mm_set1_ps(m[7])));
+        __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[8]), x), _mm_mul_ps(_mm_set1_ps(m[9]), y)),
+                              _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[10]), z), _mm_set1_ps(m[11])));
+        __m128 seen = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(w, zero), _mm_cmpge_ps(u, zero)),
+                                 _mm_and_ps(_mm_cmpge_ps(v, zero),
+                                            _mm_and_ps(_mm_cmplt_ps(u, _mm_mul_ps(width, w)), _mm_cmplt_ps(v, _mm_mul_ps(height, w)))));
+        keep = _mm_and_ps(keep, _mm_or_ps(seen, any));
+
+        const int mask = _mm_movemask_ps(keep);
+        for (int k = 0; k < 4; k++)
+        {
+            _mm_storeu_ps(out + 4 * n, _mm_loadu_ps(p + 4 * k));
+            n += (mask >> k) & 1;
+        }
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        memcpy(out + 4 * n, points + 4 * i, 4 * sizeof(float));
+        n += inRegion(points + 4 * i, region, min_range2, max_range2);
+    }
+    return n;
+}
+
+/// voxelizeScan shards, a few per thread to balance the uneven ones
+const size_t kVoxelShards = 64;
+
+/// voxel coordinate offset and mask in the packed keys, 21 bits per axis
+const int64_t kVoxelOffset = 1 << 20;
+const uint64_t kVoxelMask = (1 << 21) - 1;
+
+/// 64 bit mixer of the voxel keys (splitmix64 finalizer)
+inline uint64_t hashVoxel(uint64_t key)
+{
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+} // namespace
+
+void deskewScan(float *points, size_t count, const EgoMotion &motion, float scan_period, WorkerPool &pool)
+{
+    const float vx = motion.linear[0],  vy = motion.linear[1],  vz = motion.linear[2];
+    const float wx = motion.angular[0], wy = motion.angular[1], wz = motion.angular[2];
+    const float time_per_rad = -scan_period / (2.0f * float(M_PI));
+
+    pool.parallel_for(count, [ = ](size_t begin, size_t end)
+    {
+        float *p = points + 4 * begin;
+        for (size_t i = begin; i < end; i++, p += 4)
+        {
+            const float x = p[0], y = p[1], z = p[2];
+            const float t = fast_atan2(y, x) * time_per_rad;
+
+            p[0] = x + (wy * z - wz * y + vx) * t;
+            p[1] = y + (wz * x - wx * z + vy) * t;
+            p[2] = z + (wx * y - wy * x + vz) * t;
+        }
+    }, kPointsPerChunk);
+}
+
+size_t quantizeScan(const float *points, size_t count, float scale, uint8_t *out, WorkerPool &pool)
+{
+    const float inv_scale = 1.0f / scale;
+    bool in_range = true;
+    boost::mutex mutex;
+
+    pool.parallel_for(count, [&](size_t begin, size_t end)
+    {
+        if (!quantizeChunk(points, begin, end, inv_scale, out))
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            in_range = false;
+        }
+    }, kPointsPerChunk);
+
+    if (in_range)
+        return count;
+
+    // rare: some point is beyond the int16 range, compact the scan without it
+    size_t written = 0;
+    for (size_t i = 0; i < count; i++)
+        written += quantizePoint(points + 4 * i, inv_scale, out + kCompactPointStep * written);
+    return written;
+}
+
+void projectScan(const float *points, size_t count, int cols, float *image, RangeProjection &projection, WorkerPool &pool)
+{
+    const uint32_t cells = kRangeImageRows * cols;
+    projection.cell.resize(count);
+    projection.range.resize(count);
+    uint32_t *cell = projection.cell.data();
+    float *range = projection.range.data();
+
+    const float col_per_rad = -0.5f * cols / float(M_PI);
+    const float row_per_rad = -kRangeImageRows / (kRangeFovUp - kRangeFovDown);
+    const float max_col = cols - 1, max_row = kRangeImageRows - 1;
+
+    pool.parallel_for(count, [ = ](size_t begin, size_t end)
+    {
+        const float *p = points + 4 * begin;
+        for (size_t i = begin; i < end; i++, p += 4)
+        {
+            const float x = p[0], y = p[1], z = p[2];
+            const float planar = std::sqrt(x * x + y * y);
+            const float r = std::sqrt(planar * planar + z * z);
+
+            // azimuth +pi (behind, left) -> column 0, forward -> cols / 2; elevation fov_up -> row 0
+            float col = (fast_atan2(y, x) - float(M_PI)) * col_per_rad;
+            float row = (fast_atan2(z, planar) - kRangeFovUp) * row_per_rad;
+            col = col < 0.0f ? 0.0f : (col > max_col ? max_col : col);
+            row = row < 0.0f ? 0.0f : (row > max_row ? max_row : row);
+
+            range[i] = r;
+            cell[i] = r > 0.0f ? uint32_t(row) * cols + uint32_t(col) : cells;
+        }
+    }, kPointsPerChunk);
+
+    // scatter, the nearest point of a pixel wins
+    memset(image, 0, cells * 2 * sizeof(float));
+    for (size_t i = 0; i < count; i++)
+    {
+        if (cell[i] == cells)
+            continue;
+        float *pixel = image + 2 * cell[i];
+        if (pixel[0] == 0.0f || range[i] < pixel[0])
+        {
+            pixel[0] = range[i];
+            pixel[1] = points[4 * i + 3];
+        }
+    }
+}
+
+size_t cropScan(const float *points, size_t count, const CropRegion &region, float *out, std::vector<size_t> &blocks, WorkerPool &pool)
+{
+    blocks.resize((count + kPointsPerChunk - 1) / kPointsPerChunk);
+
+    // each block is packed at its own offset in out
+    pool.parallel_for(blocks.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t b = begin; b < end; b++)
+        {
+            const size_t first = b * kPointsPerChunk;
+            blocks[b] = cropBlock(points, first, std::min(first + kPointsPerChunk, count), region, out + 4 * first);
+        }
+    });
+
+    size_t written = blocks.empty() ? 0 : blocks[0];
+    for (size_t b = 1; b < blocks.size(); b++)
+    {
+        memmove(out + 4 * written, out + 4 * b * kPointsPerChunk, blocks[b] * 4 * sizeof(float));
+        written += blocks[b];
+    }
+    return written;
+}
+
+size_t voxelizeScan(const float *points, size_t count, float leaf, float *out, VoxelGrid &grid, WorkerPool &pool)
+{
+    const float inv_leaf = 1.0f / leaf;
+    const size_t blocks = (count + kPointsPerChunk - 1) / kPointsPerChunk;
+    grid.keys.resize(count);
+    grid.order.resize(count);
+    grid.offsets.assign(blocks * kVoxelShards + kVoxelShards + 1, 0);
+    grid.shards.resize(kVoxelShards);
+    uint64_t *keys = grid.keys.data();
+    size_t *counts = grid.offsets.data();                       // [block][shard]
+    size_t *shard_start = counts + blocks * kVoxelShards;       // [shard + 1]
+
+    // keys, and points per block and shard
+    pool.parallel_for(blocks, [&](size_t begin, size_t end)
+    {
+        for (size_t b = begin; b < end; b++)
+        {
+            size_t *block_counts = counts + b * kVoxelShards;
+            const size_t last = std::min((b + 1) * kPointsPerChunk, count);
+            for (size_t i = b * kPointsPerChunk; i < last; i++)
+            {
+                const float *p = points + 4 * i;
+                uint64_t key = 0;
+                for (int k = 0; k < 3; k++)
+                    key = (key << 21) | (uint64_t(int64_t(std::floor(p[k] * inv_leaf)) + kVoxelOffset) & kVoxelMask);
+                keys[i] = key;
+                block_counts[hashVoxel(key) % kVoxelShards]++;
+            }
+        }
+    });
+
+    // counting sort by shard, stable: counts become the write positions
+    size_t position = 0;
+    for (size_t s = 0; s < kVoxelShards; s++)
+    {
+        shard_start[s] = position;
+        for (size_t b = 0; b < blocks; b++)
+        {
+            size_t n = counts[b * kVoxelShards + s];
+            counts[b * kVoxelShards + s] = position;
+            position += n;
+        }
+    }
+    shard_start[kVoxelShards] = position;
+
+    pool.parallel_for(blocks, [&](size_t begin, size_t end)
+    {
+        for (size_t b = begin; b < end; b++)
+        {
+            size_t *next = counts + b * kVoxelShards;
+            const size_t last = std::min((b + 1) * kPointsPerChunk, count);
+            for (size_t i = b * kPointsPerChunk; i < last; i++)
+                grid.order[next[hashVoxel(keys[i]) % kVoxelShards]++] = i;
+        }
+    });
+
+    // every shard accumulates its voxels
+    pool.parallel_for(kVoxelShards, [&](size_t begin, size_t end)
+    {
+        for (size_t s = begin; s < end; s++)
+        {
+            VoxelGrid::Shard &shard = grid.shards[s];
+            const size_t n = shard_start[s + 1] - shard_start[s];
+            size_t size = 16;
+            while (size < 2 * n)
+                size *= 2;
+            shard.slots.assign(size, 0);
+            shard.voxels.clear();
+            const size_t mask = size - 1;
+
+            for (size_t j = shard_start[s]; j < shard_start[s + 1]; j++)
+            {
+                const uint32_t i = grid.order[j];
+                const uint64_t key = keys[i];
+                // the low bits pick the shard, the high ones the slot
+                size_t slot = (hashVoxel(key) >> 32) & mask;
+                while (shard.slots[slot] != 0 && shard.voxels[shard.slots[slot] - 1].key != key)
+                    slot = (slot + 1) & mask;
+
+                if (shard.slots[slot] == 0)
+                {
+                    VoxelGrid::Voxel voxel = { key, { 0.0f, 0.0f, 0.0f, 0.0f }, 0 };
+                    shard.voxels.push_back(voxel);
+                    shard.slots[slot] = shard.voxels.size();
+                }
+                VoxelGrid::Voxel &voxel = shard.voxels[shard.slots[slot] - 1];
+                for (int k = 0; k < 4; k++)
+                    voxel.sum[k] += points[4 * i + k];
+                voxel.count++;
+            }
+        }
+    });
+
+    // output offset of every shard, in place of its start in order
+    size_t written = 0;
+    for (size_t s = 0; s < kVoxelShards; s++)
+    {
+        shard_start[s] = written;
+        written += grid.shards[s].voxels.size();
+    }
+
+    pool.parallel_for(kVoxelShards, [&](size_t begin, size_t end)
+    {
+        for (size_t s = begin; s < end; s++)
+        {
+            const std::vector<VoxelGrid::Voxel> &voxels = grid.shards[s].voxels;
+            float *o = out + 4 * shard_start[s];
+            for (size_t v = 0; v < voxels.size(); v++, o += 4)
+            {
+                const float inv_count = 1.0f / voxels[v].count;
+                for (int k = 0; k < 4; k++)
+                    o[k] = voxels[v].sum[k] * inv_count;
+            }
+        }
+    });
+    return written;
+}
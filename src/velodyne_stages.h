@@ -0,0 +1,159 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * Processing stages applied to the Velodyne scans before publishing.
+ * Scans are plain float arrays, 4 floats per point: x, y, z, reflectance,
+ * the same layout of the KITTI .bin files.
+ */
+
+#ifndef KITTI_PLAYER_VELODYNE_STAGES_H
+#define KITTI_PLAYER_VELODYNE_STAGES_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+class WorkerPool;
+
+/// Ego-motion of the scanner during a scan, expressed in the velodyne frame
+struct EgoMotion
+{
+    float linear[3];    // velocity  [m/s]
+    float angular[3];   // angular rate [rad/s]
+};
+
+/**
+ * @brief deskewScan removes the motion distortion of a scan
+ * @param points scan, 4 floats per point, corrected in place
+ * @param count number of points
+ * @param motion scanner motion, assumed constant during the scan
+ * @param scan_period duration of a revolution [s]
+ * @param pool workers running the chunks of the scan
+ *
+ * The acquisition time of each point comes from its azimuth: KITTI scans start
+ * and end behind the car and are stamped when the scanner faces forward, so a
+ * point at azimuth a was taken at t = -a / (2 pi) * scan_period. Every point is
+ * moved to its pose at t = 0 with a first order (constant velocity, small
+ * rotation) model: p' = p + (w x p + v) t.
+ */
+void deskewScan(float *points, size_t count, const EgoMotion &motion, float scan_period, WorkerPool &pool);
+
+/// Compact point layout written by quantizeScan: int16 x, y, z, uint8 reflectance, 1 byte padding
+const size_t kCompactPointStep = 8;
+
+/**
+ * @brief quantizeScan packs a scan in kCompactPointStep bytes per point
+ * @param points scan, 4 floats per point
+ * @param count number of points
+ * @param scale size of a coordinate step [m]; value = round(coordinate / scale)
+ * @param out output buffer, count * kCompactPointStep bytes
+ * @param pool workers running the chunks of the scan
+ * @return number of points written
+ *
+ * Coordinates are within scale / 2 of the original ones; points farther than
+ * 32767 * scale on any axis are dropped. Reflectance is quantized to 1/255.
+ */
+size_t quantizeScan(const float *points, size_t count, float scale, uint8_t *out, WorkerPool &pool);
+
+/// Rows of the range images, one per HDL-64E laser
+const int kRangeImageRows = 64;
+
+/// Pixel and range of every point, kept by projectScan from scan to scan
+struct RangeProjection
+{
+    std::vector<uint32_t>   cell;   // row * cols + col, rows * cols if the point has no return
+    std::vector<float>      range;
+};
+
+/**
+ * @brief projectScan projects a scan on a spherical range image
+ * @param points scan, 4 floats per point
+ * @param count number of points
+ * @param cols image width, 360 degrees of azimuth
+ * @param image output, kRangeImageRows x cols pixels of 2 floats: range [m], reflectance;
+ *        0, 0 where no point falls
+ * @param projection per point buffers, reused
+ * @param pool workers running the chunks of the scan
+ *
+ * KITTI scans carry no laser index: rows are elevation bins over the HDL-64E
+ * field of view (+3 to -25 degrees), columns azimuth bins with the forward
+ * direction in the middle and the left side on the left. The pixel of every
+ * point is computed by a branch-free loop over the chunks of the scan, then
+ * the points are scattered keeping the nearest one of each pixel.
+ */
+void projectScan(const float *points, size_t count, int cols, float *image, RangeProjection &projection, WorkerPool &pool);
+
+/// Points kept by cropScan
+struct CropRegion
+{
+    float   min_range;          // [m]
+    float   max_range;          // [m], 0 = no limit
+    bool    frustum;            // only keep the points seen by a camera
+    float   projection[12];     // velodyne point -> (u w, v w, w) pixel of the camera, 3x4 row major
+    float   width, height;      // camera image size [pixels]
+};
+
+/**
+ * @brief cropScan copies the points of a scan that are within a region
+ * @param points scan, 4 floats per point
+ * @param count number of points
+ * @param region range limits and camera frustum
+ * @param out output, room for count points; the kept points are packed at its start
+ * @param blocks points kept per block, reused
+ * @param pool workers running the blocks of the scan
+ * @return number of points written
+ *
+ * Every block of the scan is filtered in its own part of out, four points at
+ * a time with SSE2: the tests give a lane mask, and each point is stored
+ * unconditionally at the write position, that only advances when the point
+ * is kept. The blocks are then moved next to each other.
+ */
+size_t cropScan(const float *points, size_t count, const CropRegion &region, float *out, std::vector<size_t> &blocks, WorkerPool &pool);
+
+/**
+ * @brief The VoxelGrid struct keeps the buffers of voxelizeScan from scan to scan
+ *
+ * The voxels are sharded by the hash of their coordinates: every shard is an
+ * open addressing table over an arena of voxels, both only growing, so that a
+ * steady playback does not allocate.
+ */
+struct VoxelGrid
+{
+    struct Voxel
+    {
+        uint64_t    key;        // packed voxel coordinates
+        float       sum[4];     // x, y, z, reflectance
+        uint32_t    count;
+    };
+
+    struct Shard
+    {
+        std::vector<uint32_t>   slots;      // voxel index + 1, 0 = empty
+        std::vector<Voxel>      voxels;     // arena, in insertion order
+    };
+
+    std::vector<uint64_t>   keys;           // voxel of every point
+    std::vector<uint32_t>   order;          // points grouped by shard
+    std::vector<size_t>     offsets;        // per block and shard, then start of every shard in order
+    std::vector<Shard>      shards;
+};
+
+/**
+ * @brief voxelizeScan downsamples a scan on a voxel grid
+ * @param points scan, 4 floats per point
+ * @param count number of points
+ * @param leaf voxel size [m]
+ * @param out output, room for count points: one point per occupied voxel, the
+ *        centroid and the mean reflectance of its points
+ * @param grid buffers, reused
+ * @param pool workers running the blocks of the scan and the shards
+ * @return number of points written
+ *
+ * The points are keyed and counted per shard block by block, grouped by shard
+ * with a counting sort, then every shard accumulates its voxels on its own
+ * thread, without locks. The output is in a deterministic order: by shard,
+ * then by first point of the voxel.
+ */
+size_t voxelizeScan(const float *points, size_t count, float leaf, float *out, VoxelGrid &grid, WorkerPool &pool);
+
+#endif // KITTI_PLAYER_VELODYNE_STAGES_H
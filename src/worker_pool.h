@@ -0,0 +1,136 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * WorkerPool: data-parallel loops for the per-frame processing stages.
+ */
+
+#ifndef KITTI_PLAYER_WORKER_POOL_H
+#define KITTI_PLAYER_WORKER_POOL_H
+
+#include <algorithm>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * @brief The WorkerPool class runs data-parallel loops on a fixed set of threads
+ *
+ * parallel_for splits [0, n) in chunks that are run by the workers and by the
+ * calling thread, and returns when every chunk is done. The threads are created
+ * once, so a loop costs a wake-up and not a thread spawn. Loops issued from
+ * different threads are serialized.
+ */
+class WorkerPool
+{
+public:
+    typedef boost::function<void (size_t begin, size_t end)> Body;
+
+    /**
+     * @brief WorkerPool
+     * @param threads total number of threads running a loop, caller included.
+     *        0: one per hardware thread
+     */
+    explicit WorkerPool(unsigned int threads = 0)
+        : body_(NULL), n_(0), next_(0), chunk_(1), pending_(0), generation_(0), stop_(false)
+    {
+        if (threads == 0)
+            threads = std::max(1u, boost::thread::hardware_concurrency());
+        for (unsigned int i = 1; i < threads; i++)
+            threads_.create_thread(boost::bind(&WorkerPool::worker, this));
+    }
+
+    ~WorkerPool()
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        threads_.join_all();
+    }
+
+    /// number of threads running a loop, caller included
+    unsigned int size() const
+    {
+        return threads_.size() + 1;
+    }
+
+    /**
+     * @brief parallel_for runs body over [0, n) and waits for it
+     * @param n number of items
+     * @param body called with disjoint [begin, end) ranges
+     * @param min_chunk minimum number of items per call
+     */
+    void parallel_for(size_t n, const Body &body, size_t min_chunk = 1)
+    {
+        if (n == 0)
+            return;
+
+        boost::mutex::scoped_lock run_lock(run_mutex_);
+        boost::mutex::scoped_lock lock(mutex_);
+
+        // a few chunks per thread, to balance uneven items
+        body_ = &body;
+        n_ = n;
+        next_ = 0;
+        chunk_ = std::max(min_chunk, (n + 4 * size() - 1) / (4 * size()));
+        pending_ = (n + chunk_ - 1) / chunk_;
+        generation_++;
+        work_cv_.notify_all();
+
+        runChunks(lock);
+        while (pending_ > 0)
+            done_cv_.wait(lock);
+        body_ = NULL;
+    }
+
+private:
+    /// runs the chunks left in the current loop; lock is held on entry and exit
+    void runChunks(boost::mutex::scoped_lock &lock)
+    {
+        while (next_ < n_)
+        {
+            size_t begin = next_;
+            size_t end = std::min(n_, begin + chunk_);
+            next_ = end;
+
+            const Body &body = *body_;
+            lock.unlock();
+            body(begin, end);
+            lock.lock();
+
+            if (--pending_ == 0)
+                done_cv_.notify_all();
+        }
+    }
+
+    void worker()
+    {
+        unsigned int seen = 0;
+        boost::mutex::scoped_lock lock(mutex_);
+        while (true)
+        {
+            while (!stop_ && generation_ == seen)
+                work_cv_.wait(lock);
+            if (stop_)
+                return;
+            seen = generation_;
+            runChunks(lock);
+        }
+    }
+
+    boost::mutex                run_mutex_;     // one loop at a time
+    boost::mutex                mutex_;
+    boost::condition_variable   work_cv_;
+    boost::condition_variable   done_cv_;
+    boost::thread_group         threads_;
+
+    const Body     *body_;
+    size_t          n_;
+    size_t          next_;
+    size_t          chunk_;
+    size_t          pending_;       // chunks not completed yet
+    unsigned int    generation_;    // incremented at every loop
+    bool            stop_;
+};
+
+#endif // KITTI_PLAYER_WORKER_POOL_H
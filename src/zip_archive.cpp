@@ -0,0 +1,538 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * zip_archive: read access to the KITTI zip archives, without extracting them.
+ */
+
+#include <kitti_player/zip_archive.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/thread/mutex.hpp>
+#include <zlib.h>
+
+using namespace std;
+
+namespace kitti_player
+{
+
+namespace
+{
+
+const uint32_t kLocalHeader        = 0x04034b50;
+const uint32_t kCentralHeader      = 0x02014b50;
+const uint32_t kEndOfCentral       = 0x06054b50;
+const uint32_t kEndOfCentral64     = 0x06064b50;
+const uint32_t kEndOfCentral64Lock = 0x07064b50;
+
+const size_t kEndOfCentralBytes = 22;
+const size_t kMaxComment        = 65535;
+
+const char     kIndexMagic[4] = { 'K', 'Z', 'I', '1' };
+const uint32_t kIndexVersion  = 1;
+
+inline uint16_t get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+inline uint32_t get32(const uint8_t *p)
+{
+    return get16(p) | (uint32_t(get16(p + 2)) << 16);
+}
+
+inline uint64_t get64(const uint8_t *p)
+{
+    return get32(p) | (uint64_t(get32(p + 4)) << 32);
+}
+
+/// reads exactly size bytes at offset; return true if read
+bool preadAll(int fd, void *out, size_t size, uint64_t offset)
+{
+    uint8_t *dest = static_cast<uint8_t*>(out);
+    while (size > 0)
+    {
+        ssize_t got = pread(fd, dest, size, offset);
+        if (got <= 0)
+            return false;
+        dest += got;
+        size -= got;
+        offset += got;
+    }
+    return true;
+}
+
+/// frees a member mapping
+struct Unmapper
+{
+    void   *base;
+    size_t  bytes;
+
+    void operator()(uint8_t *) const
+    {
+        munmap(base, bytes);
+    }
+};
+
+/// compressed bytes of the deflated members, one buffer per thread
+vector<uint8_t> &compressedBuffer()
+{
+    static thread_local vector<uint8_t> buffer;
+    return buffer;
+}
+
+/// index file record, followed by the name
+struct IndexRecord
+{
+    uint64_t    data_offset;
+    uint64_t    compressed;
+    uint64_t    size;
+    uint32_t    method;
+    uint32_t    name_length;
+};
+
+struct IndexHeader
+{
+    char        magic[4];
+    uint32_t    version;
+    uint64_t    archive_size;
+    int64_t     archive_mtime;
+    uint64_t    members;
+};
+
+// mounted archives, by the directory they overlay; replaced, never modified
+struct Mount
+{
+    string                              prefix;
+    boost::shared_ptr<const ZipArchive> archive;
+};
+
+boost::mutex mount_mutex;
+boost::shared_ptr<const vector<Mount> > mounts(new vector<Mount>);
+
+boost::shared_ptr<const vector<Mount> > currentMounts()
+{
+    boost::mutex::scoped_lock lock(mount_mutex);
+    return mounts;
+}
+
+string parentDirectory(const string &path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == string::npos ? "" : path.substr(0, slash + 1);
+}
+
+} // namespace
+
+ZipArchive::ZipArchive()
+    : fd_(-1), index_loaded_(false)
+{
+}
+
+ZipArchive::~ZipArchive()
+{
+    close();
+}
+
+void ZipArchive::close()
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+    members_.clear();
+    directories_.clear();
+    index_loaded_ = false;
+}
+
+int ZipArchive::open(const string &filename)
+{
+    close();
+    fd_ = ::open(filename.c_str(), O_RDONLY);
+    if (fd_ < 0)
+        return 0;
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+    {
+        close();
+        return 0;
+    }
+    filename_ = filename;
+
+    // the index is valid as long as the archive keeps its size and modification time
+    const string index_file = filename + ".idx";
+    if (loadIndex(index_file, st.st_size, st.st_mtime))
+        index_loaded_ = true;
+    else if (readCentralDirectory(st.st_size))
+        saveIndex(index_file, st.st_size, st.st_mtime);    // optional, e.g. read-only storage
+    else
+    {
+        close();
+        return 0;
+    }
+
+    indexDirectories();
+    return 1;
+}
+
+int ZipArchive::readCentralDirectory(uint64_t archive_size)
+{
+    if (archive_size < kEndOfCentralBytes)
+        return 0;
+
+    // end of central directory record, before an optional comment
+    size_t tail_bytes = min<uint64_t>(archive_size, kEndOfCentralBytes + kMaxComment);
+    vector<uint8_t> tail(tail_bytes);
+    if (!preadAll(fd_, tail.data(), tail_bytes, archive_size - tail_bytes))
+        return 0;
+    ssize_t eocd = tail_bytes - kEndOfCentralBytes;
+    while (eocd >= 0 && get32(&tail[eocd]) != kEndOfCentral)
+        eocd--;
+    if (eocd < 0)
+        return 0;
+
+    uint64_t entries = get16(&tail[eocd + 10]);
+    uint64_t cd_size = get32(&tail[eocd + 12]);
+    uint64_t cd_offset = get32(&tail[eocd + 16]);
+
+    // zip64: the locator precedes the end record
+    if (eocd >= 20 && get32(&tail[eocd - 20]) == kEndOfCentral64Lock)
+    {
+        uint8_t record[56];
+        if (!preadAll(fd_, record, sizeof(record), get64(&tail[eocd - 20 + 8])) || get32(record) != kEndOfCentral64)
+            return 0;
+        entries = get64(record + 32);
+        cd_size = get64(record + 40);
+        cd_offset = get64(record + 48);
+    }
+    if (cd_offset + cd_size > archive_size)
+        return 0;
+
+    vector<uint8_t> cd(cd_size);
+    if (!preadAll(fd_, cd.data(), cd_size, cd_offset))
+        return 0;
+
+    const uint8_t *p = cd.data();
+    const uint8_t *end = p + cd_size;
+    for (uint64_t e = 0; e < entries; e++)
+    {
+        if (end - p < 46 || get32(p) != kCentralHeader)
+            return 0;
+        uint16_t name_length = get16(p + 28);
+        uint16_t extra_length = get16(p + 30);
+        uint16_t comment_length = get16(p + 32);
+        if (size_t(end - p) < 46u + name_length + extra_length + comment_length)
+            return 0;
+
+        Member member;
+        member.method = get16(p + 10);
+        member.compressed = get32(p + 20);
+        member.size = get32(p + 24);
+        uint64_t local_offset = get32(p + 42);
+        string name(reinterpret_cast<const char*>(p + 46), name_length);
+
+        // zip64 extra field: the 64 bit values saturated in the header, in this order
+        const uint8_t *extra = p + 46 + name_length;
+        const uint8_t *extra_end = extra + extra_length;
+        while (extra_end - extra >= 4)
+        {
+            uint16_t id = get16(extra);
+            uint16_t bytes = get16(extra + 2);
+            const uint8_t *field = extra + 4;
+            if (id == 0x0001)
+            {
+                const uint8_t *field_end = field + bytes;
+                if (member.size == 0xffffffffu && field_end - field >= 8)
+                    member.size = get64(field), field += 8;
+                if (member.compressed == 0xffffffffu && field_end - field >= 8)
+                    member.compressed = get64(field), field += 8;
+                if (local_offset == 0xffffffffu && field_end - field >= 8)
+                    local_offset = get64(field);
+                break;
+            }
+            extra = field + bytes;
+        }
+        p += 46 + name_length + extra_length + comment_length;
+
+        if (name.empty() || name[name.size() - 1] == '/')
+            continue;   // directory
+
+        // the data follows the local header, whose name and extra field may differ in length
+        uint8_t local[30];
+        if (!preadAll(fd_, local, sizeof(local), local_offset) || get32(local) != kLocalHeader)
+            return 0;
+        member.data_offset = local_offset + sizeof(local) + get16(local + 26) + get16(local + 28);
+        if (member.data_offset + member.compressed > archive_size)
+            return 0;
+        members_[name] = member;
+    }
+    return 1;
+}
+
+int ZipArchive::loadIndex(const string &index_file, uint64_t archive_size, int64_t archive_mtime)
+{
+    ifstream file(index_file.c_str(), ios::binary);
+    if (!file.is_open())
+        return 0;
+
+    IndexHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        memcmp(header.magic, kIndexMagic, sizeof(header.magic)) != 0 || header.version != kIndexVersion ||
+        header.archive_size != archive_size || header.archive_mtime != archive_mtime)
+        return 0;
+
+    // a record out of the archive (e.g. a damaged index) makes it rebuilt from the central directory
+    members_.clear();
+    string name;
+    for (uint64_t i = 0; i < header.members; i++)
+    {
+        IndexRecord record;
+        if (!file.read(reinterpret_cast<char*>(&record), sizeof(record)) || record.name_length > 65535 ||
+            record.compressed > archive_size || record.data_offset > archive_size - record.compressed ||
+            (record.method == 0 && record.size != record.compressed))
+        {
+            members_.clear();
+            return 0;
+        }
+        name.resize(record.name_length);
+        if (!file.read(&name[0], record.name_length))
+        {
+            members_.clear();
+            return 0;
+        }
+
+        Member &member = members_[name];
+        member.data_offset = record.data_offset;
+        member.compressed = record.compressed;
+        member.size = record.size;
+        member.method = record.method;
+    }
+    return 1;
+}
+
+int ZipArchive::saveIndex(const string &index_file, uint64_t archive_size, int64_t archive_mtime) const
+{
+    // written aside, in a file of its own, and renamed: concurrent players never read a partial index
+    string temporary = index_file + ".XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if (fd < 0)
+        return 0;
+    fchmod(fd, 0644);
+    ::close(fd);
+    {
+        ofstream file(temporary.c_str(), ios::binary | ios::trunc);
+        if (!file.is_open())
+        {
+            unlink(temporary.c_str());
+            return 0;
+        }
+
+        IndexHeader header;
+        memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+        header.version = kIndexVersion;
+        header.archive_size = archive_size;
+        header.archive_mtime = archive_mtime;
+        header.members = members_.size();
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (std::map<string, Member>::const_iterator it = members_.begin(); it != members_.end(); ++it)
+        {
+            IndexRecord record;
+            record.data_offset = it->second.data_offset;
+            record.compressed = it->second.compressed;
+            record.size = it->second.size;
+            record.method = it->second.method;
+            record.name_length = it->first.size();
+            file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+            file.write(it->first.data(), it->first.size());
+        }
+        if (!file.good())
+        {
+            unlink(temporary.c_str());
+            return 0;
+        }
+    }
+    if (rename(temporary.c_str(), index_file.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return 0;
+    }
+    return 1;
+}
+
+void ZipArchive::indexDirectories()
+{
+    directories_.clear();
+    for (std::map<string, Member>::const_iterator it = members_.begin(); it != members_.end(); ++it)
+    {
+        string dir = parentDirectory(it->first);
+        directories_[dir]++;
+
+        // parents without files of their own
+        while (!dir.empty())
+        {
+            dir = parentDirectory(dir.substr(0, dir.size() - 1));
+            if (directories_.count(dir))
+                break;
+            directories_[dir] = 0;
+        }
+    }
+}
+
+const ZipArchive::Member *ZipArchive::find(const string &name) const
+{
+    std::map<string, Member>::const_iterator it = members_.find(name);
+    return it == members_.end() ? NULL : &it->second;
+}
+
+unsigned int ZipArchive::countFiles(const string &dir) const
+{
+    std::map<string, unsigned int>::const_iterator it = directories_.find(dir);
+    return it == directories_.end() ? 0 : it->second;
+}
+
+bool ZipArchive::hasDirectory(const string &dir) const
+{
+    return directories_.count(dir) > 0;
+}
+
+int ZipArchive::read(const Member &member, void *out) const
+{
+    if (fd_ < 0)
+        return 0;
+    if (member.method == 0)
+        return member.compressed == member.size && preadAll(fd_, out, member.size, member.data_offset);
+    if (member.method != Z_DEFLATED)
+        return 0;
+
+    vector<uint8_t> &compressed = compressedBuffer();
+    compressed.resize(member.compressed);
+    if (!preadAll(fd_, compressed.data(), member.compressed, member.data_offset))
+        return 0;
+
+    // raw deflate stream, no zlib header
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+        return 0;
+    stream.next_in = compressed.data();
+    stream.avail_in = member.compressed;
+    stream.next_out = static_cast<Bytef*>(out);
+    stream.avail_out = member.size;
+    int status = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    return status == Z_STREAM_END && stream.total_out == member.size;
+}
+
+boost::shared_ptr<uint8_t> ZipArchive::map(const Member &member) const
+{
+    if (fd_ < 0 || member.method != 0 || member.compressed != member.size || member.size == 0)
+        return boost::shared_ptr<uint8_t>();
+
+    // mappings start on a page: the member sits at skip bytes in it
+    const uint64_t page = sysconf(_SC_PAGESIZE);
+    const uint64_t start = member.data_offset / page * page;
+    const size_t skip = member.data_offset - start;
+    const size_t bytes = skip + member.size;
+    void *base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd_, start);
+    if (base == MAP_FAILED)
+        return boost::shared_ptr<uint8_t>();
+
+    Unmapper unmapper = { base, bytes };
+    return boost::shared_ptr<uint8_t>(static_cast<uint8_t*>(base) + skip, unmapper);
+}
+
+void ZipArchive::prefetch(const Member &member) const
+{
+    if (fd_ >= 0)
+        posix_fadvise(fd_, member.data_offset, member.compressed, POSIX_FADV_WILLNEED);
+}
+
+string ZipArchive::driveDirectory() const
+{
+    static const char *sensors[] = { "/oxts/", "/velodyne_points/", "/image_00/", "/image_02/" };
+    for (std::map<string, Member>::const_iterator it = members_.begin(); it != members_.end(); ++it)
+    {
+        for (size_t s = 0; s < sizeof(sensors) / sizeof(sensors[0]); s++)
+        {
+            size_t found = ("/" + it->first).find(sensors[s]);
+            if (found != string::npos)
+                return it->first.substr(0, found);
+        }
+    }
+    return "";
+}
+
+int mountArchive(const string &zip)
+{
+    boost::mutex::scoped_lock lock(mount_mutex);
+    for (size_t i = 0; i < mounts->size(); i++)
+        if ((*mounts)[i].archive->filename() == zip)
+            return 1;
+
+    boost::shared_ptr<ZipArchive> archive(new ZipArchive);
+    if (!archive->open(zip))
+        return 0;
+
+    boost::shared_ptr<vector<Mount> > updated(new vector<Mount>(*mounts));
+    Mount mount;
+    mount.prefix = parentDirectory(zip);
+    mount.archive = archive;
+    updated->push_back(mount);
+    mounts = updated;
+    return 1;
+}
+
+int mountDrive(const string &zip, string &drive_path)
+{
+    if (!mountArchive(zip))
+        return 0;
+
+    string member;
+    boost::shared_ptr<const ZipArchive> archive;
+    {
+        boost::shared_ptr<const vector<Mount> > current = currentMounts();
+        for (size_t i = 0; i < current->size() && !archive; i++)
+            if ((*current)[i].archive->filename() == zip)
+                archive = (*current)[i].archive;
+    }
+    string drive = archive ? archive->driveDirectory() : "";
+    if (drive.empty())
+        return 0;
+    drive_path = parentDirectory(zip) + drive;
+
+    // KITTI ships the calibration of a day apart: <day>_calib.zip holds <day>/calib_*.txt
+    string day = drive.substr(0, drive.find('/'));
+    string calib_zip = parentDirectory(zip) + day + "_calib.zip";
+    struct stat st;
+    if (drive.find('/') != drive.size() - 1 && stat(calib_zip.c_str(), &st) == 0)
+        mountArchive(calib_zip);
+    return 1;
+}
+
+boost::shared_ptr<const ZipArchive> findMounted(const string &path, string &member)
+{
+    boost::shared_ptr<const vector<Mount> > current = currentMounts();
+    for (size_t i = 0; i < current->size(); i++)
+    {
+        const Mount &mount = (*current)[i];
+        if (path.compare(0, mount.prefix.size(), mount.prefix) != 0)
+            continue;
+        string name = path.substr(mount.prefix.size());
+        if (mount.archive->find(name) != NULL || mount.archive->hasDirectory(name))
+        {
+            member.swap(name);
+            return mount.archive;
+        }
+    }
+    return boost::shared_ptr<const ZipArchive>();
+}
+
+} // namespace kitti_player
@@ -0,0 +1,69 @@
+/*
+ * KITTI_PLAYER v2.
+ *
+ * throughput_check: writes a synthetic drive with kitti_generate, then plays
+ * it with kitti_player --profile for each combination of streams, against
+ * the baseline of this machine in the build directory.
+ *
+ * Throughputs only compare on the same machine: the first run, without a
+ * baseline file, records it (--recordBaseline); the later ones check against
+ * it. Remove the file to record it again, e.g. after a hardware change.
+ *
+ * KITTI_PLAYER, KITTI_GENERATE and THROUGHPUT_BASELINE are set by CMake.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+#include <gtest/gtest.h>
+
+using namespace std;
+
+namespace
+{
+
+/// combinations of streams played, as on the command line
+const char *kStreams[] = { "-v", "-C", "-G", "-a", "-a -T" };
+
+/// exit status of a shell command, -1 if it did not exit
+int run(const string &command)
+{
+    int status = system(command.c_str());
+    return status != -1 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+} // namespace
+
+TEST(Throughput, Baseline)
+{
+    const string drive = boost::str(boost::format("/tmp/kitti_player_throughput_%d") % getpid());
+    ASSERT_EQ(0, run(string(KITTI_GENERATE) + " -d " + drive + " -n 100"));
+
+    // calibration run: every combination is recorded, none can be missing afterwards
+    const bool record = !ifstream(THROUGHPUT_BASELINE).good();
+    if (record)
+        cout << "Recording the throughput baseline of this machine in " THROUGHPUT_BASELINE << endl;
+
+    for (size_t i = 0; i < sizeof(kStreams) / sizeof(kStreams[0]); i++)
+    {
+        // kitti_player skips its last two arguments, the __name and __log appended by roslaunch
+        string command = string(KITTI_PLAYER) + " -d " + drive + " " + kStreams[i] +
+                         " --profile --baseline " THROUGHPUT_BASELINE " --tolerance 0.2" +
+                         (record ? " --recordBaseline" : "") + " __name:=throughput_player __log:=/dev/null";
+        EXPECT_EQ(0, run(command)) << command;
+    }
+
+    run("rm -rf " + drive);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}